@@ -0,0 +1,143 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/files/memory_mapped_file.h"
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+
+namespace base::files
+{
+    namespace
+    {
+        // The file mapping calls of the platform: a section view on Windows,
+        // mmap elsewhere. Both return NULL for a missing, empty or unmappable
+        // file.
+#ifdef _WIN32
+        const uint8_t* MapFile(_In_ const std::filesystem::path& file_name, _Out_ size_t* length)
+        {
+            HANDLE file = CreateFileW(file_name.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return nullptr;
+            }
+
+            auto close_file = stdext::scope_exit([file]() { CloseHandle(file); });
+
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+                static_cast<ULONGLONG>(size.QuadPart) > SIZE_MAX) {
+                return nullptr;
+            }
+
+            HANDLE section = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (section == nullptr) {
+                return nullptr;
+            }
+
+            // The view keeps the section alive.
+            const auto data = static_cast<const uint8_t*>(MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(section);
+
+            *length = static_cast<size_t>(size.QuadPart);
+            return data;
+        }
+
+        void UnmapFile(_In_ const uint8_t* data, _In_ size_t /*length*/)
+        {
+            UnmapViewOfFile(data);
+        }
+#else
+        const uint8_t* MapFile(_In_ const std::filesystem::path& file_name, _Out_ size_t* length)
+        {
+            const int file = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file < 0) {
+                return nullptr;
+            }
+
+            struct stat status{};
+            if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size <= 0 ||
+                static_cast<uint64_t>(status.st_size) > SIZE_MAX) {
+                close(file);
+                return nullptr;
+            }
+
+            // The mapping keeps the file open.
+            const auto size = static_cast<size_t>(status.st_size);
+            const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+            close(file);
+
+            if (data == MAP_FAILED) {
+                return nullptr;
+            }
+
+            *length = size;
+            return static_cast<const uint8_t*>(data);
+        }
+
+        void UnmapFile(_In_ const uint8_t* data, _In_ size_t length)
+        {
+            munmap(const_cast<uint8_t*>(data), length);
+        }
+#endif
+    }
+
+    MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+        : _Data(other._Data)
+        , _Length(other._Length)
+    {
+        other._Data   = nullptr;
+        other._Length = 0;
+    }
+
+    MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            Close();
+
+            _Data   = other._Data;
+            _Length = other._Length;
+
+            other._Data   = nullptr;
+            other._Length = 0;
+        }
+        return *this;
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        Close();
+    }
+
+    bool MemoryMappedFile::Initialize(_In_ const std::filesystem::path& file_name)
+    {
+        Close();
+
+        size_t length = 0;
+        _Data = MapFile(file_name, &length);
+        if (_Data == nullptr) {
+            return false;
+        }
+
+        _Length = length;
+        return true;
+    }
+
+    void MemoryMappedFile::Close()
+    {
+        if (_Data != nullptr) {
+            UnmapFile(_Data, _Length);
+        }
+
+        _Data   = nullptr;
+        _Length = 0;
+    }
+}
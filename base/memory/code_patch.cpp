@@ -0,0 +1,290 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/memory/code_patch.h"
+#   include <algorithm>
+#   include <cerrno>
+#   include <cstdio>
+#   include <cstring>
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+
+namespace base::memory
+{
+    namespace
+    {
+        // A run of pages that share one protection.
+        struct ProtectedRange
+        {
+            uint8_t* Address;
+            size_t   Length;
+            DWORD    OldProtection;
+        };
+
+        // The page protection calls of the platform: VirtualProtect on
+        // Windows, mprotect elsewhere.
+#ifdef _WIN32
+        size_t GetPageSize()
+        {
+            SYSTEM_INFO system_info{};
+            GetSystemInfo(&system_info);
+            return system_info.dwPageSize;
+        }
+
+        DWORD GetWritableProtection(DWORD protection)
+        {
+            const DWORD executable = PAGE_EXECUTE | PAGE_EXECUTE_READ |
+                PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+            // Keep the pages executable: other threads may be running them.
+            return (protection & executable) ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+        }
+
+        void RestoreProtection(const std::vector<ProtectedRange>& ranges)
+        {
+            for (const auto& range : ranges) {
+                DWORD old_protection = 0;
+                VirtualProtect(range.Address, range.Length, range.OldProtection, &old_protection);
+            }
+        }
+
+        // Makes [first, last) writable, one VirtualProtect per run of pages
+        // with the same protection.
+        DWORD MakeWritable(uint8_t* first, uint8_t* last, std::vector<ProtectedRange>& ranges)
+        {
+            while (first < last) {
+                MEMORY_BASIC_INFORMATION info{};
+                if (VirtualQuery(first, &info, sizeof(info)) != sizeof(info)) {
+                    return GetLastError();
+                }
+
+                const auto region_last = static_cast<uint8_t*>(info.BaseAddress) + info.RegionSize;
+                const auto length = static_cast<size_t>(std::min(last, region_last) - first);
+
+                DWORD old_protection = 0;
+                if (!VirtualProtect(first, length, GetWritableProtection(info.Protect), &old_protection)) {
+                    return GetLastError();
+                }
+
+                ranges.push_back({ first, length, old_protection });
+                first += length;
+            }
+
+            return NO_ERROR;
+        }
+
+        void FlushCode(const std::vector<ProtectedRange>& ranges)
+        {
+            for (const auto& range : ranges) {
+                FlushInstructionCache(GetCurrentProcess(), range.Address, range.Length);
+            }
+        }
+#else
+        size_t GetPageSize()
+        {
+            return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        DWORD ErrorFromErrno(int error)
+        {
+            switch (error) {
+            case EACCES:
+            case EPERM:
+                return ERROR_ACCESS_DENIED;
+            case ENOMEM:
+                return ERROR_INVALID_ADDRESS;
+            case EINVAL:
+                return ERROR_INVALID_PARAMETER;
+            default:
+                return ERROR_GEN_FAILURE;
+            }
+        }
+
+        void RestoreProtection(const std::vector<ProtectedRange>& ranges)
+        {
+            for (const auto& range : ranges) {
+                mprotect(range.Address, range.Length, static_cast<int>(range.OldProtection));
+            }
+        }
+
+        // Makes [first, last) writable, one mprotect per mapping. mprotect
+        // cannot report the protection it replaces, so the mappings and
+        // their protections are read from /proc/self/maps first.
+        DWORD MakeWritable(uint8_t* first, uint8_t* last, std::vector<ProtectedRange>& ranges)
+        {
+            FILE* maps = fopen("/proc/self/maps", "r");
+            if (maps == nullptr) {
+                return ErrorFromErrno(errno);
+            }
+
+            std::vector<ProtectedRange> mappings;
+            char line[512];
+
+            for (auto cursor = first; cursor < last && fgets(line, sizeof(line), maps);) {
+                unsigned long long map_first = 0;
+                unsigned long long map_last = 0;
+                char permissions[5] = {};
+                if (sscanf(line, "%llx-%llx %4s", &map_first, &map_last, permissions) != 3) {
+                    continue;
+                }
+
+                const auto region_first = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(map_first));
+                const auto region_last  = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(map_last));
+                if (region_last <= cursor) {
+                    continue;
+                }
+                if (region_first > cursor) {
+                    // A hole: the page is not mapped.
+                    break;
+                }
+
+                DWORD protection = PROT_NONE;
+                protection |= permissions[0] == 'r' ? PROT_READ : 0;
+                protection |= permissions[1] == 'w' ? PROT_WRITE : 0;
+                protection |= permissions[2] == 'x' ? PROT_EXEC : 0;
+
+                const auto length = static_cast<size_t>(std::min(last, region_last) - cursor);
+                mappings.push_back({ cursor, length, protection });
+                cursor += length;
+            }
+
+            fclose(maps);
+
+            if (mappings.empty() || mappings.back().Address + mappings.back().Length < last) {
+                return ERROR_INVALID_ADDRESS;
+            }
+
+            for (const auto& mapping : mappings) {
+                // Keep the pages executable: other threads may be running them.
+                const int protection = PROT_READ | PROT_WRITE | static_cast<int>(mapping.OldProtection & PROT_EXEC);
+
+                if (mprotect(mapping.Address, mapping.Length, protection) != 0) {
+                    return ErrorFromErrno(errno);
+                }
+                ranges.push_back(mapping);
+            }
+
+            return NO_ERROR;
+        }
+
+        void FlushCode(const std::vector<ProtectedRange>& ranges)
+        {
+            for (const auto& range : ranges) {
+                __builtin___clear_cache(reinterpret_cast<char*>(range.Address),
+                    reinterpret_cast<char*>(range.Address + range.Length));
+            }
+        }
+#endif
+    }
+
+    bool CodePatchTransaction::Add(
+        _Inout_ void* address,
+        _In_reads_bytes_(length) const void* new_code,
+        _In_ size_t length
+    ) {
+        if ((address == nullptr) || (new_code == nullptr) || (length == 0) || _Committed) {
+            return false;
+        }
+
+        auto data = static_cast<const uint8_t*>(new_code);
+        _Writes.push_back({ static_cast<uint8_t*>(address), { data, data + length }, {} });
+        return true;
+    }
+
+    DWORD CodePatchTransaction::Commit()
+    {
+        if (_Committed) {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        std::sort(_Writes.begin(), _Writes.end(), [](const Write& left, const Write& right) {
+            return left.Address < right.Address;
+        });
+
+        for (size_t i = 1; i < _Writes.size(); ++i) {
+            if (_Writes[i - 1].Address + _Writes[i - 1].NewCode.size() > _Writes[i].Address) {
+                return ERROR_INVALID_PARAMETER;
+            }
+        }
+
+        DWORD error = Apply(true);
+        if (error == NO_ERROR) {
+            _Committed = true;
+        }
+        return error;
+    }
+
+    DWORD CodePatchTransaction::Rollback()
+    {
+        if (!_Committed) {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        DWORD error = Apply(false);
+        if (error == NO_ERROR) {
+            _Committed = false;
+        }
+        return error;
+    }
+
+    DWORD CodePatchTransaction::Apply(_In_ bool commit)
+    {
+        if (_Writes.empty()) {
+            return NO_ERROR;
+        }
+
+        const auto page_size = static_cast<uintptr_t>(GetPageSize());
+
+        auto page_floor = [page_size](const uint8_t* address) {
+            return reinterpret_cast<uint8_t*>(reinterpret_cast<uintptr_t>(address) & ~(page_size - 1));
+        };
+        auto page_ceil = [page_size](const uint8_t* address) {
+            return reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(address) + page_size - 1) & ~(page_size - 1));
+        };
+
+        // Change the protection of every touched page first, so that a
+        // failure leaves the memory untouched.
+        std::vector<ProtectedRange> ranges;
+
+        for (size_t i = 0; i < _Writes.size();) {
+            auto first = page_floor(_Writes[i].Address);
+            auto last  = page_ceil(_Writes[i].Address + _Writes[i].NewCode.size());
+
+            // Merge the writes that share or touch these pages.
+            for (++i; i < _Writes.size() && page_floor(_Writes[i].Address) <= last; ++i) {
+                last = std::max(last, page_ceil(_Writes[i].Address + _Writes[i].NewCode.size()));
+            }
+
+            DWORD error = MakeWritable(first, last, ranges);
+            if (error != NO_ERROR) {
+                RestoreProtection(ranges);
+                return error;
+            }
+        }
+
+        // Write the data.
+        for (auto& write : _Writes) {
+            if (commit) {
+                write.OldCode.assign(write.Address, write.Address + write.NewCode.size());
+                memcpy(write.Address, write.NewCode.data(), write.NewCode.size());
+            }
+            else {
+                memcpy(write.Address, write.OldCode.data(), write.OldCode.size());
+            }
+        }
+
+        // Restore the old page protection.
+        RestoreProtection(ranges);
+
+        FlushCode(ranges);
+        return NO_ERROR;
+    }
+}
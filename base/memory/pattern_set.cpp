@@ -0,0 +1,199 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#include "base/universal.inl"
+
+
+namespace base::memory
+{
+    size_t PatternSet::Add(_In_ std::string_view aPattern)
+    {
+        return Add(BytePattern(aPattern));
+    }
+
+    size_t PatternSet::Add(_In_ const BytePattern& aPattern)
+    {
+        if (!aPattern.IsValid())
+        {
+            return npos;
+        }
+
+        const auto vIndex = _Patterns.size();
+        const auto vBytes = aPattern.Bytes();
+        const auto vMask  = aPattern.Mask();
+        const auto vSize  = aPattern.HeadSize();
+
+        // Only the head sits at fixed offsets from the match start. Prefer
+        // its rarest pair of adjacent exact bytes.
+        auto vGram = npos;
+        auto vGramRank = 0u;
+        for (size_t i = 0; i + 1 < vSize; ++i)
+        {
+            if (vMask[i] != 0xFF || vMask[i + 1] != 0xFF)
+            {
+                continue;
+            }
+
+            const auto vRank = 0u + GetByteFrequencyRank(vBytes[i]) + GetByteFrequencyRank(vBytes[i + 1]);
+            if (vGram == npos || vRank < vGramRank)
+            {
+                vGram = i;
+                vGramRank = vRank;
+            }
+        }
+
+        // Otherwise the rarest exact byte.
+        auto vByte = npos;
+        if (vGram == npos)
+        {
+            for (size_t i = 0; i < vSize; ++i)
+            {
+                if (vMask[i] == 0xFF && (vByte == npos ||
+                    GetByteFrequencyRank(vBytes[i]) < GetByteFrequencyRank(vBytes[vByte])))
+                {
+                    vByte = i;
+                }
+            }
+        }
+
+        static auto Insert = [](std::vector<Entry>& aEntries, const Entry& aEntry)
+        {
+            aEntries.insert(std::upper_bound(aEntries.begin(), aEntries.end(), aEntry,
+                [](const Entry& aLeft, const Entry& aRight) { return aLeft.Key < aRight.Key; }), aEntry);
+        };
+
+        if (vGram != npos)
+        {
+            const auto vKey = static_cast<uint32_t>(vBytes[vGram] | (vBytes[vGram + 1] << 8));
+            Insert(_Grams, { vKey, static_cast<uint32_t>(vGram), vIndex });
+            _GramFilter[vKey >> 6] |= 1ull << (vKey & 63);
+        }
+        else if (vByte != npos)
+        {
+            const auto vKey = static_cast<uint32_t>(vBytes[vByte]);
+            Insert(_Bytes, { vKey, static_cast<uint32_t>(vByte), vIndex });
+            _ByteFilter[vKey >> 6] |= 1ull << (vKey & 63);
+        }
+        else
+        {
+            _Wildcards.push_back(vIndex);
+        }
+
+        _Patterns.push_back(aPattern);
+        return vIndex;
+    }
+
+    bool PatternSet::Scan(
+        _In_ const uint8_t* aFirst,
+        _In_ const uint8_t* aLast,
+        _In_ MatchFunction aCallback,
+        _In_opt_ PVOID aCookie
+    ) const
+    {
+        if (aFirst == nullptr || aLast <= aFirst || aCallback == nullptr)
+        {
+            return true;
+        }
+
+        const auto vBytes = static_cast<size_t>(aLast - aFirst);
+
+        // Verifies every entry keyed by aKey whose anchor lies at aAnchor.
+        auto Verify = [&](const std::vector<Entry>& aEntries, uint32_t aKey, const uint8_t* aAnchor) -> bool
+        {
+            auto vEntry = std::lower_bound(aEntries.begin(), aEntries.end(), aKey,
+                [](const Entry& aLeft, uint32_t aRight) { return aLeft.Key < aRight; });
+
+            for (; vEntry != aEntries.end() && vEntry->Key == aKey; ++vEntry)
+            {
+                const auto& vPattern = _Patterns[vEntry->Index];
+
+                const auto vOffset = static_cast<size_t>(aAnchor - aFirst);
+                if (vOffset < vEntry->Offset || vOffset - vEntry->Offset + vPattern.MinSize() > vBytes)
+                {
+                    continue;
+                }
+
+                const auto vMatch = aAnchor - vEntry->Offset;
+                if (vPattern.Match(vMatch, aLast - vMatch) && !aCallback(vEntry->Index, vMatch, aCookie))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        for (const auto vIndex : _Wildcards)
+        {
+            const auto& vPattern = _Patterns[vIndex];
+            for (size_t i = 0; i + vPattern.MinSize() <= vBytes; ++i)
+            {
+                if (vPattern.Match(aFirst + i, vBytes - i) && !aCallback(vIndex, aFirst + i, aCookie))
+                {
+                    return false;
+                }
+            }
+        }
+
+        const auto vHasBytes = !_Bytes.empty();
+        const auto vHasGrams = !_Grams.empty();
+
+        for (auto vCursor = aFirst; vCursor < aLast; ++vCursor)
+        {
+            const uint32_t vByte = vCursor[0];
+
+            if (vHasBytes && (_ByteFilter[vByte >> 6] >> (vByte & 63)) & 1)
+            {
+                if (!Verify(_Bytes, vByte, vCursor))
+                {
+                    return false;
+                }
+            }
+
+            if (vHasGrams && vCursor + 1 < aLast)
+            {
+                const uint32_t vGram = vByte | (vCursor[1] << 8);
+                if ((_GramFilter[vGram >> 6] >> (vGram & 63)) & 1)
+                {
+                    if (!Verify(_Grams, vGram, vCursor))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    std::vector<const uint8_t*> PatternSet::FindFirst(
+        _In_ const uint8_t* aFirst,
+        _In_ const uint8_t* aLast
+    ) const
+    {
+        struct FindFirstStorage
+        {
+            std::vector<const uint8_t*> Matches;
+            size_t Remaining;
+        } vStorage{ std::vector<const uint8_t*>(_Patterns.size()), _Patterns.size() };
+
+        if (vStorage.Remaining == 0)
+        {
+            return std::move(vStorage.Matches);
+        }
+
+        Scan(aFirst, aLast, [](size_t aIndex, const uint8_t* aMatch, PVOID aCookie) -> bool
+        {
+            auto& vStorage = *static_cast<FindFirstStorage*>(aCookie);
+            if (vStorage.Matches[aIndex] == nullptr)
+            {
+                vStorage.Matches[aIndex] = aMatch;
+                vStorage.Remaining -= 1;
+            }
+            return vStorage.Remaining != 0;
+        }, &vStorage);
+
+        return std::move(vStorage.Matches);
+    }
+}
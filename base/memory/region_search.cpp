@@ -0,0 +1,213 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/memory/search.h"
+#   include "include/libbase/memory/region_search.h"
+#   include <algorithm>
+#   include <cstdio>
+#   include <cstring>
+#endif
+
+
+namespace base::memory
+{
+#ifdef _WIN32
+    bool IsReadableRegion(_In_ const MEMORY_BASIC_INFORMATION& aInfo)
+    {
+        if (aInfo.State != MEM_COMMIT || (aInfo.Protect & (PAGE_GUARD | PAGE_NOACCESS)))
+        {
+            return false;
+        }
+
+        constexpr DWORD kReadable =
+            PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY |
+            PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+        return (aInfo.Protect & kReadable) != 0;
+    }
+
+    bool EnumReadableRegions(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ ReadableRegionFunction aCallback,
+        _In_opt_ PVOID aCookie
+    )
+    {
+        if (aAddress == nullptr || aBytes == 0 || aCallback == nullptr)
+        {
+            return true;
+        }
+
+        auto vCursor = static_cast<uint8_t*>(aAddress);
+        const auto vLast = vCursor + aBytes;
+
+        // The readable run being built.
+        auto vRun = (uint8_t*)nullptr;
+
+        while (vCursor < vLast)
+        {
+            MEMORY_BASIC_INFORMATION vInfo{};
+            if (VirtualQuery(vCursor, &vInfo, sizeof(vInfo)) != sizeof(vInfo))
+            {
+                // Past the user address space.
+                break;
+            }
+
+            const auto vNext = std::min(vLast, static_cast<uint8_t*>(vInfo.BaseAddress) + vInfo.RegionSize);
+
+            if (IsReadableRegion(vInfo))
+            {
+                vRun = vRun ? vRun : vCursor;
+            }
+            else if (vRun)
+            {
+                if (!aCallback(vRun, vCursor - vRun, aCookie))
+                {
+                    return false;
+                }
+                vRun = nullptr;
+            }
+
+            vCursor = vNext;
+        }
+
+        if (vRun && !aCallback(vRun, vCursor - vRun, aCookie))
+        {
+            return false;
+        }
+
+        return true;
+    }
+#else
+    bool EnumReadableRegions(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ ReadableRegionFunction aCallback,
+        _In_opt_ PVOID aCookie
+    )
+    {
+        if (aAddress == nullptr || aBytes == 0 || aCallback == nullptr)
+        {
+            return true;
+        }
+
+        const auto vFirst = static_cast<uint8_t*>(aAddress);
+        const auto vLast  = vFirst + std::min<size_t>(aBytes, UINTPTR_MAX - reinterpret_cast<uintptr_t>(vFirst));
+
+        // The readable runs are collected before the callback runs: it may
+        // change the mappings, and with them the file being read.
+        struct Run
+        {
+            uint8_t* First;
+            uint8_t* Last;
+        };
+        std::vector<Run> vRuns;
+
+        FILE* vMaps = fopen("/proc/self/maps", "r");
+        if (vMaps == nullptr)
+        {
+            return true;
+        }
+
+        char vLine[512];
+        while (fgets(vLine, sizeof(vLine), vMaps))
+        {
+            unsigned long long vMapFirst = 0;
+            unsigned long long vMapLast  = 0;
+            char vPermissions[5] = {};
+            if (sscanf(vLine, "%llx-%llx %4s", &vMapFirst, &vMapLast, vPermissions) != 3)
+            {
+                continue;
+            }
+
+            const auto vRegionFirst = std::max(vFirst, reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(vMapFirst)));
+            const auto vRegionLast  = std::min(vLast,  reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(vMapLast)));
+
+            // Some [vvar] pages fault although they are mapped readable.
+            if (vRegionFirst >= vRegionLast || vPermissions[0] != 'r' || strstr(vLine, "[vvar") != nullptr)
+            {
+                continue;
+            }
+
+            if (!vRuns.empty() && vRuns.back().Last == vRegionFirst)
+            {
+                vRuns.back().Last = vRegionLast;
+            }
+            else
+            {
+                vRuns.push_back({ vRegionFirst, vRegionLast });
+            }
+        }
+
+        fclose(vMaps);
+
+        for (const auto& vRun : vRuns)
+        {
+            if (!aCallback(vRun.First, static_cast<size_t>(vRun.Last - vRun.First), aCookie))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+#endif
+
+    void* MemorySearchReadable(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern
+    )
+    {
+        struct SearchStorage
+        {
+            const BytePattern* Pattern;
+            const uint8_t*     Hit;
+        } vStorage{ &aPattern, nullptr };
+
+        EnumReadableRegions(aAddress, aBytes, [](void* aBase, size_t aRegionBytes, PVOID aCookie) -> bool
+        {
+            auto& vStorage = *static_cast<SearchStorage*>(aCookie);
+
+            const auto vFirst = static_cast<const uint8_t*>(aBase);
+            vStorage.Hit = vStorage.Pattern->Find(vFirst, vFirst + aRegionBytes);
+            return vStorage.Hit == nullptr;
+        }, &vStorage);
+
+        return const_cast<uint8_t*>(vStorage.Hit);
+    }
+
+    std::vector<uint8_t*> MemorySearchAllReadable(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode
+    )
+    {
+        struct SearchStorage
+        {
+            const BytePattern*    Pattern;
+            SearchMode            Mode;
+            std::vector<uint8_t*> Hits;
+        } vStorage{ &aPattern, aMode, {} };
+
+        EnumReadableRegions(aAddress, aBytes, [](void* aBase, size_t aRegionBytes, PVOID aCookie) -> bool
+        {
+            auto& vStorage = *static_cast<SearchStorage*>(aCookie);
+
+            for (auto vHit : SearchAll(aBase, aRegionBytes, *vStorage.Pattern, vStorage.Mode))
+            {
+                vStorage.Hits.push_back(vHit);
+            }
+            return true;
+        }, &vStorage);
+
+        return std::move(vStorage.Hits);
+    }
+}
@@ -44,6 +44,223 @@ namespace base::memory
         return error;
     }
 
+    void* MemorySearch(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern
+    )
+    {
+        const auto vAddress = static_cast<const uint8_t*>(aAddress);
+
+        auto vHitAddress = (const uint8_t*)nullptr;
+
+        __try
+        {
+            vHitAddress = aPattern.Find(vAddress, vAddress + aBytes);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            vHitAddress = nullptr;
+        }
+
+        return const_cast<uint8_t*>(vHitAddress);
+    }
+
+    namespace
+    {
+        // Chunks are handed out in address order; this bounds how much work a
+        // first-hit search does past the winning chunk.
+        constexpr size_t kMinParallelChunk = 4 * 1024 * 1024;
+
+        // Runs aWorker(chunk index, first, owned, last) for every chunk on a
+        // pool of threads. The chunks overlap by aOverlap bytes; a chunk owns
+        // the matches that start in [first, owned). aWorker returns false to
+        // cancel every chunk after the current one.
+        template<typename Worker>
+        void ForEachChunkParallel(
+            const uint8_t* aFirst,
+            size_t aBytes,
+            size_t aOverlap,
+            unsigned aThreads,
+            Worker&& aWorker)
+        {
+            if (aThreads == 0)
+            {
+                aThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+
+            const auto vChunkSize = std::max(kMinParallelChunk, aBytes / (size_t(aThreads) * 4) + 1);
+            const auto vChunks    = (aBytes + vChunkSize - 1) / vChunkSize;
+
+            std::atomic<size_t> vNext{ 0 };
+            std::atomic<size_t> vCancelAfter{ SIZE_MAX };
+
+            auto vRun = [&]()
+            {
+                for (auto i = vNext++; i < vChunks; i = vNext++)
+                {
+                    if (i > vCancelAfter.load(std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+
+                    const auto vBegin = i * vChunkSize;
+                    const auto vOwned = std::min(aBytes, vBegin + vChunkSize);
+                    const auto vEnd   = std::min(aBytes, vBegin + vChunkSize + aOverlap);
+
+                    if (!aWorker(i, aFirst + vBegin, aFirst + vOwned, aFirst + vEnd))
+                    {
+                        // Keep the lowest cancelling chunk.
+                        auto vCurrent = vCancelAfter.load();
+                        while (i < vCurrent && !vCancelAfter.compare_exchange_weak(vCurrent, i))
+                        {
+                        }
+                    }
+                }
+            };
+
+            const auto vWorkers = static_cast<unsigned>(std::min<size_t>(aThreads, vChunks));
+
+            std::vector<std::thread> vPool;
+            vPool.reserve(vWorkers ? vWorkers - 1 : 0);
+            for (auto i = 1u; i < vWorkers; ++i)
+            {
+                vPool.emplace_back(vRun);
+            }
+
+            vRun();
+
+            for (auto& vThread : vPool)
+            {
+                vThread.join();
+            }
+        }
+    }
+
+    void* MemorySearchParallel(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ unsigned aThreads
+    )
+    {
+        const auto vAddress = static_cast<const uint8_t*>(aAddress);
+        const auto vSize    = aPattern.Size();
+        if (vAddress == nullptr || vSize == 0 || aBytes < aPattern.MinSize())
+        {
+            return nullptr;
+        }
+
+        std::mutex vLock;
+        auto vHitChunk   = SIZE_MAX;
+        auto vHitAddress = (void*)nullptr;
+
+        ForEachChunkParallel(vAddress, aBytes, vSize - 1, aThreads,
+            [&](size_t aChunk, const uint8_t* aFirst, const uint8_t* aOwned, const uint8_t* aLast) -> bool
+            {
+                const auto vHit = MemorySearch(const_cast<uint8_t*>(aFirst), aLast - aFirst, aPattern);
+                if (vHit == nullptr || vHit >= aOwned)
+                {
+                    return true;
+                }
+
+                std::lock_guard<std::mutex> vGuard(vLock);
+                if (aChunk < vHitChunk)
+                {
+                    vHitChunk   = aChunk;
+                    vHitAddress = vHit;
+                }
+                return false;
+            });
+
+        return vHitAddress;
+    }
+
+    std::vector<uint8_t*> MemorySearchAllParallel(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode,
+        _In_opt_ unsigned aThreads
+    )
+    {
+        std::vector<uint8_t*> vHits;
+
+        const auto vAddress = static_cast<const uint8_t*>(aAddress);
+        const auto vSize    = aPattern.Size();
+        if (vAddress == nullptr || vSize == 0 || aBytes < aPattern.MinSize())
+        {
+            return vHits;
+        }
+
+        std::mutex vLock;
+        std::map<size_t, std::vector<uint8_t*>> vChunkHits;
+
+        ForEachChunkParallel(vAddress, aBytes, vSize - 1, aThreads,
+            [&](size_t aChunk, const uint8_t* aFirst, const uint8_t* aOwned, const uint8_t* aLast) -> bool
+            {
+                std::vector<uint8_t*> vFound;
+
+                for (auto vCursor = aFirst; vCursor < aOwned;)
+                {
+                    const auto vHit = static_cast<uint8_t*>(
+                        MemorySearch(const_cast<uint8_t*>(vCursor), aLast - vCursor, aPattern));
+                    if (vHit == nullptr || vHit >= aOwned)
+                    {
+                        break;
+                    }
+
+                    vFound.push_back(vHit);
+                    vCursor = vHit + 1;
+                }
+
+                std::lock_guard<std::mutex> vGuard(vLock);
+                vChunkHits.emplace(aChunk, std::move(vFound));
+                return true;
+            });
+
+        // Chunks only report hits starting inside them, so the merged list is
+        // sorted and free of duplicates.
+        for (auto& vChunk : vChunkHits)
+        {
+            for (const auto vHit : vChunk.second)
+            {
+                if (aMode == SearchMode::NonOverlapping &&
+                    !vHits.empty() && vHit < vHits.back() + aPattern.MinSize())
+                {
+                    continue;
+                }
+
+                vHits.push_back(vHit);
+            }
+        }
+
+        return vHits;
+    }
+
+    void* details::GuardedSearch(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ FindFunction aFind,
+        _In_ const void* aPattern
+    )
+    {
+        const auto vAddress = static_cast<const uint8_t*>(aAddress);
+
+        auto vHitAddress = (const uint8_t*)nullptr;
+
+        __try
+        {
+            vHitAddress = aFind(aPattern, vAddress, vAddress + aBytes);
+        }
+        __except (EXCEPTION_EXECUTE_HANDLER)
+        {
+            vHitAddress = nullptr;
+        }
+
+        return const_cast<uint8_t*>(vHitAddress);
+    }
+
     void* MemorySearch(
         _In_bytecount_(aBytes) void* aAddress,
         _In_ size_t aBytes,
@@ -0,0 +1,673 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// BytePattern and its search engines. Nothing here needs the Windows
+// headers, so this file also builds with GCC or Clang on Linux, where the
+// engines can be tested and benchmarked over plain buffers. The searches
+// that guard against access faults with SEH (MemorySearch and the parallel
+// searches built on it) are in search.cpp.
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#   define LIBBASE_SEARCH_X86 1
+#   include <immintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define LIBBASE_TARGET_AVX2 __attribute__((target("avx2")))
+#   else
+#       define LIBBASE_TARGET_AVX2
+#   endif
+#endif
+
+
+namespace base::memory
+{
+    namespace
+    {
+        // Approximate occurrence rank of each byte value in x86/x64 code
+        // sections. Higher is more common; unlisted values are rare (0).
+        constexpr auto kByteFrequency = []()
+        {
+            struct Table { uint8_t Rank[256]; } vTable{};
+
+            constexpr uint8_t kCommon[] = {
+                0x00, 0xFF, 0x48, 0x8B, 0x89, 0xCC, 0x24, 0x4C, 0x0F, 0x44,
+                0xE8, 0x83, 0x8D, 0x85, 0x01, 0x74, 0x75, 0x45, 0xC0, 0x90,
+                0x08, 0x10, 0x20, 0x33, 0x40, 0x4D, 0x84, 0xC3, 0xEB, 0x28,
+                0x30, 0x38, 0x18, 0x41, 0x49, 0x8A, 0x50, 0x5C, 0xC7, 0x02,
+            };
+
+            for (size_t i = 0; i < sizeof(kCommon); ++i)
+            {
+                vTable.Rank[kCommon[i]] = static_cast<uint8_t>(sizeof(kCommon) - i);
+            }
+            return vTable;
+        }();
+
+        // Upper bound of a "{min-max}" skip.
+        constexpr size_t kMaxPatternSkip = 0xFFFF;
+
+        inline unsigned CountTrailingZeros(uint32_t aValue)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long vIndex = 0;
+            _BitScanForward(&vIndex, aValue);
+            return vIndex;
+#else
+            return static_cast<unsigned>(__builtin_ctz(aValue));
+#endif
+        }
+
+        // Scalar engine: memchr on the first anchor byte.
+        // Candidates are the starts in [aFirst, aLast]; the buffer ends at aEnd.
+        const uint8_t* FindScalar(
+            const BytePattern& aPattern,
+            size_t aAnchor,
+            const uint8_t* aFirst,
+            const uint8_t* aLast,
+            const uint8_t* aEnd)
+        {
+            const auto vByte = aPattern.Bytes()[aAnchor];
+
+            // Every start in [aFirst, aLast] is a valid candidate.
+            auto vCursor = aFirst + aAnchor;
+            const auto vEnd = aLast + aAnchor + 1;
+
+            while (vCursor < vEnd)
+            {
+                auto vHit = static_cast<const uint8_t*>(memchr(vCursor, vByte, vEnd - vCursor));
+                if (vHit == nullptr)
+                {
+                    break;
+                }
+
+                if (aPattern.Match(vHit - aAnchor, aEnd - (vHit - aAnchor)))
+                {
+                    return vHit - aAnchor;
+                }
+                vCursor = vHit + 1;
+            }
+
+            return nullptr;
+        }
+
+#ifdef LIBBASE_SEARCH_X86
+        bool CpuSupportsAvx2()
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int vInfo[4]{};
+            __cpuid(vInfo, 0);
+            if (vInfo[0] < 7)
+            {
+                return false;
+            }
+
+            __cpuid(vInfo, 1);
+            const auto vOSXSave = (vInfo[2] & (1 << 27)) != 0;
+            const auto vAVX     = (vInfo[2] & (1 << 28)) != 0;
+            if (!vOSXSave || !vAVX || (_xgetbv(0) & 0x6) != 0x6)
+            {
+                return false;
+            }
+
+            __cpuidex(vInfo, 7, 0);
+            return (vInfo[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        // SSE2 engine: tests 16 candidate offsets per step against the
+        // anchor byte pair, then verifies the surviving candidates.
+        const uint8_t* FindSSE2(
+            const BytePattern& aPattern,
+            const size_t aAnchor[2],
+            const uint8_t* aFirst,
+            const uint8_t* aLast,
+            const uint8_t* aEnd)
+        {
+            const auto vAnchor0 = _mm_set1_epi8(static_cast<char>(aPattern.Bytes()[aAnchor[0]]));
+            const auto vAnchor1 = _mm_set1_epi8(static_cast<char>(aPattern.Bytes()[aAnchor[1]]));
+
+            auto vCursor = aFirst;
+            for (; vCursor + 15 <= aLast; vCursor += 16)
+            {
+                const auto vBlock0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vCursor + aAnchor[0]));
+                const auto vBlock1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(vCursor + aAnchor[1]));
+
+                auto vMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(vBlock0, vAnchor0),
+                    _mm_cmpeq_epi8(vBlock1, vAnchor1))));
+
+                while (vMask)
+                {
+                    const auto vCandidate = vCursor + CountTrailingZeros(vMask);
+                    if (aPattern.Match(vCandidate, aEnd - vCandidate))
+                    {
+                        return vCandidate;
+                    }
+                    vMask &= vMask - 1;
+                }
+            }
+
+            return vCursor <= aLast ? FindScalar(aPattern, aAnchor[0], vCursor, aLast, aEnd) : nullptr;
+        }
+
+        // AVX2 engine: as FindSSE2, 32 candidate offsets per step.
+        LIBBASE_TARGET_AVX2
+        const uint8_t* FindAVX2(
+            const BytePattern& aPattern,
+            const size_t aAnchor[2],
+            const uint8_t* aFirst,
+            const uint8_t* aLast,
+            const uint8_t* aEnd)
+        {
+            const auto vAnchor0 = _mm256_set1_epi8(static_cast<char>(aPattern.Bytes()[aAnchor[0]]));
+            const auto vAnchor1 = _mm256_set1_epi8(static_cast<char>(aPattern.Bytes()[aAnchor[1]]));
+
+            auto vCursor = aFirst;
+            for (; vCursor + 31 <= aLast; vCursor += 32)
+            {
+                const auto vBlock0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vCursor + aAnchor[0]));
+                const auto vBlock1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(vCursor + aAnchor[1]));
+
+                auto vMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(vBlock0, vAnchor0),
+                    _mm256_cmpeq_epi8(vBlock1, vAnchor1))));
+
+                while (vMask)
+                {
+                    const auto vCandidate = vCursor + CountTrailingZeros(vMask);
+                    if (aPattern.Match(vCandidate, aEnd - vCandidate))
+                    {
+                        return vCandidate;
+                    }
+                    vMask &= vMask - 1;
+                }
+            }
+
+            return vCursor <= aLast ? FindSSE2(aPattern, aAnchor, vCursor, aLast, aEnd) : nullptr;
+        }
+#endif
+    }
+
+    bool IsSearchEngineSupported(_In_ SearchEngine aEngine)
+    {
+        switch (aEngine)
+        {
+        case SearchEngine::Auto:
+        case SearchEngine::Scalar:
+            return true;
+#ifdef LIBBASE_SEARCH_X86
+        case SearchEngine::SSE2:
+            return true;
+        case SearchEngine::AVX2:
+        {
+            static const bool vAvx2 = CpuSupportsAvx2();
+            return vAvx2;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    uint8_t GetByteFrequencyRank(_In_ uint8_t aByte)
+    {
+        return kByteFrequency.Rank[aByte];
+    }
+
+    BytePattern::BytePattern(_In_ std::string_view aPattern)
+    {
+        static auto HexToInteger = [](char aChar) -> int
+        {
+            if (aChar >= '0' && aChar <= '9') return aChar - '0';
+            if (aChar >= 'a' && aChar <= 'f') return aChar - 'a' + 10;
+            if (aChar >= 'A' && aChar <= 'F') return aChar - 'A' + 10;
+            return -1;
+        };
+
+        // Parses one byte token at aPattern[i]: two hex digits, a nibble mask
+        // or a wildcard. Returns the token length, or 0 if malformed.
+        static auto ParseByte = [](std::string_view aPattern, size_t i, uint8_t& aByte, uint8_t& aMask) -> size_t
+        {
+            const auto vNext = (i + 1 < aPattern.size()) ? aPattern[i + 1] : '\0';
+            const auto vHigh = HexToInteger(aPattern[i]);
+            const auto vLow  = HexToInteger(vNext);
+
+            if (aPattern[i] == '?')
+            {
+                aByte = static_cast<uint8_t>(vLow >= 0 ? vLow : 0x00);
+                aMask = static_cast<uint8_t>(vLow >= 0 ? 0x0F : 0x00);
+                return (vLow >= 0 || vNext == '?') ? 2 : 1;
+            }
+            if (vHigh >= 0 && vLow >= 0)
+            {
+                aByte = static_cast<uint8_t>((vHigh << 4) | vLow);
+                aMask = 0xFF;
+                return 2;
+            }
+            if (vHigh >= 0 && vNext == '?')
+            {
+                aByte = static_cast<uint8_t>(vHigh << 4);
+                aMask = 0xF0;
+                return 2;
+            }
+            return 0;
+        };
+
+        static auto ParseNumber = [](std::string_view aPattern, size_t& i, size_t& aNumber) -> bool
+        {
+            aNumber = 0;
+
+            const auto vFirst = i;
+            for (; i < aPattern.size() && aPattern[i] >= '0' && aPattern[i] <= '9'; ++i)
+            {
+                aNumber = aNumber * 10 + (aPattern[i] - '0');
+                if (aNumber > kMaxPatternSkip)
+                {
+                    return false;
+                }
+            }
+            return i != vFirst;
+        };
+
+        auto Malformed = [this]()
+        {
+            _Bytes   .clear();
+            _Mask    .clear();
+            _Segments.clear();
+            _Sets    .clear();
+        };
+
+        // The segment being parsed; the first one has no skip before it.
+        Segment vSegment{};
+
+        for (size_t i = 0; i < aPattern.size();)
+        {
+            if (aPattern[i] == ' ')
+            {
+                ++i;
+                continue;
+            }
+
+            if (aPattern[i] == '{')
+            {
+                // "{n}" or "{min-max}".
+                auto vMin = size_t(0);
+                auto vMax = size_t(0);
+
+                ++i;
+                if (!ParseNumber(aPattern, i, vMin))
+                {
+                    Malformed();
+                    return;
+                }
+
+                vMax = vMin;
+                if (i < aPattern.size() && aPattern[i] == '-')
+                {
+                    ++i;
+                    if (!ParseNumber(aPattern, i, vMax) || vMax < vMin)
+                    {
+                        Malformed();
+                        return;
+                    }
+                }
+
+                if (i >= aPattern.size() || aPattern[i] != '}')
+                {
+                    Malformed();
+                    return;
+                }
+                ++i;
+
+                if (vMin == vMax)
+                {
+                    _Bytes.insert(_Bytes.end(), vMin, 0x00);
+                    _Mask .insert(_Mask .end(), vMin, 0x00);
+                    vSegment.Length += vMin;
+                    continue;
+                }
+
+                // A variable skip closes the segment. Consecutive skips add up.
+                if (vSegment.Length != 0)
+                {
+                    _Segments.push_back(vSegment);
+                    vSegment = { _Bytes.size(), 0, 0, 0 };
+                }
+                else if (_Segments.empty())
+                {
+                    // Nothing to anchor the skip to.
+                    Malformed();
+                    return;
+                }
+
+                vSegment.MinSkip += vMin;
+                vSegment.MaxSkip += vMax;
+                continue;
+            }
+
+            auto vByte = uint8_t(0);
+            auto vMask = uint8_t(0);
+
+            if (aPattern[i] == '[')
+            {
+                // "[48|4C|5?]": the union of the members.
+                uint64_t vBits[4]{};
+
+                ++i;
+                for (;;)
+                {
+                    while (i < aPattern.size() && aPattern[i] == ' ')
+                    {
+                        ++i;
+                    }
+
+                    const auto vLength = (i < aPattern.size()) ? ParseByte(aPattern, i, vByte, vMask) : 0;
+                    if (vLength == 0)
+                    {
+                        Malformed();
+                        return;
+                    }
+                    i += vLength;
+
+                    for (auto vValue = 0u; vValue < 256; ++vValue)
+                    {
+                        if ((vValue & vMask) == vByte)
+                        {
+                            vBits[vValue >> 6] |= 1ull << (vValue & 63);
+                        }
+                    }
+
+                    while (i < aPattern.size() && aPattern[i] == ' ')
+                    {
+                        ++i;
+                    }
+
+                    if (i < aPattern.size() && aPattern[i] == '|')
+                    {
+                        ++i;
+                        continue;
+                    }
+                    if (i < aPattern.size() && aPattern[i] == ']')
+                    {
+                        ++i;
+                        break;
+                    }
+                    Malformed();
+                    return;
+                }
+
+                // Mask the bits every member shares. If the mask admits more
+                // values than the set holds, Match() checks the set itself.
+                auto vFirst  = -1;
+                auto vCommon = 0xFFu;
+                auto vCount  = 0u;
+                for (auto vValue = 0u; vValue < 256; ++vValue)
+                {
+                    if ((vBits[vValue >> 6] >> (vValue & 63)) & 1)
+                    {
+                        vFirst   = (vFirst < 0) ? static_cast<int>(vValue) : vFirst;
+                        vCommon &= ~(vValue ^ static_cast<unsigned>(vFirst));
+                        vCount  += 1;
+                    }
+                }
+
+                vMask = static_cast<uint8_t>(vCommon);
+                vByte = static_cast<uint8_t>(vFirst & vCommon);
+
+                auto vFree = 0u;
+                for (auto vBit = 0u; vBit < 8; ++vBit)
+                {
+                    vFree += ((vCommon >> vBit) & 1) ? 0 : 1;
+                }
+
+                if (vCount != (1u << vFree))
+                {
+                    ByteSet vSet{ _Bytes.size(), {} };
+                    memcpy(vSet.Bits, vBits, sizeof(vBits));
+                    _Sets.push_back(vSet);
+                }
+            }
+            else
+            {
+                const auto vLength = ParseByte(aPattern, i, vByte, vMask);
+                if (vLength == 0)
+                {
+                    Malformed();
+                    return;
+                }
+                i += vLength;
+            }
+
+            _Bytes.push_back(vByte);
+            _Mask .push_back(vMask);
+            vSegment.Length += 1;
+        }
+
+        if (vSegment.Length == 0 && !_Segments.empty())
+        {
+            // A trailing variable skip.
+            Malformed();
+            return;
+        }
+
+        _Segments.push_back(vSegment);
+
+        _MinSize = 0;
+        _MaxSize = 0;
+        for (const auto& vEach : _Segments)
+        {
+            _MinSize += vEach.MinSkip + vEach.Length;
+            _MaxSize += vEach.MaxSkip + vEach.Length;
+        }
+
+        // Plain patterns need no segment list.
+        if (_Segments.size() == 1)
+        {
+            _Segments.clear();
+        }
+
+        // Pick the two rarest exact bytes of the head as the anchor pair. A
+        // pattern with a single exact byte uses it for both anchors.
+        const auto vHeadSize = HeadSize();
+        for (size_t i = 0; i < vHeadSize; ++i)
+        {
+            if (_Mask[i] != 0xFF)
+            {
+                continue;
+            }
+
+            const auto vRank = kByteFrequency.Rank[_Bytes[i]];
+            if (_Anchor[0] == npos || vRank < kByteFrequency.Rank[_Bytes[_Anchor[0]]])
+            {
+                _Anchor[1] = _Anchor[0];
+                _Anchor[0] = i;
+            }
+            else if (_Anchor[1] == npos || vRank < kByteFrequency.Rank[_Bytes[_Anchor[1]]])
+            {
+                _Anchor[1] = i;
+            }
+        }
+
+        if (_Anchor[1] == npos)
+        {
+            _Anchor[1] = _Anchor[0];
+        }
+    }
+
+    bool BytePattern::MatchComplex(_In_ const uint8_t* aData, _In_ size_t aAvailable) const
+    {
+        if (_Segments.empty())
+        {
+            return aAvailable >= _Bytes.size() && MatchRange(aData, 0, _Bytes.size());
+        }
+        return MatchSegments(aData, aAvailable, 0);
+    }
+
+    bool BytePattern::Match(
+        _In_ const uint8_t* aHead,
+        _In_ size_t aHeadBytes,
+        _In_ const uint8_t* aTail,
+        _In_ size_t aTailBytes
+    ) const
+    {
+        const SplitData vData{ aHead, aHeadBytes, aTail };
+        const auto vAvailable = aHeadBytes + aTailBytes;
+
+        if (_Segments.empty())
+        {
+            return vAvailable >= _Bytes.size() && MatchRange(vData, 0, _Bytes.size());
+        }
+        return MatchSegments(vData, vAvailable, 0);
+    }
+
+    template<typename Data>
+    bool BytePattern::MatchRange(_In_ const Data& aData, _In_ size_t aOffset, _In_ size_t aLength) const
+    {
+        for (size_t i = 0; i < aLength; ++i)
+        {
+            if ((aData[i] & _Mask[aOffset + i]) != _Bytes[aOffset + i])
+            {
+                return false;
+            }
+        }
+
+        for (const auto& vSet : _Sets)
+        {
+            if (vSet.Offset < aOffset || vSet.Offset >= aOffset + aLength)
+            {
+                continue;
+            }
+
+            const auto vValue = aData[vSet.Offset - aOffset];
+            if (((vSet.Bits[vValue >> 6] >> (vValue & 63)) & 1) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename Data>
+    bool BytePattern::MatchSegments(_In_ const Data& aData, _In_ size_t aAvailable, _In_ size_t aSegment) const
+    {
+        const auto& vSegment = _Segments[aSegment];
+        if (aAvailable < vSegment.Length || !MatchRange(aData, vSegment.Offset, vSegment.Length))
+        {
+            return false;
+        }
+
+        if (aSegment + 1 == _Segments.size())
+        {
+            return true;
+        }
+
+        // Try every skip length, shortest first.
+        const auto& vNext = _Segments[aSegment + 1];
+        for (auto vSkip = vNext.MinSkip; vSkip <= vNext.MaxSkip; ++vSkip)
+        {
+            const auto vAdvance = vSegment.Length + vSkip;
+            if (vAdvance + vNext.Length > aAvailable)
+            {
+                break;
+            }
+
+            if (MatchSegments(aData + vAdvance, aAvailable - vAdvance, aSegment + 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t BytePattern::Hash() const
+    {
+        // FNV-1a.
+        auto vHash = 0xcbf29ce484222325ull;
+        auto HashBytes = [&vHash](const void* aData, size_t aBytes)
+        {
+            const auto vData = static_cast<const uint8_t*>(aData);
+            for (size_t i = 0; i < aBytes; ++i)
+            {
+                vHash = (vHash ^ vData[i]) * 0x100000001b3ull;
+            }
+        };
+
+        const uint64_t vSize = _Bytes.size();
+        HashBytes(&vSize, sizeof(vSize));
+        HashBytes(_Bytes.data(), _Bytes.size());
+        HashBytes(_Mask .data(), _Mask .size());
+
+        for (const auto& vSegment : _Segments)
+        {
+            const uint64_t vFields[] = { vSegment.Offset, vSegment.Length, vSegment.MinSkip, vSegment.MaxSkip };
+            HashBytes(vFields, sizeof(vFields));
+        }
+
+        for (const auto& vSet : _Sets)
+        {
+            const uint64_t vOffset = vSet.Offset;
+            HashBytes(&vOffset, sizeof(vOffset));
+            HashBytes(vSet.Bits, sizeof(vSet.Bits));
+        }
+        return vHash;
+    }
+
+    const uint8_t* BytePattern::Find(
+        _In_ const uint8_t* aFirst,
+        _In_ const uint8_t* aLast,
+        _In_opt_ SearchEngine aEngine
+    ) const
+    {
+        const auto vSize = MinSize();
+        if (vSize == 0 || aFirst == nullptr || aLast < aFirst ||
+            static_cast<size_t>(aLast - aFirst) < vSize)
+        {
+            return nullptr;
+        }
+
+        // Last valid start of a match.
+        const auto vLast = aLast - vSize;
+
+        // No exact byte in the head: try every offset.
+        if (_Anchor[0] == npos)
+        {
+            for (auto vCandidate = aFirst; vCandidate <= vLast; ++vCandidate)
+            {
+                if (Match(vCandidate, aLast - vCandidate))
+                {
+                    return vCandidate;
+                }
+            }
+            return nullptr;
+        }
+
+        if (aEngine == SearchEngine::Auto)
+        {
+            aEngine = IsSearchEngineSupported(SearchEngine::AVX2) ? SearchEngine::AVX2 :
+                IsSearchEngineSupported(SearchEngine::SSE2) ? SearchEngine::SSE2 : SearchEngine::Scalar;
+        }
+
+        switch (aEngine)
+        {
+#ifdef LIBBASE_SEARCH_X86
+        case SearchEngine::AVX2:
+            if (IsSearchEngineSupported(SearchEngine::AVX2))
+            {
+                return FindAVX2(*this, _Anchor, aFirst, vLast, aLast);
+            }
+            [[fallthrough]];
+        case SearchEngine::SSE2:
+            return FindSSE2(*this, _Anchor, aFirst, vLast, aLast);
+#endif
+        default:
+            return FindScalar(*this, _Anchor[0], aFirst, vLast, aLast);
+        }
+    }
+}
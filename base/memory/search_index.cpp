@@ -0,0 +1,221 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#include "base/universal.inl"
+
+
+namespace base::memory
+{
+    bool SearchIndex::Build(
+        _In_reads_bytes_(aBytes) const void* aAddress,
+        _In_ size_t aBytes,
+        _In_opt_ size_t aMaxMemory
+    )
+    {
+        Reset();
+
+        const auto vData = static_cast<const uint8_t*>(aAddress);
+        if (vData == nullptr || aBytes < 2 || aBytes - 1 > UINT32_MAX)
+        {
+            return false;
+        }
+
+        const auto vTableSize = (kGrams + 1) * sizeof(uint32_t) + kGrams / 8;
+        if (aMaxMemory != 0 && aMaxMemory < vTableSize)
+        {
+            return false;
+        }
+
+        // Count the positions of each gram.
+        std::vector<uint32_t> vCounts(kGrams);
+        for (size_t i = 0; i + 1 < aBytes; ++i)
+        {
+            vCounts[vData[i] | (vData[i + 1] << 8)] += 1;
+        }
+
+        // Drop the most frequent grams until the positions fit in the cap.
+        _Dropped.assign(kGrams / 64, 0);
+
+        auto vPositions = static_cast<uint64_t>(aBytes - 1);
+        if (aMaxMemory != 0 && vTableSize + vPositions * sizeof(uint32_t) > aMaxMemory)
+        {
+            std::vector<uint32_t> vOrder(kGrams);
+            for (size_t i = 0; i < kGrams; ++i)
+            {
+                vOrder[i] = static_cast<uint32_t>(i);
+            }
+
+            std::sort(vOrder.begin(), vOrder.end(), [&vCounts](uint32_t aLeft, uint32_t aRight)
+            {
+                return vCounts[aLeft] > vCounts[aRight];
+            });
+
+            for (const auto vGram : vOrder)
+            {
+                if (vTableSize + vPositions * sizeof(uint32_t) <= aMaxMemory)
+                {
+                    break;
+                }
+
+                vPositions -= vCounts[vGram];
+                vCounts[vGram] = 0;
+
+                _Dropped[vGram >> 6] |= 1ull << (vGram & 63);
+                _DroppedCount += 1;
+            }
+        }
+
+        // Prefix sums, then fill in address order so every list is sorted.
+        _Starts.resize(kGrams + 1);
+        for (size_t i = 0; i < kGrams; ++i)
+        {
+            _Starts[i + 1] = _Starts[i] + vCounts[i];
+        }
+
+        _Positions.resize(static_cast<size_t>(vPositions));
+
+        std::vector<uint32_t> vCursor(_Starts.begin(), _Starts.end() - 1);
+        for (size_t i = 0; i + 1 < aBytes; ++i)
+        {
+            const auto vGram = vData[i] | (vData[i + 1] << 8);
+            if ((_Dropped[vGram >> 6] >> (vGram & 63)) & 1)
+            {
+                continue;
+            }
+
+            _Positions[vCursor[vGram]++] = static_cast<uint32_t>(i);
+        }
+
+        _Data  = vData;
+        _Bytes = aBytes;
+        return true;
+    }
+
+    void SearchIndex::Reset()
+    {
+        _Data  = nullptr;
+        _Bytes = 0;
+        _DroppedCount = 0;
+
+        std::vector<uint32_t>().swap(_Starts);
+        std::vector<uint32_t>().swap(_Positions);
+        std::vector<uint64_t>().swap(_Dropped);
+    }
+
+    size_t SearchIndex::MemoryUsage() const
+    {
+        return _Starts.capacity() * sizeof(uint32_t) +
+            _Positions.capacity() * sizeof(uint32_t) +
+            _Dropped.capacity() * sizeof(uint64_t);
+    }
+
+    size_t SearchIndex::SelectGram(_In_ const BytePattern& aPattern) const
+    {
+        const auto vBytes = aPattern.Bytes();
+        const auto vMask  = aPattern.Mask();
+        const auto vSize  = aPattern.HeadSize();
+
+        auto vBest = npos;
+        auto vBestCount = 0u;
+
+        for (size_t i = 0; i + 1 < vSize; ++i)
+        {
+            if (vMask[i] != 0xFF || vMask[i + 1] != 0xFF)
+            {
+                continue;
+            }
+
+            const auto vGram = vBytes[i] | (vBytes[i + 1] << 8);
+            if ((_Dropped[vGram >> 6] >> (vGram & 63)) & 1)
+            {
+                continue;
+            }
+
+            const auto vCount = _Starts[vGram + 1] - _Starts[vGram];
+            if (vBest == npos || vCount < vBestCount)
+            {
+                vBest = i;
+                vBestCount = vCount;
+            }
+        }
+
+        return vBest;
+    }
+
+    template<typename Visitor>
+    void SearchIndex::ForEachMatch(_In_ const BytePattern& aPattern, Visitor&& aVisit) const
+    {
+        if (!IsValid() || !aPattern.IsValid() || aPattern.MinSize() > _Bytes)
+        {
+            return;
+        }
+
+        const auto vLast = _Data + _Bytes;
+        const auto vGram = SelectGram(aPattern);
+
+        if (vGram == npos)
+        {
+            // Nothing indexed to look up: a linear pass.
+            for (auto vCursor = _Data; ;)
+            {
+                const auto vHit = aPattern.Find(vCursor, vLast);
+                if (vHit == nullptr || !aVisit(vHit))
+                {
+                    break;
+                }
+                vCursor = vHit + 1;
+            }
+            return;
+        }
+
+        const auto vKey = aPattern.Bytes()[vGram] | (aPattern.Bytes()[vGram + 1] << 8);
+        const auto vEnd = _Positions.data() + _Starts[vKey + 1];
+
+        for (auto vPosition = _Positions.data() + _Starts[vKey]; vPosition < vEnd; ++vPosition)
+        {
+            if (*vPosition < vGram)
+            {
+                continue;
+            }
+
+            const auto vStart = *vPosition - vGram;
+            if (vStart + aPattern.MinSize() > _Bytes)
+            {
+                break;
+            }
+
+            if (aPattern.Match(_Data + vStart, _Bytes - vStart) && !aVisit(_Data + vStart))
+            {
+                break;
+            }
+        }
+    }
+
+    const uint8_t* SearchIndex::Find(_In_ const BytePattern& aPattern) const
+    {
+        auto vHit = (const uint8_t*)nullptr;
+
+        ForEachMatch(aPattern, [&vHit](const uint8_t* aMatch)
+        {
+            vHit = aMatch;
+            return false;
+        });
+
+        return vHit;
+    }
+
+    std::vector<const uint8_t*> SearchIndex::FindAll(_In_ const BytePattern& aPattern) const
+    {
+        std::vector<const uint8_t*> vHits;
+
+        ForEachMatch(aPattern, [&vHits](const uint8_t* aMatch)
+        {
+            vHits.push_back(aMatch);
+            return true;
+        });
+
+        return vHits;
+    }
+}
@@ -0,0 +1,149 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+#include "include/libbase/memory/stream_search.h"
+
+
+namespace base::memory
+{
+    StreamSearcher::StreamSearcher(
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode
+    )
+        : _Pattern(&aPattern)
+        , _Mode(aMode)
+    {
+        if (aPattern.Size() > 1)
+        {
+            _Tail.reserve(aPattern.Size() - 1);
+        }
+    }
+
+    void StreamSearcher::Reset()
+    {
+        _Offset  = 0;
+        _NextHit = 0;
+        _Tail.clear();
+    }
+
+    bool StreamSearcher::Report(
+        _In_ uint64_t aOffset,
+        _In_ MatchFunction aCallback,
+        _In_opt_ PVOID aCookie
+    )
+    {
+        if (aOffset < _NextHit)
+        {
+            return true;
+        }
+
+        _NextHit = aOffset + (_Mode == SearchMode::Overlapping ? 1 : _Pattern->MinSize());
+        return aCallback(aOffset, aCookie);
+    }
+
+    bool StreamSearcher::Feed(
+        _In_reads_bytes_(aBytes) const void* aData,
+        _In_ size_t aBytes,
+        _In_ MatchFunction aCallback,
+        _In_opt_ PVOID aCookie
+    )
+    {
+        const auto vData = static_cast<const uint8_t*>(aData);
+        const auto vSize = _Pattern->Size();
+
+        if (vData == nullptr || aBytes == 0 || vSize == 0 || aCallback == nullptr)
+        {
+            return true;
+        }
+
+        // A start is decided once Size() bytes follow it; later starts stay
+        // in the tail until more data (or Finish()) comes.
+        const auto vKeep = vSize - 1;
+
+        // Matches that start in the tail and end in this chunk. The pattern is
+        // compared in two pieces, the tail and the head of the chunk, so the
+        // chunk is never copied.
+        const auto vTailBytes  = _Tail.size();
+        const auto vTailOffset = _Offset - vTailBytes;
+
+        for (size_t vStart = 0; vStart < vTailBytes; ++vStart)
+        {
+            const auto vInTail = vTailBytes - vStart;
+            if (vSize - vInTail > aBytes)
+            {
+                // Needs more data; the start stays in the tail.
+                continue;
+            }
+
+            if (_Pattern->Match(&_Tail[vStart], vInTail, vData, vSize - vInTail) &&
+                !Report(vTailOffset + vStart, aCallback, aCookie))
+            {
+                return false;
+            }
+        }
+
+        // Matches inside this chunk.
+        for (auto vCursor = vData; vCursor + vSize <= vData + aBytes;)
+        {
+            const auto vHit = _Pattern->Find(vCursor, vData + aBytes);
+            if (vHit == nullptr || vHit + vSize > vData + aBytes)
+            {
+                break;
+            }
+
+            if (!Report(_Offset + (vHit - vData), aCallback, aCookie))
+            {
+                return false;
+            }
+            vCursor = vHit + 1;
+        }
+
+        // Keep the last Size() - 1 bytes of the stream.
+        if (aBytes >= vKeep)
+        {
+            _Tail.assign(vData + aBytes - vKeep, vData + aBytes);
+        }
+        else
+        {
+            _Tail.insert(_Tail.end(), vData, vData + aBytes);
+            if (_Tail.size() > vKeep)
+            {
+                _Tail.erase(_Tail.begin(), _Tail.end() - vKeep);
+            }
+        }
+
+        _Offset += aBytes;
+        return true;
+    }
+
+    bool StreamSearcher::Finish(
+        _In_ MatchFunction aCallback,
+        _In_opt_ PVOID aCookie
+    )
+    {
+        if (aCallback == nullptr)
+        {
+            return true;
+        }
+
+        // Starts in the tail can still match a shorter form of a pattern
+        // with a variable skip.
+        const auto vTailBytes  = _Tail.size();
+        const auto vTailOffset = _Offset - vTailBytes;
+
+        for (size_t vStart = 0; vStart < vTailBytes; ++vStart)
+        {
+            if (_Pattern->Match(&_Tail[vStart], vTailBytes - vStart) && !Report(vTailOffset + vStart, aCallback, aCookie))
+            {
+                return false;
+            }
+        }
+
+        _Tail.clear();
+        return true;
+    }
+}
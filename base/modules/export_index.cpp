@@ -0,0 +1,160 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/universal.inl"
+
+
+namespace base::modules
+{
+    uint64_t ExportIndex::HashName(_In_reads_(length) const char* name, _In_ size_t length)
+    {
+        // FNV-1a.
+        auto hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < length; ++i) {
+            hash = (hash ^ static_cast<uint8_t>(name[i])) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    bool ExportIndex::Build(_In_ const PEImage& image)
+    {
+        Reset();
+
+        PIMAGE_EXPORT_DIRECTORY exports = image.GetExportDirectory();
+        if (nullptr == exports) {
+            return false;
+        }
+
+        const auto& directory = image.GetNTHeaders()->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+        _DirectoryRVA  = directory.VirtualAddress;
+        _DirectorySize = directory.Size;
+        _Base = exports->Base;
+
+        auto functions = reinterpret_cast<PDWORD>(image.RVAToAddr(exports->AddressOfFunctions));
+        auto names     = reinterpret_cast<PDWORD>(image.RVAToAddr(exports->AddressOfNames));
+        auto ordinals  = reinterpret_cast<PWORD >(image.RVAToAddr(exports->AddressOfNameOrdinals));
+
+        // Ordinals are 16 bits; anything past that is not reachable.
+        const DWORD num_funcs = functions ? std::min<DWORD>(exports->NumberOfFunctions, 0x10000) : 0;
+        const DWORD num_names = (names && ordinals) ? exports->NumberOfNames : 0;
+
+        _Functions.assign(functions, functions + num_funcs);
+
+        size_t capacity = 16;
+        while (capacity < num_names * size_t(2)) {
+            capacity *= 2;
+        }
+        _Slots.assign(capacity, Slot{ 0, npos, 0, {} });
+
+        const size_t mask = capacity - 1;
+
+        for (DWORD i = 0; i < num_names; ++i) {
+            auto name = reinterpret_cast<LPCSTR>(image.RVAToAddr(names[i]));
+            const DWORD index = ordinals[i];
+            if (nullptr == name || index >= num_funcs) {
+                continue;
+            }
+
+            const auto length = strlen(name);
+            const auto hash = HashName(name, length);
+
+            Export value{};
+            if (Find(hash, name, length, &value)) {
+                // Keep the first of duplicate names.
+                continue;
+            }
+
+            size_t slot = hash & mask;
+            while (_Slots[slot].Name != npos) {
+                slot = (slot + 1) & mask;
+            }
+
+            const DWORD rva = _Functions[index];
+            _Slots[slot].Hash   = hash;
+            _Slots[slot].Name   = static_cast<uint32_t>(_Names.size());
+            _Slots[slot].Length = static_cast<uint32_t>(length);
+            _Slots[slot].Value.Ordinal   = static_cast<WORD>(index + _Base);
+            _Slots[slot].Value.RVA       = rva;
+            _Slots[slot].Value.Forwarded = rva - _DirectoryRVA < _DirectorySize;
+
+            _Names.append(name, length + 1);
+            ++_Count;
+        }
+
+        return true;
+    }
+
+    void ExportIndex::Reset()
+    {
+        _Slots.clear();
+        _Names.clear();
+        _Functions.clear();
+        _Count = 0;
+        _Base = 0;
+        _DirectoryRVA  = 0;
+        _DirectorySize = 0;
+    }
+
+    bool ExportIndex::Find(_In_ uint64_t hash, _In_ LPCSTR name, _In_ size_t length, _Out_ Export* result) const
+    {
+        const size_t mask = _Slots.size() - 1;
+
+        for (size_t slot = hash & mask; _Slots[slot].Name != npos; slot = (slot + 1) & mask) {
+            const auto& entry = _Slots[slot];
+            if (entry.Hash == hash && entry.Length == length &&
+                memcmp(_Names.data() + entry.Name, name, length) == 0) {
+                *result = entry.Value;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool ExportIndex::ResolveOrdinal(_In_ WORD ordinal, _Out_ Export* result) const
+    {
+        const DWORD index = ordinal - _Base;
+        if (index >= _Functions.size() || _Functions[index] == 0) {
+            return false;
+        }
+
+        result->Ordinal   = ordinal;
+        result->RVA       = _Functions[index];
+        result->Forwarded = result->RVA - _DirectoryRVA < _DirectorySize;
+        return true;
+    }
+
+    bool ExportIndex::Resolve(_In_ LPCSTR name, _Out_ Export* result) const
+    {
+        if (nullptr == result) {
+            return false;
+        }
+
+        *result = Export{};
+
+        if (!IsValid()) {
+            return false;
+        }
+
+        if (PEImage::IsOrdinal(name)) {
+            return ResolveOrdinal(PEImage::ToOrdinal(name), result);
+        }
+
+        const auto length = strlen(name);
+        return Find(HashName(name, length), name, length, result);
+    }
+
+    size_t ExportIndex::ResolveMany(
+        _In_reads_(count) const LPCSTR* names,
+        _In_ size_t count,
+        _Out_writes_(count) Export* results
+    ) const
+    {
+        size_t resolved = 0;
+        for (size_t i = 0; i < count; ++i) {
+            resolved += Resolve(names[i], &results[i]) ? 1 : 0;
+        }
+        return resolved;
+    }
+}
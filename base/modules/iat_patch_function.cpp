@@ -9,16 +9,6 @@ namespace base::modules
 {
     namespace
     {
-        struct InterceptFunctionInformation {
-            bool finished_operation;
-            const char* imported_from_module;
-            const char* function_name;
-            void* new_function;
-            void** old_function;
-            IMAGE_THUNK_DATA** iat_thunk;
-            DWORD return_code;
-        };
-
         void* GetIATFunction(IMAGE_THUNK_DATA* iat_thunk) {
             if (iat_thunk == nullptr) {
                 return nullptr;
@@ -35,47 +25,41 @@ namespace base::modules
             return iat_function.pointer;
         }
 
-        bool InterceptEnumCallback(
-            const PEImage& /*image*/,
-            const char* module,
-            DWORD /*ordinal*/,
-            const char* name,
-            DWORD /*hint*/,
+        // Returns true if the entry imports function_name from
+        // imported_from_module.
+        bool IsImport(
+            const PEImage::ImportEntry& entry,
+            const char* imported_from_module,
+            const char* function_name
+        ) {
+            return (lstrcmpiA(entry.module, imported_from_module) == 0) &&
+                (entry.name != nullptr) &&
+                (lstrcmpiA(entry.name, function_name) == 0);
+        }
+
+        // Patches the IAT slot of an import.
+        DWORD PatchImport(
             IMAGE_THUNK_DATA* iat,
-            void* cookie
+            void* new_function,
+            void** old_function,
+            IMAGE_THUNK_DATA** iat_thunk
         ) {
-            auto intercept_information = reinterpret_cast<InterceptFunctionInformation*>(cookie);
-            if (intercept_information == nullptr) {
-                return false;
+            // Save the old pointer.
+            if (old_function != nullptr) {
+                *old_function = GetIATFunction(iat);
             }
-
-            if ((lstrcmpiA(module, intercept_information->imported_from_module) == 0) &&
-                (name != nullptr) &&
-                (lstrcmpiA(name, intercept_information->function_name) == 0)) {
-
-                // Save the old pointer.
-                if (intercept_information->old_function != nullptr) {
-                    *(intercept_information->old_function) = GetIATFunction(iat);
-                }
-                if (intercept_information->iat_thunk != nullptr) {
-                    *(intercept_information->iat_thunk) = iat;
-                }
-
-                // portability check
-                static_assert(sizeof(iat->u1.Function) == sizeof(intercept_information->new_function));
-
-                // Patch the function.
-                intercept_information->return_code = ModifyCode(
-                    &(iat->u1.Function),
-                    &(intercept_information->new_function),
-                    sizeof(intercept_information->new_function));
-
-                // Terminate further enumeration.
-                intercept_information->finished_operation = true;
-                return false;
+            if (iat_thunk != nullptr) {
+                *iat_thunk = iat;
             }
 
-            return true;
+            // portability check
+            static_assert(sizeof(iat->u1.Function) == sizeof(new_function));
+
+            // Patch the function.
+            return ModifyCode(
+                &(iat->u1.Function),
+                &new_function,
+                sizeof(new_function));
         }
 
         // Helper to intercept a function in an import table of a specific
@@ -110,23 +94,21 @@ namespace base::modules
                 return ERROR_INVALID_PARAMETER;
             }
 
-            InterceptFunctionInformation intercept_information = {
-              false,
-              imported_from_module,
-              function_name,
-              new_function,
-              old_function,
-              iat_thunk,
-              ERROR_GEN_FAILURE };
-
             // First go through the IAT. If we don't find the import we are looking
             // for in IAT, search delay import table.
-            target_image.EnumAllImports(InterceptEnumCallback, &intercept_information);
+            for (const auto& entry : target_image.Imports()) {
+                if (IsImport(entry, imported_from_module, function_name)) {
+                    return PatchImport(entry.iat, new_function, old_function, iat_thunk);
+                }
+            }
 
-            if (!intercept_information.finished_operation) {
-                target_image.EnumAllDelayImports(InterceptEnumCallback, &intercept_information);
+            for (const auto& entry : target_image.DelayImports()) {
+                if (IsImport(entry, imported_from_module, function_name)) {
+                    return PatchImport(entry.iat, new_function, old_function, iat_thunk);
+                }
             }
-            return intercept_information.return_code;
+
+            return ERROR_GEN_FAILURE;
         }
 
         // Restore intercepted IAT entry with the original function.
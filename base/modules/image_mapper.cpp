@@ -0,0 +1,441 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/stdext.h"
+#   include "include/libbase/modules/pe_parser.h"
+#   include "include/libbase/modules/pe_relocate.h"
+#   include "include/libbase/modules/image_mapper.h"
+#   include <algorithm>
+#   include <cerrno>
+#   include <cstring>
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+
+namespace base::modules
+{
+    namespace
+    {
+        // The file and memory calls of the platform: ReadFile and
+        // VirtualAlloc on Windows, pread and mmap elsewhere.
+#ifdef _WIN32
+        using FileHandle = HANDLE;
+
+        DWORD OpenFile(const std::filesystem::path& file_name, FileHandle* file, ULONGLONG* file_size) {
+            *file = CreateFileW(file_name.c_str(), GENERIC_READ,
+                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (*file == INVALID_HANDLE_VALUE) {
+                return GetLastError();
+            }
+
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(*file, &size)) {
+                const DWORD error = GetLastError();
+                CloseHandle(*file);
+                return error;
+            }
+
+            *file_size = static_cast<ULONGLONG>(size.QuadPart);
+            return NO_ERROR;
+        }
+
+        void CloseFile(FileHandle file) {
+            CloseHandle(file);
+        }
+
+        // Reads exactly length bytes at offset of the file into buffer.
+        DWORD ReadAt(FileHandle file, ULONGLONG offset, PVOID buffer, DWORD length) {
+            OVERLAPPED overlapped{};
+            overlapped.Offset     = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD read = 0;
+            if (!ReadFile(file, buffer, length, &read, &overlapped)) {
+                return GetLastError();
+            }
+            return read == length ? NO_ERROR : ERROR_HANDLE_EOF;
+        }
+
+        // Reads the raw data of a section to its place in the region.
+        DWORD MapSection(FileHandle file, ULONGLONG offset, PBYTE address, DWORD length) {
+            return ReadAt(file, offset, address, length);
+        }
+
+        DWORD GetPageSize() {
+            SYSTEM_INFO system_info{};
+            GetSystemInfo(&system_info);
+            return system_info.dwPageSize;
+        }
+
+        // Committed memory is zero.
+        DWORD AllocateRegion(size_t size, PBYTE* region) {
+            *region = static_cast<PBYTE>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            return *region ? NO_ERROR : GetLastError();
+        }
+
+        void FreeRegion(PBYTE region, size_t /*size*/) {
+            VirtualFree(region, 0, MEM_RELEASE);
+        }
+
+
+        constexpr DWORD kHeadersProtection = PAGE_READONLY;
+        constexpr DWORD kSharedProtection  = PAGE_EXECUTE_READWRITE;
+
+        DWORD ProtectPages(PBYTE address, size_t size, DWORD protection) {
+            DWORD old_protection = 0;
+            return VirtualProtect(address, size, protection, &old_protection) ? NO_ERROR : GetLastError();
+        }
+#else
+        using FileHandle = int;
+
+        DWORD ErrorFromErrno(int error) {
+            switch (error) {
+            case ENOENT:
+            case ENOTDIR:
+                return ERROR_FILE_NOT_FOUND;
+            case EACCES:
+            case EPERM:
+                return ERROR_ACCESS_DENIED;
+            case ENOMEM:
+                return ERROR_NOT_ENOUGH_MEMORY;
+            case EINVAL:
+                return ERROR_INVALID_PARAMETER;
+            default:
+                return ERROR_GEN_FAILURE;
+            }
+        }
+
+        DWORD OpenFile(const std::filesystem::path& file_name, FileHandle* file, ULONGLONG* file_size) {
+            *file = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (*file < 0) {
+                return ErrorFromErrno(errno);
+            }
+
+            struct stat status{};
+            if (fstat(*file, &status) != 0 || !S_ISREG(status.st_mode)) {
+                const DWORD error = S_ISREG(status.st_mode) ? ErrorFromErrno(errno) : ERROR_ACCESS_DENIED;
+                close(*file);
+                return error;
+            }
+
+            *file_size = static_cast<ULONGLONG>(status.st_size);
+            return NO_ERROR;
+        }
+
+        void CloseFile(FileHandle file) {
+            close(file);
+        }
+
+        // Reads exactly length bytes at offset of the file into buffer.
+        DWORD ReadAt(FileHandle file, ULONGLONG offset, PVOID buffer, DWORD length) {
+            auto bytes = static_cast<PBYTE>(buffer);
+
+            while (length != 0) {
+                const auto read = pread(file, bytes, length, static_cast<off_t>(offset));
+                if (read < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (read <= 0) {
+                    return read == 0 ? ERROR_HANDLE_EOF : ErrorFromErrno(errno);
+                }
+
+                bytes  += read;
+                offset += static_cast<ULONGLONG>(read);
+                length -= static_cast<DWORD>(read);
+            }
+            return NO_ERROR;
+        }
+
+        DWORD GetPageSize() {
+            return static_cast<DWORD>(sysconf(_SC_PAGESIZE));
+        }
+
+        // Puts the raw data of a section at its place in the region. The
+        // whole pages of a file-aligned section are mapped copy-on-write
+        // from the file instead of read; the partial last page is read, so
+        // that the rest of it stays zero.
+        DWORD MapSection(FileHandle file, ULONGLONG offset, PBYTE address, DWORD length) {
+            const DWORD page_size = GetPageSize();
+
+            DWORD mapped = 0;
+            if (offset % page_size == 0 && reinterpret_cast<uintptr_t>(address) % page_size == 0) {
+                mapped = length / page_size * page_size;
+            }
+
+            if (mapped != 0 && mmap(address, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                file, static_cast<off_t>(offset)) == MAP_FAILED) {
+                // The region is intact; read the section instead.
+                mapped = 0;
+            }
+
+            return mapped == length ? NO_ERROR : ReadAt(file, offset + mapped, address + mapped, length - mapped);
+        }
+
+        // Anonymous memory is zero.
+        DWORD AllocateRegion(size_t size, PBYTE* region) {
+            const auto address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            *region = address != MAP_FAILED ? static_cast<PBYTE>(address) : nullptr;
+            return *region ? NO_ERROR : ErrorFromErrno(errno);
+        }
+
+        void FreeRegion(PBYTE region, size_t size) {
+            munmap(region, size);
+        }
+
+        // The protection the loader gives a section with characteristics.
+        DWORD SectionProtection(DWORD characteristics) {
+            DWORD protection = PROT_NONE;
+            protection |= (characteristics & IMAGE_SCN_MEM_READ) ? PROT_READ : 0;
+            protection |= (characteristics & IMAGE_SCN_MEM_WRITE) ? PROT_READ | PROT_WRITE : 0;
+            protection |= (characteristics & IMAGE_SCN_MEM_EXECUTE) ? PROT_EXEC : 0;
+            return protection;
+        }
+
+        constexpr DWORD kHeadersProtection = PROT_READ;
+        constexpr DWORD kSharedProtection  = PROT_READ | PROT_WRITE | PROT_EXEC;
+
+        DWORD ProtectPages(PBYTE address, size_t size, DWORD protection) {
+            return mprotect(address, size, static_cast<int>(protection)) == 0 ? NO_ERROR : ErrorFromErrno(errno);
+        }
+#endif
+
+        // Checks the headers read from the file, before the region is
+        // allocated from what they say.
+        bool IsMappable(const IMAGE_DOS_HEADER& dos_header, const IMAGE_NT_HEADERS& nt_headers) {
+            const auto& optional_header = nt_headers.OptionalHeader;
+
+            const ULONGLONG section_table = static_cast<ULONGLONG>(dos_header.e_lfanew) + sizeof(IMAGE_NT_HEADERS);
+
+            return nt_headers.Signature == IMAGE_NT_SIGNATURE &&
+                nt_headers.FileHeader.SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER) &&
+                optional_header.Magic == IMAGE_NT_OPTIONAL_HDR_MAGIC &&
+                optional_header.SectionAlignment != 0 &&
+                optional_header.SizeOfImage != 0 &&
+                optional_header.SizeOfHeaders <= optional_header.SizeOfImage &&
+                section_table + nt_headers.FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER) <=
+                    optional_header.SizeOfHeaders;
+        }
+    }  // namespace
+
+    ImageMapper::~ImageMapper()
+    {
+        Unmap();
+    }
+
+    DWORD ImageMapper::Map(_In_ const std::filesystem::path& file_name)
+    {
+        Unmap();
+
+        FileHandle file{};
+        ULONGLONG file_size = 0;
+
+        DWORD error = OpenFile(file_name, &file, &file_size);
+        if (error != NO_ERROR) {
+            return error;
+        }
+
+        auto close_file = stdext::scope_exit([file]() { CloseFile(file); });
+
+        // The headers first, for SizeOfImage.
+        IMAGE_DOS_HEADER dos_header{};
+        IMAGE_NT_HEADERS nt_headers{};
+
+        if (file_size < sizeof(dos_header) ||
+            ReadAt(file, 0, &dos_header, sizeof(dos_header)) != NO_ERROR ||
+            dos_header.e_magic != IMAGE_DOS_SIGNATURE ||
+            dos_header.e_lfanew <= 0 ||
+            static_cast<ULONGLONG>(dos_header.e_lfanew) + sizeof(nt_headers) > file_size ||
+            ReadAt(file, dos_header.e_lfanew, &nt_headers, sizeof(nt_headers)) != NO_ERROR ||
+            !IsMappable(dos_header, nt_headers)) {
+            return ERROR_BAD_EXE_FORMAT;
+        }
+
+        const DWORD image_size = nt_headers.OptionalHeader.SizeOfImage;
+        const DWORD alignment  = nt_headers.OptionalHeader.SectionAlignment;
+
+        // Committed memory is zero, which leaves uninitialized data and the
+        // tails of sections as the loader leaves them.
+        PBYTE region = nullptr;
+        error = AllocateRegion(image_size, &region);
+        if (error != NO_ERROR) {
+            return error;
+        }
+
+        auto release_region = stdext::scope_exit([region, image_size]() { FreeRegion(region, image_size); });
+
+        // Everything is read straight to its place in the region. The
+        // headers are used from there on, so they must be the ones checked
+        // above even if the file changed in between.
+        const auto headers_size = static_cast<DWORD>(std::min<ULONGLONG>(nt_headers.OptionalHeader.SizeOfHeaders, file_size));
+
+        error = ReadAt(file, 0, region, headers_size);
+        if (error != NO_ERROR) {
+            return error;
+        }
+
+        auto mapped_headers = reinterpret_cast<PIMAGE_NT_HEADERS>(region + dos_header.e_lfanew);
+        if (memcmp(region, &dos_header, sizeof(dos_header)) != 0 ||
+            memcmp(mapped_headers, &nt_headers, sizeof(nt_headers)) != 0) {
+            return ERROR_BAD_EXE_FORMAT;
+        }
+
+        PIMAGE_SECTION_HEADER sections = IMAGE_FIRST_SECTION(mapped_headers);
+
+        for (WORD i = 0; i < nt_headers.FileHeader.NumberOfSections; ++i) {
+            const IMAGE_SECTION_HEADER& section = sections[i];
+
+            // The loader reads no more than the aligned virtual size, and
+            // nothing past the end of the file.
+            ULONGLONG raw_size = section.SizeOfRawData;
+            if (section.Misc.VirtualSize != 0) {
+                const ULONGLONG virtual_size = (static_cast<ULONGLONG>(section.Misc.VirtualSize) + alignment - 1) / alignment * alignment;
+                raw_size = std::min(raw_size, virtual_size);
+            }
+            raw_size = section.PointerToRawData < file_size
+                ? std::min(raw_size, file_size - section.PointerToRawData)
+                : 0;
+
+            if (static_cast<ULONGLONG>(section.VirtualAddress) + raw_size > image_size) {
+                return ERROR_BAD_EXE_FORMAT;
+            }
+
+            if (raw_size != 0) {
+                error = MapSection(file, section.PointerToRawData, region + section.VirtualAddress, static_cast<DWORD>(raw_size));
+                if (error != NO_ERROR) {
+                    return error;
+                }
+            }
+        }
+
+        release_region.release();
+
+        _Region = region;
+        _Size   = image_size;
+        SetModule(reinterpret_cast<HMODULE>(region));
+
+        return NO_ERROR;
+    }
+
+    void ImageMapper::Unmap()
+    {
+        if (_Region != nullptr) {
+            FreeRegion(_Region, _Size);
+        }
+
+        SetModule(nullptr);
+        _Region = nullptr;
+        _Size   = 0;
+    }
+
+    DWORD ImageMapper::Relocate()
+    {
+        if (!IsValid()) {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        return ApplyRelocations(*this, reinterpret_cast<ULONGLONG>(_Region));
+    }
+
+    void ImageMapper::AddImportResolver(_In_ ImportResolver resolver, _In_opt_ PVOID cookie)
+    {
+        _Resolvers.push_back({ resolver, cookie });
+    }
+
+    DWORD ImageMapper::ResolveImports()
+    {
+        if (!IsValid()) {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        for (const auto& import : Imports()) {
+            if (import.iat == nullptr) {
+                return ERROR_BAD_EXE_FORMAT;
+            }
+
+            bool resolved = false;
+            for (const auto& resolver : _Resolvers) {
+                ULONGLONG address = 0;
+                if (resolver.Function(*this, import, &address, resolver.Cookie)) {
+                    import.iat->u1.Function = static_cast<decltype(import.iat->u1.Function)>(address);
+                    resolved = true;
+                    break;
+                }
+            }
+
+            if (!resolved) {
+                return ERROR_PROC_NOT_FOUND;
+            }
+        }
+
+        return NO_ERROR;
+    }
+
+    DWORD ImageMapper::Protect()
+    {
+        if (!IsValid()) {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        PIMAGE_NT_HEADERS nt_headers = GetNTHeaders();
+        const DWORD alignment = nt_headers->OptionalHeader.SectionAlignment;
+
+        if (alignment < GetPageSize()) {
+            return ProtectPages(_Region, _Size, kSharedProtection);
+        }
+
+        DWORD error = ProtectPages(_Region, nt_headers->OptionalHeader.SizeOfHeaders, kHeadersProtection);
+        if (error != NO_ERROR) {
+            return error;
+        }
+
+        for (const auto& section : Sections()) {
+            const ULONGLONG start = section.header->VirtualAddress;
+            const DWORD section_size = section.section_size != 0
+                ? section.section_size
+                : section.header->SizeOfRawData;
+
+            if (section_size == 0 || start >= _Size) {
+                continue;
+            }
+
+            // Sections span whole alignment units, up to the end of the image.
+            const ULONGLONG size = std::min<ULONGLONG>(
+                (static_cast<ULONGLONG>(section_size) + alignment - 1) / alignment * alignment,
+                _Size - start);
+
+            error = ProtectPages(_Region + start, static_cast<size_t>(size),
+                SectionProtection(section.header->Characteristics));
+            if (error != NO_ERROR) {
+                return error;
+            }
+        }
+
+        return NO_ERROR;
+    }
+
+    PVOID ImageMapper::RVAToAddr(_In_ size_t rva) const
+    {
+        if (rva == 0 || rva >= _Size) {
+            return nullptr;
+        }
+
+        return _Region + rva;
+    }
+
+    size_t ImageMapper::GetReadableSize(_In_ const void* address) const
+    {
+        const auto byte = static_cast<const uint8_t*>(address);
+        if (_Region == nullptr || byte < _Region || byte >= _Region + _Size) {
+            return 0;
+        }
+        return static_cast<size_t>(_Region + _Size - byte);
+    }
+}
@@ -0,0 +1,479 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/files/memory_mapped_file.h"
+#   include "include/libbase/modules/pe_view.h"
+#   include "include/libbase/modules/pe_corpus_scanner.h"
+#   include <algorithm>
+#   include <atomic>
+#   include <chrono>
+#   include <condition_variable>
+#   include <cstring>
+#   include <mutex>
+#   include <string_view>
+#   include <thread>
+#endif
+#include <deque>
+#include <unordered_map>
+
+
+namespace base::modules
+{
+    namespace
+    {
+        // A CodeView debug record, as written by the linker for PDB 7.0.
+        struct CodeViewRecord
+        {
+            DWORD Signature;    // "RSDS"
+            GUID  Guid;
+            DWORD Age;
+        };
+
+        constexpr DWORD kCodeViewSignature = 0x53445352; // "RSDS"
+
+        // Paths are stored in UTF-8. Windows paths are UTF-16; elsewhere
+        // they are bytes, UTF-8 by convention, and stored as they are.
+        std::string PathToUtf8(const std::filesystem::path& path) {
+#ifdef _WIN32
+            return codepage::wcstombs(path.native());
+#else
+            return path.native();
+#endif
+        }
+
+        struct WorkItem
+        {
+            std::filesystem::path path;
+            bool directory;
+        };
+
+        // The deque of one thread of the pool. The owner pushes and pops at
+        // the back; other threads steal from the front.
+        struct WorkQueue
+        {
+            std::mutex            lock;
+            std::deque<WorkItem>  items;
+        };
+
+        // One file, parsed before it is added to the summary.
+        struct FileRecord
+        {
+            uint64_t file_size       = 0;
+            int64_t  last_write_time = 0;
+            WORD     machine         = 0;
+            DWORD    time_date_stamp = 0;
+            uint8_t  flags           = 0;
+            uint32_t export_count    = 0;
+            GUID     debug_guid{};
+            DWORD    debug_age       = 0;
+
+            std::vector<IMAGE_SECTION_HEADER> sections;
+
+            // Imported modules and the number of functions from each.
+            std::vector<std::pair<LPCSTR, uint32_t>> imports;
+
+            // Resets the record, keeping the capacity of the vectors.
+            void Clear() {
+                file_size       = 0;
+                last_write_time = 0;
+                machine         = 0;
+                time_date_stamp = 0;
+                flags           = 0;
+                export_count    = 0;
+                debug_guid      = GUID{};
+                debug_age       = 0;
+                sections.clear();
+                imports.clear();
+            }
+        };
+
+        // Reads the file header and the section table, which have the same
+        // layout in PE32 and PE32+ files.
+        bool ReadHeaders(const uint8_t* data, size_t size, FileRecord* record) {
+            if (size < sizeof(IMAGE_DOS_HEADER)) {
+                return false;
+            }
+
+            const auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(data);
+            if (dos_header->e_magic != IMAGE_DOS_SIGNATURE || dos_header->e_lfanew < 0) {
+                return false;
+            }
+
+            const size_t file_header = static_cast<size_t>(dos_header->e_lfanew) + sizeof(DWORD);
+            if (file_header + sizeof(IMAGE_FILE_HEADER) > size) {
+                return false;
+            }
+
+            DWORD signature = 0;
+            memcpy(&signature, data + dos_header->e_lfanew, sizeof(signature));
+            if (signature != IMAGE_NT_SIGNATURE) {
+                return false;
+            }
+
+            IMAGE_FILE_HEADER header{};
+            memcpy(&header, data + file_header, sizeof(header));
+
+            record->machine         = header.Machine;
+            record->time_date_stamp = header.TimeDateStamp;
+
+            const size_t section_table = file_header + sizeof(IMAGE_FILE_HEADER) + header.SizeOfOptionalHeader;
+            const size_t sections = section_table < size
+                ? std::min<size_t>(header.NumberOfSections, (size - section_table) / sizeof(IMAGE_SECTION_HEADER))
+                : 0;
+
+            record->sections.resize(sections);
+            if (sections != 0) {
+                memcpy(record->sections.data(), data + section_table, sections * sizeof(IMAGE_SECTION_HEADER));
+            }
+            return true;
+        }
+
+        bool CountImport(const PEView&, LPCSTR module, DWORD, LPCSTR, DWORD, DWORD, PVOID cookie) {
+            auto& imports = static_cast<FileRecord*>(cookie)->imports;
+
+            // The imports of a module are enumerated together.
+            if (imports.empty() || imports.back().first != module) {
+                imports.emplace_back(module, 0);
+            }
+            imports.back().second += 1;
+            return true;
+        }
+
+        bool CountExport(const PEView&, DWORD, DWORD, LPCSTR, DWORD, LPCSTR, PVOID cookie) {
+            static_cast<FileRecord*>(cookie)->export_count += 1;
+            return true;
+        }
+
+        // Reads the imports, the exports and the debug identifier of a PE32
+        // or PE32+ file.
+        void ParseView(const uint8_t* data, size_t size, FileRecord* record) {
+            const PEView view(data, size, PEView::Layout::File);
+            if (!view.IsValid()) {
+                return;
+            }
+
+            record->flags |= PECorpusSummary::kParsed;
+
+            view.EnumImports(CountImport, record);
+            view.EnumExports(CountExport, record);
+
+            const auto debug = view.GetDirectory(IMAGE_DIRECTORY_ENTRY_DEBUG);
+            const auto count = debug.Size / sizeof(IMAGE_DEBUG_DIRECTORY);
+
+            for (size_t i = 0; i < count; ++i) {
+                IMAGE_DEBUG_DIRECTORY entry{};
+                memcpy(&entry, debug.Data + i * sizeof(entry), sizeof(entry));
+
+                if (entry.Type != IMAGE_DEBUG_TYPE_CODEVIEW ||
+                    entry.SizeOfData < sizeof(CodeViewRecord) ||
+                    entry.PointerToRawData > size ||
+                    size - entry.PointerToRawData < sizeof(CodeViewRecord)) {
+                    continue;
+                }
+
+                CodeViewRecord codeview{};
+                memcpy(&codeview, data + entry.PointerToRawData, sizeof(codeview));
+
+                if (codeview.Signature == kCodeViewSignature) {
+                    record->debug_guid = codeview.Guid;
+                    record->debug_age  = codeview.Age;
+                    record->flags |= PECorpusSummary::kHasDebugId;
+                    break;
+                }
+            }
+        }
+
+        // Shared state of one Scan.
+        class CorpusWalk
+        {
+        public:
+            CorpusWalk(size_t threads, PECorpusSummary* summary)
+                : _Queues(threads), _Summary(summary) {
+            }
+
+            void Push(size_t worker, WorkItem&& item) {
+                _Pending += 1;
+                {
+                    std::lock_guard<std::mutex> guard(_Queues[worker].lock);
+                    _Queues[worker].items.push_back(std::move(item));
+                    _Queued += 1;
+                }
+
+                if (_Idle != 0) {
+                    std::lock_guard<std::mutex> guard(_IdleLock);
+                    _Signal.notify_one();
+                }
+            }
+
+            void Run(size_t worker) {
+                FileRecord record;
+                WorkItem item;
+
+                while (Pop(worker, &item)) {
+                    if (item.directory) {
+                        List(worker, item.path, &record);
+                    }
+                    else {
+                        Scan(item.path, &record);
+                    }
+
+                    if (--_Pending == 0) {
+                        std::lock_guard<std::mutex> guard(_IdleLock);
+                        _Signal.notify_all();
+                    }
+                }
+            }
+
+            PECorpusStats Stats() const {
+                PECorpusStats stats;
+                stats.files  = _Files;
+                stats.images = _Images;
+                stats.bytes  = _Bytes;
+                stats.errors = _Errors;
+                return stats;
+            }
+
+        private:
+            // Takes the newest item of the worker's own queue, or else the
+            // oldest of another's. Waits while other workers may still push
+            // work; returns false once there is none left anywhere.
+            bool Pop(size_t worker, WorkItem* item) {
+                for (;;) {
+                    for (size_t i = 0; i < _Queues.size(); ++i) {
+                        const size_t victim = (worker + i) % _Queues.size();
+                        auto& queue = _Queues[victim];
+
+                        std::lock_guard<std::mutex> guard(queue.lock);
+                        if (queue.items.empty()) {
+                            continue;
+                        }
+
+                        if (victim == worker) {
+                            *item = std::move(queue.items.back());
+                            queue.items.pop_back();
+                        }
+                        else {
+                            *item = std::move(queue.items.front());
+                            queue.items.pop_front();
+                        }
+                        _Queued -= 1;
+                        return true;
+                    }
+
+                    std::unique_lock<std::mutex> guard(_IdleLock);
+                    _Idle += 1;
+                    _Signal.wait(guard, [this]() { return _Queued != 0 || _Pending == 0; });
+                    _Idle -= 1;
+
+                    if (_Queued == 0 && _Pending == 0) {
+                        return false;
+                    }
+                }
+            }
+
+            // Pushes the subdirectories and scans the files as they are
+            // listed, so the pending work holds directories and grows with
+            // the shape of the tree, not with the number of files. A file is
+            // handed to the pool instead only while a worker waits with
+            // nothing to take, which keeps the threads busy in a flat
+            // directory and queues a file or so per thread at most.
+            void List(size_t worker, const std::filesystem::path& directory, FileRecord* record) {
+                std::error_code error;
+                std::filesystem::directory_iterator it(directory,
+                    std::filesystem::directory_options::skip_permission_denied, error);
+                if (error) {
+                    _Errors += 1;
+                    return;
+                }
+
+                for (const std::filesystem::directory_iterator end; it != end; it.increment(error)) {
+                    if (error) {
+                        _Errors += 1;
+                        break;
+                    }
+
+                    // symlink_status does not follow links, so links to
+                    // directories are neither walked nor scanned.
+                    const auto status = it->symlink_status(error);
+                    if (error) {
+                        continue;
+                    }
+
+                    if (std::filesystem::is_directory(status)) {
+                        Push(worker, { it->path(), true });
+                    }
+                    else if (std::filesystem::is_regular_file(status)) {
+                        if (_Idle != 0 && _Queued == 0) {
+                            Push(worker, { it->path(), false });
+                        }
+                        else {
+                            Scan(it->path(), record);
+                        }
+                    }
+                }
+            }
+
+            void Scan(const std::filesystem::path& path, FileRecord* record) {
+                _Files += 1;
+
+                files::MemoryMappedFile file;
+                if (!file.Initialize(path)) {
+                    // Empty files cannot be mapped, and are not PE files.
+                    std::error_code error;
+                    if (std::filesystem::file_size(path, error) != 0 || error) {
+                        _Errors += 1;
+                    }
+                    return;
+                }
+
+                _Bytes += file.Length();
+
+                record->Clear();
+                if (!ReadHeaders(file.Data(), file.Length(), record)) {
+                    return;
+                }
+
+                _Images += 1;
+
+                record->file_size = file.Length();
+
+                std::error_code error;
+                record->last_write_time = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+
+                ParseView(file.Data(), file.Length(), record);
+
+                // The module names point into the mapping; they are copied
+                // into the summary before it is unmapped.
+                Append(path, *record);
+            }
+
+            uint32_t AddString(std::string_view value) {
+                const auto offset = static_cast<uint32_t>(_Summary->strings.size());
+                _Summary->strings.append(value.data(), value.size());
+                _Summary->strings.push_back('\0');
+                return offset;
+            }
+
+            // Module names repeat across files; each is stored once.
+            uint32_t InternString(std::string_view value) {
+                const auto it = _Interned.find(std::string(value));
+                if (it != _Interned.end()) {
+                    return it->second;
+                }
+
+                const auto offset = AddString(value);
+                _Interned.emplace(value, offset);
+                return offset;
+            }
+
+            void Append(const std::filesystem::path& path, const FileRecord& record) {
+                const auto name = PathToUtf8(path);
+
+                std::lock_guard<std::mutex> guard(_SummaryLock);
+                auto& summary = *_Summary;
+
+                summary.path.push_back(AddString(name));
+                summary.file_size.push_back(record.file_size);
+                summary.last_write_time.push_back(record.last_write_time);
+                summary.machine.push_back(record.machine);
+                summary.time_date_stamp.push_back(record.time_date_stamp);
+                summary.flags.push_back(record.flags);
+                summary.export_count.push_back(record.export_count);
+                summary.debug_guid.push_back(record.debug_guid);
+                summary.debug_age.push_back(record.debug_age);
+
+                summary.first_section.push_back(static_cast<uint32_t>(summary.section_rva.size()));
+                summary.section_count.push_back(static_cast<WORD>(record.sections.size()));
+
+                for (const auto& section : record.sections) {
+                    const auto name_length = strnlen(reinterpret_cast<const char*>(section.Name), IMAGE_SIZEOF_SHORT_NAME);
+                    summary.section_name.push_back(InternString({ reinterpret_cast<const char*>(section.Name), name_length }));
+                    summary.section_rva.push_back(section.VirtualAddress);
+                    summary.section_size.push_back(section.Misc.VirtualSize);
+                    summary.section_characteristics.push_back(section.Characteristics);
+                }
+
+                summary.first_import.push_back(static_cast<uint32_t>(summary.import_module.size()));
+                summary.import_count.push_back(static_cast<uint32_t>(record.imports.size()));
+
+                for (const auto& import : record.imports) {
+                    summary.import_module.push_back(InternString(import.first));
+                    summary.import_functions.push_back(import.second);
+                }
+            }
+
+            std::vector<WorkQueue> _Queues;
+
+            std::atomic<size_t> _Pending{ 0 };     // Pushed and not finished.
+            std::atomic<size_t> _Queued{ 0 };      // Pushed and not taken.
+            std::atomic<size_t> _Idle{ 0 };
+
+            std::mutex              _IdleLock;
+            std::condition_variable _Signal;
+
+            std::mutex        _SummaryLock;
+            PECorpusSummary*  _Summary;
+            std::unordered_map<std::string, uint32_t> _Interned;
+
+            std::atomic<uint64_t> _Files{ 0 };
+            std::atomic<uint64_t> _Images{ 0 };
+            std::atomic<uint64_t> _Bytes{ 0 };
+            std::atomic<uint64_t> _Errors{ 0 };
+        };
+    }  // namespace
+
+    void PECorpusSummary::Clear()
+    {
+        *this = PECorpusSummary{};
+    }
+
+    PECorpusScanner::PECorpusScanner(_In_opt_ size_t threads)
+        : _Threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    DWORD PECorpusScanner::Scan(
+        _In_ const std::vector<std::filesystem::path>& roots,
+        _Out_ PECorpusSummary* summary,
+        _Out_opt_ PECorpusStats* stats
+    )
+    {
+        if (summary == nullptr) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        summary->Clear();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        CorpusWalk walk(_Threads, summary);
+
+        for (size_t i = 0; i < roots.size(); ++i) {
+            std::error_code error;
+            const bool directory = std::filesystem::is_directory(roots[i], error);
+            walk.Push(i % _Threads, { roots[i], directory });
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < _Threads; ++i) {
+            workers.emplace_back([&walk, i]() { walk.Run(i); });
+        }
+
+        walk.Run(0);
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (stats) {
+            *stats = walk.Stats();
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return NO_ERROR;
+    }
+}
@@ -0,0 +1,95 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/portable.inl"
+#include "include/libbase/files/memory_mapped_file.h"
+#include "include/libbase/modules/pe_parser.h"
+#include "include/libbase/modules/pe_file.h"
+
+
+namespace base::modules
+{
+    bool PEFile::Initialize(_In_ const std::filesystem::path& file_name)
+    {
+        Close();
+
+        if (!_File.Initialize(file_name)) {
+            return false;
+        }
+
+        const auto length = _File.Length();
+        const auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(_File.Data());
+
+        // Everything VerifyMagic and the section table accessors read has to
+        // be inside the file.
+        bool valid = length >= sizeof(IMAGE_DOS_HEADER) &&
+            dos_header->e_magic == IMAGE_DOS_SIGNATURE &&
+            dos_header->e_lfanew > 0 &&
+            static_cast<size_t>(dos_header->e_lfanew) + sizeof(IMAGE_NT_HEADERS) <= length;
+
+        if (valid) {
+            SetModule(reinterpret_cast<HMODULE>(const_cast<uint8_t*>(_File.Data())));
+
+            const auto section_table = static_cast<size_t>(dos_header->e_lfanew) + sizeof(IMAGE_NT_HEADERS);
+            valid = VerifyMagic() &&
+                section_table + GetNumSections() * sizeof(IMAGE_SECTION_HEADER) <= length;
+        }
+
+        if (!valid) {
+            Close();
+        }
+        return valid;
+    }
+
+    void PEFile::Close()
+    {
+        SetModule(nullptr);
+        _File.Close();
+    }
+
+    PVOID PEFile::RVAToAddr(_In_ size_t rva) const
+    {
+        if (rva == 0 || !_File.IsValid()) {
+            return nullptr;
+        }
+
+        size_t offset = 0;
+
+        // The headers sit at the same offsets in the file and in memory.
+        if (rva < GetNTHeaders()->OptionalHeader.SizeOfHeaders) {
+            offset = rva;
+        }
+        else {
+            // Don't use the virtual RVAToAddr.
+            PIMAGE_SECTION_HEADER section = GetImageSectionFromAddr(PEImage::RVAToAddr(rva));
+            if (section == nullptr) {
+                return nullptr;
+            }
+
+            // Past the raw data the section is zero-filled in memory and
+            // has nothing behind it in the file.
+            const size_t offset_within_section = rva - section->VirtualAddress;
+            if (offset_within_section >= section->SizeOfRawData) {
+                return nullptr;
+            }
+
+            offset = section->PointerToRawData + offset_within_section;
+        }
+
+        if (offset >= _File.Length()) {
+            return nullptr;
+        }
+        return const_cast<uint8_t*>(_File.Data()) + offset;
+    }
+
+    size_t PEFile::GetReadableSize(_In_ const void* address) const
+    {
+        const auto data = _File.Data();
+        const auto byte = static_cast<const uint8_t*>(address);
+        if (data == nullptr || byte < data || byte >= data + _File.Length()) {
+            return 0;
+        }
+        return static_cast<size_t>(data + _File.Length() - byte);
+    }
+}
@@ -0,0 +1,530 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/stdext.h"
+#   include "include/libbase/files/memory_mapped_file.h"
+#   include "include/libbase/modules/pe_view.h"
+#   include "include/libbase/modules/pe_metadata_cache.h"
+#   include <algorithm>
+#   include <cstring>
+#endif
+#include <fstream>
+
+
+namespace base::modules
+{
+    namespace
+    {
+        constexpr DWORD kStoreMagic   = 0x4D50534C; // "LSPM"
+        constexpr DWORD kStoreVersion = 1;
+
+        // The part of a file hashed into HeadersHash.
+        constexpr size_t kHeadersSize = 0x1000;
+
+        // The arrays follow the header in the order of its counts, then the
+        // strings.
+        struct FileHeader
+        {
+            DWORD    Magic;
+            DWORD    Version;
+            uint32_t NumberOfImages;
+            uint32_t NumberOfSections;
+            uint32_t NumberOfImportChunks;
+            uint32_t NumberOfImports;
+            uint32_t NumberOfExports;
+            uint32_t SizeOfStrings;
+        };
+
+        // Every array starts aligned for its records when the mapping is.
+        static_assert(sizeof(FileHeader) % 8 == 0);
+        static_assert(sizeof(PEMetadataCache::ImageRecord) % 8 == 0);
+        static_assert(sizeof(PEMetadataCache::SectionRecord) % 4 == 0);
+        static_assert(sizeof(PEMetadataCache::ImportChunkRecord) % 4 == 0);
+        static_assert(sizeof(PEMetadataCache::ImportRecord) % 4 == 0);
+        static_assert(sizeof(PEMetadataCache::ExportRecord) % 4 == 0);
+
+        // Paths are stored in UTF-8. Windows paths are UTF-16; elsewhere
+        // they are bytes, UTF-8 by convention, and stored as they are.
+        std::string PathToUtf8(const std::filesystem::path& path) {
+#ifdef _WIN32
+            return codepage::wcstombs(path.native());
+#else
+            return path.native();
+#endif
+        }
+
+        // FNV-1a.
+        uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        // Returns true if the run of count records at first is inside a
+        // table of size records.
+        bool IsRunInside(uint32_t first, uint32_t count, size_t size) {
+            return first <= size && count <= size - first;
+        }
+
+        // Fills the identity of a file (everything Find() compares but the
+        // path) from the file on disk.
+        bool ReadIdentity(const std::filesystem::path& file_name, PEMetadataCache::ImageRecord* key) {
+            std::error_code error;
+            const auto file_size = std::filesystem::file_size(file_name, error);
+            if (error) {
+                return false;
+            }
+
+            const auto last_write_time = std::filesystem::last_write_time(file_name, error);
+            if (error) {
+                return false;
+            }
+
+            const auto size = static_cast<size_t>(std::min<uintmax_t>(file_size, kHeadersSize));
+
+            char headers[kHeadersSize];
+            std::ifstream stream(file_name, std::ios::binary);
+            if (!stream.read(headers, static_cast<std::streamsize>(size))) {
+                return false;
+            }
+
+            key->FileSize      = file_size;
+            key->LastWriteTime = static_cast<int64_t>(last_write_time.time_since_epoch().count());
+            key->HeadersHash   = HashBytes(headers, size);
+            return true;
+        }
+    }  // namespace
+
+    PEMetadataCache::Table<PEMetadataCache::SectionRecord> PEMetadataCache::Image::Sections() const
+    {
+        return { _Tables->Sections.Data + _Record->FirstSection, _Record->NumberOfSections };
+    }
+
+    PEMetadataCache::Table<PEMetadataCache::ImportChunkRecord> PEMetadataCache::Image::ImportChunks() const
+    {
+        return { _Tables->ImportChunks.Data + _Record->FirstImportChunk, _Record->NumberOfImportChunks };
+    }
+
+    PEMetadataCache::Table<PEMetadataCache::ImportRecord> PEMetadataCache::Image::Imports(
+        _In_ const ImportChunkRecord& chunk
+    ) const {
+        // Chunks are checked here rather than in Find(), which would have to
+        // go through all of them.
+        if (!IsRunInside(chunk.FirstImport, chunk.NumberOfImports, _Tables->Imports.Size)) {
+            return {};
+        }
+        return { _Tables->Imports.Data + chunk.FirstImport, chunk.NumberOfImports };
+    }
+
+    PEMetadataCache::Table<PEMetadataCache::ExportRecord> PEMetadataCache::Image::Exports() const
+    {
+        return { _Tables->Exports.Data + _Record->FirstExport, _Record->NumberOfExports };
+    }
+
+    LPCSTR PEMetadataCache::Image::String(_In_ uint32_t offset) const
+    {
+        // The string table ends with a terminator, so any offset inside it
+        // is a terminated string.
+        if (offset >= _Tables->Strings.Size) {
+            return nullptr;
+        }
+        return _Tables->Strings.Data + offset;
+    }
+
+    uint32_t PEMetadataCache::Staged::AddString(_In_ std::string_view value)
+    {
+        const auto offset = static_cast<uint32_t>(Strings.size());
+        Strings.append(value);
+        Strings.push_back('\0');
+        return offset;
+    }
+
+    uint32_t PEMetadataCache::Staged::InternString(_In_ std::string_view value)
+    {
+        const auto result = Interned.try_emplace(std::string(value), 0);
+        if (result.second) {
+            result.first->second = AddString(value);
+        }
+        return result.first->second;
+    }
+
+    void PEMetadataCache::Staged::Append(_In_ const Tables& tables, _In_ const ImageRecord& image)
+    {
+        const auto copy_string = [this, &tables](uint32_t offset) {
+            return offset < tables.Strings.Size
+                ? InternString(tables.Strings.Data + offset)
+                : kNoString;
+        };
+
+        ImageRecord record = image;
+        record.Path = AddString(tables.Strings.Data + image.Path);
+
+        record.FirstSection = static_cast<uint32_t>(Sections.size());
+        Sections.insert(Sections.end(),
+            tables.Sections.Data + image.FirstSection,
+            tables.Sections.Data + image.FirstSection + image.NumberOfSections);
+
+        record.FirstImportChunk = static_cast<uint32_t>(ImportChunks.size());
+        record.NumberOfImportChunks = 0;
+        for (uint32_t i = 0; i < image.NumberOfImportChunks; ++i) {
+            const auto& chunk = tables.ImportChunks[image.FirstImportChunk + i];
+            if (!IsRunInside(chunk.FirstImport, chunk.NumberOfImports, tables.Imports.Size)) {
+                continue;
+            }
+
+            ImportChunkRecord copy = { copy_string(chunk.Module), static_cast<uint32_t>(Imports.size()), chunk.NumberOfImports };
+            for (uint32_t j = 0; j < chunk.NumberOfImports; ++j) {
+                ImportRecord import = tables.Imports[chunk.FirstImport + j];
+                import.Name = copy_string(import.Name);
+                Imports.push_back(import);
+            }
+
+            ImportChunks.push_back(copy);
+            ++record.NumberOfImportChunks;
+        }
+
+        record.FirstExport = static_cast<uint32_t>(Exports.size());
+        for (uint32_t i = 0; i < image.NumberOfExports; ++i) {
+            ExportRecord copy = tables.Exports[image.FirstExport + i];
+            copy.Name    = copy_string(copy.Name);
+            copy.Forward = copy_string(copy.Forward);
+            Exports.push_back(copy);
+        }
+
+        Images.push_back(record);
+    }
+
+    PEMetadataCache::Tables PEMetadataCache::Staged::View() const
+    {
+        Tables tables;
+        tables.Images       = { Images.data(), Images.size() };
+        tables.Sections     = { Sections.data(), Sections.size() };
+        tables.ImportChunks = { ImportChunks.data(), ImportChunks.size() };
+        tables.Imports      = { Imports.data(), Imports.size() };
+        tables.Exports      = { Exports.data(), Exports.size() };
+        tables.Strings      = { Strings.data(), Strings.size() };
+        return tables;
+    }
+
+    bool PEMetadataCache::IsInside(_In_ const Tables& tables, _In_ const ImageRecord& image)
+    {
+        return image.Path < tables.Strings.Size &&
+            IsRunInside(image.FirstSection, image.NumberOfSections, tables.Sections.Size) &&
+            IsRunInside(image.FirstImportChunk, image.NumberOfImportChunks, tables.ImportChunks.Size) &&
+            IsRunInside(image.FirstExport, image.NumberOfExports, tables.Exports.Size);
+    }
+
+    bool PEMetadataCache::Matches(
+        _In_ const Tables& tables,
+        _In_ const ImageRecord& record,
+        _In_ const ImageRecord& key,
+        _In_ std::string_view path
+    ) {
+        return record.PathHash      == key.PathHash      &&
+            record.FileSize         == key.FileSize      &&
+            record.LastWriteTime    == key.LastWriteTime &&
+            record.HeadersHash      == key.HeadersHash   &&
+            IsInside(tables, record) &&
+            path == tables.Strings.Data + record.Path;
+    }
+
+    bool PEMetadataCache::Load(_In_ const std::filesystem::path& file_name)
+    {
+        _Mapped = {};
+
+        if (!_File.Initialize(file_name)) {
+            return false;
+        }
+
+        auto close_file = stdext::scope_exit([this]() { _File.Close(); });
+
+        if (_File.Length() < sizeof(FileHeader)) {
+            return false;
+        }
+
+        const auto header = reinterpret_cast<const FileHeader*>(_File.Data());
+        if (header->Magic != kStoreMagic || header->Version != kStoreVersion) {
+            return false;
+        }
+
+        const uint64_t size = sizeof(FileHeader) +
+            uint64_t(header->NumberOfImages)       * sizeof(ImageRecord) +
+            uint64_t(header->NumberOfSections)     * sizeof(SectionRecord) +
+            uint64_t(header->NumberOfImportChunks) * sizeof(ImportChunkRecord) +
+            uint64_t(header->NumberOfImports)      * sizeof(ImportRecord) +
+            uint64_t(header->NumberOfExports)      * sizeof(ExportRecord) +
+            header->SizeOfStrings;
+        if (size != _File.Length()) {
+            return false;
+        }
+
+        auto data = reinterpret_cast<const uint8_t*>(header + 1);
+        const auto take = [&data](auto* table, uint32_t count) {
+            using Record = std::remove_reference_t<decltype(*table->Data)>;
+            table->Data = reinterpret_cast<const Record*>(data);
+            table->Size = count;
+            data += count * sizeof(Record);
+        };
+
+        Tables tables;
+        take(&tables.Images,       header->NumberOfImages);
+        take(&tables.Sections,     header->NumberOfSections);
+        take(&tables.ImportChunks, header->NumberOfImportChunks);
+        take(&tables.Imports,      header->NumberOfImports);
+        take(&tables.Exports,      header->NumberOfExports);
+        take(&tables.Strings,      header->SizeOfStrings);
+
+        if (tables.Strings.Size != 0 && tables.Strings[tables.Strings.Size - 1] != '\0') {
+            return false;
+        }
+
+        close_file.release();
+
+        _Mapped = tables;
+        return true;
+    }
+
+    bool PEMetadataCache::Add(_In_ const std::filesystem::path& file_name)
+    {
+        files::MemoryMappedFile file;
+        if (!file.Initialize(file_name)) {
+            return false;
+        }
+
+        const PEView view(file.Data(), file.Length(), PEView::Layout::File);
+        if (!view.IsValid()) {
+            return false;
+        }
+
+        std::error_code error;
+        const auto last_write_time = std::filesystem::last_write_time(file_name, error);
+        if (error) {
+            return false;
+        }
+
+        const auto path = PathToUtf8(file_name);
+        const IMAGE_FILE_HEADER* file_header = view.GetFileHeader();
+        const DWORD size_of_image = view.GetNTHeaders64()
+            ? view.GetNTHeaders64()->OptionalHeader.SizeOfImage
+            : view.GetNTHeaders32()->OptionalHeader.SizeOfImage;
+
+        auto& staged = _Staged;
+
+        ImageRecord image{};
+        image.PathHash      = HashBytes(path.data(), path.size());
+        image.FileSize      = file.Length();
+        image.LastWriteTime = static_cast<int64_t>(last_write_time.time_since_epoch().count());
+        image.HeadersHash   = HashBytes(file.Data(), std::min(file.Length(), kHeadersSize));
+        image.Path          = staged.AddString(path);
+        image.TimeDateStamp = file_header->TimeDateStamp;
+        image.SizeOfImage   = size_of_image;
+        image.Machine       = file_header->Machine;
+
+        image.FirstSection     = static_cast<uint32_t>(staged.Sections.size());
+        image.NumberOfSections = view.GetNumSections();
+        for (WORD i = 0; i < view.GetNumSections(); ++i) {
+            const IMAGE_SECTION_HEADER* section = view.GetSectionHeader(i);
+
+            SectionRecord record{};
+            memcpy(record.Name, section->Name, sizeof(record.Name));
+            record.VirtualAddress  = section->VirtualAddress;
+            record.VirtualSize     = section->Misc.VirtualSize;
+            record.SizeOfRawData   = section->SizeOfRawData;
+            record.Characteristics = section->Characteristics;
+            staged.Sections.push_back(record);
+        }
+
+        // A module's imports are enumerated together, so a chunk ends where
+        // the module string changes.
+        image.FirstImportChunk = static_cast<uint32_t>(staged.ImportChunks.size());
+
+        struct ImportContext
+        {
+            Staged*      Store;
+            ImageRecord* Record;
+            LPCSTR       Module;
+        };
+
+        ImportContext context = { &staged, &image, nullptr };
+        view.EnumImports([](const PEView&, LPCSTR module, DWORD ordinal, LPCSTR name,
+            DWORD hint, DWORD, PVOID cookie) -> bool
+        {
+            auto& context = *static_cast<ImportContext*>(cookie);
+            auto& staged  = *context.Store;
+
+            if (module != context.Module) {
+                staged.ImportChunks.push_back({ staged.InternString(module), static_cast<uint32_t>(staged.Imports.size()), 0 });
+                ++context.Record->NumberOfImportChunks;
+                context.Module = module;
+            }
+
+            ImportRecord record{};
+            record.Name    = name ? staged.InternString(name) : kNoString;
+            record.Ordinal = name ? 0 : static_cast<WORD>(ordinal);
+            record.Hint    = static_cast<WORD>(hint);
+            staged.Imports.push_back(record);
+
+            ++staged.ImportChunks.back().NumberOfImports;
+            return true;
+        }, &context);
+
+        image.FirstExport = static_cast<uint32_t>(staged.Exports.size());
+        view.EnumExports([](const PEView&, DWORD ordinal, DWORD, LPCSTR name,
+            DWORD function_rva, LPCSTR forward, PVOID cookie) -> bool
+        {
+            auto& staged = *static_cast<Staged*>(cookie);
+
+            ExportRecord record{};
+            record.Name        = name ? staged.InternString(name) : kNoString;
+            record.Ordinal     = ordinal;
+            record.FunctionRVA = function_rva;
+            record.Forward     = forward ? staged.InternString(forward) : kNoString;
+            staged.Exports.push_back(record);
+            return true;
+        }, &staged);
+        image.NumberOfExports = static_cast<uint32_t>(staged.Exports.size() - image.FirstExport);
+
+        view.EnumRelocs([](const PEView&, WORD type, DWORD, PVOID cookie) -> bool
+        {
+            if (type != IMAGE_REL_BASED_ABSOLUTE) {
+                ++*static_cast<uint32_t*>(cookie);
+            }
+            return true;
+        }, &image.NumberOfRelocations);
+
+        staged.Images.push_back(image);
+        _StagedView = staged.View();
+        return true;
+    }
+
+    bool PEMetadataCache::Save(_In_ const std::filesystem::path& file_name)
+    {
+        // Rebuild the store from the mapped images that were not staged
+        // again and the staged ones; the last staged image of a path wins.
+        std::unordered_map<std::string_view, size_t> latest;
+        for (size_t i = 0; i < _StagedView.Images.Size; ++i) {
+            latest[_StagedView.Strings.Data + _StagedView.Images[i].Path] = i;
+        }
+
+        Staged store;
+        for (const auto& image : _Mapped.Images) {
+            if (IsInside(_Mapped, image) && latest.count(_Mapped.Strings.Data + image.Path) == 0) {
+                store.Append(_Mapped, image);
+            }
+        }
+        for (size_t i = 0; i < _StagedView.Images.Size; ++i) {
+            const auto& image = _StagedView.Images[i];
+            if (latest[_StagedView.Strings.Data + image.Path] == i) {
+                store.Append(_StagedView, image);
+            }
+        }
+
+        std::stable_sort(store.Images.begin(), store.Images.end(), [](const ImageRecord& left, const ImageRecord& right) {
+            return left.PathHash < right.PathHash;
+        });
+
+        // The mapping may be the file that is about to be replaced.
+        _Mapped = {};
+        _File.Close();
+        _Staged = std::move(store);
+        _StagedView = _Staged.View();
+
+        auto temp_name = file_name;
+        temp_name += L".tmp";
+
+        {
+            std::ofstream stream(temp_name, std::ios::binary | std::ios::trunc);
+            if (!stream) {
+                return false;
+            }
+
+            FileHeader header{};
+            header.Magic                = kStoreMagic;
+            header.Version              = kStoreVersion;
+            header.NumberOfImages       = static_cast<uint32_t>(_Staged.Images.size());
+            header.NumberOfSections     = static_cast<uint32_t>(_Staged.Sections.size());
+            header.NumberOfImportChunks = static_cast<uint32_t>(_Staged.ImportChunks.size());
+            header.NumberOfImports      = static_cast<uint32_t>(_Staged.Imports.size());
+            header.NumberOfExports      = static_cast<uint32_t>(_Staged.Exports.size());
+            header.SizeOfStrings        = static_cast<uint32_t>(_Staged.Strings.size());
+
+            const auto write = [&stream](const auto& records) {
+                stream.write(reinterpret_cast<const char*>(records.data()),
+                    static_cast<std::streamsize>(records.size() * sizeof(records[0])));
+            };
+
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            write(_Staged.Images);
+            write(_Staged.Sections);
+            write(_Staged.ImportChunks);
+            write(_Staged.Imports);
+            write(_Staged.Exports);
+            write(_Staged.Strings);
+            if (!stream) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_name, file_name, error);
+        if (error) {
+            return false;
+        }
+
+        // Map the new store, so that Find() binary-searches it, and drop the
+        // staged copy. If it cannot be mapped, the staged copy still serves.
+        if (Load(file_name)) {
+            _Staged = {};
+            _StagedView = {};
+        }
+        return true;
+    }
+
+    bool PEMetadataCache::Find(_In_ const std::filesystem::path& file_name, _Out_ Image* image) const
+    {
+        *image = Image();
+
+        const auto path = PathToUtf8(file_name);
+
+        ImageRecord key{};
+        key.PathHash = HashBytes(path.data(), path.size());
+
+        // Staged images are few and unsorted; the latest is the one to use.
+        for (size_t i = _StagedView.Images.Size; i-- > 0;) {
+            const auto& record = _StagedView.Images[i];
+            if (record.PathHash == key.PathHash && path == _StagedView.Strings.Data + record.Path) {
+                if (!ReadIdentity(file_name, &key) || !Matches(_StagedView, record, key, path)) {
+                    return false;
+                }
+
+                image->_Tables = &_StagedView;
+                image->_Record = &record;
+                return true;
+            }
+        }
+
+        const auto range = std::equal_range(_Mapped.Images.begin(), _Mapped.Images.end(), key,
+            [](const ImageRecord& left, const ImageRecord& right) {
+                return left.PathHash < right.PathHash;
+            });
+        if (range.first == range.second || !ReadIdentity(file_name, &key)) {
+            return false;
+        }
+
+        for (auto record = range.first; record != range.second; ++record) {
+            if (Matches(_Mapped, *record, key, path)) {
+                image->_Tables = &_Mapped;
+                image->_Record = record;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -2,7 +2,11 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-#include "base/universal.inl"
+#include "base/portable.inl"
+#include "include/libbase/modules/pe_parser.h"
+
+#include <algorithm>
+#include <cstring>
 
 
 namespace base::modules
@@ -45,10 +49,86 @@ namespace base::modules
             unload_iat, storage.Cookie);
     }
 
+    // Returns the address of count records of type T at rva, or NULL unless
+    // all of them can be read.
+    template<typename T>
+    T* RVAToArray(const PEImage& image, size_t rva, size_t count) {
+        if (count > SIZE_MAX / sizeof(T)) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(image.RVAToAddr(rva, count * sizeof(T)));
+    }
+
+    // The sections with a non-zero size, sorted by address. Lookups are a
+    // binary search unless sections overlap, where the first one in the
+    // header order has to win and only a linear scan gives that.
+    struct PEImage::SectionTable {
+        struct Entry {
+            DWORD start;
+            DWORD size;
+            PIMAGE_SECTION_HEADER header;
+        };
+
+        std::vector<Entry> entries;
+        bool overlapping = false;
+    };
+
+    PEImage& PEImage::operator=(const PEImage& other) {
+        if (this != &other) {
+            SetModule(other._Module);
+        }
+        return *this;
+    }
+
+    PEImage::~PEImage() {
+        ResetSectionTable();
+    }
+
     void PEImage::SetModule(_In_ HMODULE module) {
+        ResetSectionTable();
         _Module = module;
     }
 
+    void PEImage::ResetSectionTable() {
+        delete _SectionTable.exchange(nullptr);
+    }
+
+    const PEImage::SectionTable* PEImage::GetSectionTable() const {
+        const SectionTable* table = _SectionTable.load(std::memory_order_acquire);
+        if (table != nullptr) {
+            return table;
+        }
+
+        auto built = std::make_unique<SectionTable>();
+
+        PIMAGE_SECTION_HEADER section = nullptr;
+        for (UINT i = 0; (section = GetSectionHeader(i)) != nullptr; i++) {
+            // Sections at RVA 0 have never matched an address.
+            if (section->VirtualAddress != 0 && section->Misc.VirtualSize != 0) {
+                built->entries.push_back({ section->VirtualAddress, section->Misc.VirtualSize, section });
+            }
+        }
+
+        std::stable_sort(built->entries.begin(), built->entries.end(),
+            [](const SectionTable::Entry& left, const SectionTable::Entry& right) {
+                return left.start < right.start;
+            });
+
+        for (size_t i = 1; i < built->entries.size(); i++) {
+            const auto& previous = built->entries[i - 1];
+            if (built->entries[i].start - previous.start < previous.size) {
+                built->overlapping = true;
+                break;
+            }
+        }
+
+        // Another thread may have built it meanwhile; keep the first.
+        if (_SectionTable.compare_exchange_strong(table, built.get(), std::memory_order_acq_rel)) {
+            return built.release();
+        }
+        return table;
+    }
+
     PIMAGE_DOS_HEADER PEImage::GetDosHeader() const {
         return reinterpret_cast<PIMAGE_DOS_HEADER>(_Module);
     }
@@ -87,18 +167,35 @@ namespace base::modules
 
     PIMAGE_SECTION_HEADER PEImage::GetImageSectionFromAddr(_In_ PVOID address) const {
         auto target = reinterpret_cast<PBYTE>(address);
-        PIMAGE_SECTION_HEADER section = nullptr;
+        auto base   = reinterpret_cast<PBYTE>(_Module);
 
-        for (UINT i = 0; (section = GetSectionHeader(i)) != nullptr; i++) {
-            // Don't use the virtual RVAToAddr.
-            auto start = reinterpret_cast<PBYTE>(PEImage::RVAToAddr(section->VirtualAddress));
-            DWORD size = section->Misc.VirtualSize;
+        if (target < base) {
+            return nullptr;
+        }
+        const size_t rva = target - base;
 
-            if ((start <= target) && (start + size > target))
-                return section;
+        const SectionTable* table = GetSectionTable();
+
+        if (table->overlapping) {
+            PIMAGE_SECTION_HEADER section = nullptr;
+            for (UINT i = 0; (section = GetSectionHeader(i)) != nullptr; i++) {
+                if (section->VirtualAddress != 0 && section->VirtualAddress <= rva &&
+                    rva - section->VirtualAddress < section->Misc.VirtualSize)
+                    return section;
+            }
+            return nullptr;
         }
 
-        return nullptr;
+        auto next = std::upper_bound(table->entries.begin(), table->entries.end(), rva,
+            [](size_t value, const SectionTable::Entry& entry) {
+                return value < entry.start;
+            });
+        if (next == table->entries.begin()) {
+            return nullptr;
+        }
+
+        const auto& entry = *(next - 1);
+        return (rva - entry.start < entry.size) ? entry.header : nullptr;
     }
 
     PIMAGE_SECTION_HEADER PEImage::GetImageSectionHeaderByName(_In_ LPCSTR section_name) const {
@@ -130,9 +227,12 @@ namespace base::modules
             return nullptr;
         }
 
-        auto functions = reinterpret_cast<PDWORD>(RVAToAddr(exports->AddressOfFunctions));
+        const DWORD index = ordinal - exports->Base;
+        if (index >= exports->NumberOfFunctions) {
+            return nullptr;
+        }
 
-        return functions + ordinal - exports->Base;
+        return RVAToArray<DWORD>(*this, exports->AddressOfFunctions + size_t(index) * sizeof(DWORD), 1);
     }
 
     FARPROC PEImage::GetProcAddress(_In_ LPCSTR function_name) const {
@@ -147,11 +247,15 @@ namespace base::modules
 
         // Check for forwarded exports as a special case.
         if (exports <= function && exports + size > function)
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4312)
+#endif
             // This cast generates a warning because it is 32 bit specific.
             return reinterpret_cast<FARPROC>(~0);
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
         return reinterpret_cast<FARPROC>(function);
     }
 
@@ -171,14 +275,19 @@ namespace base::modules
             *ordinal = ToOrdinal(function_name);
         }
         else {
-            PDWORD names = reinterpret_cast<PDWORD>(RVAToAddr(exports->AddressOfNames));
+            PDWORD names = RVAToArray<DWORD>(*this, exports->AddressOfNames, exports->NumberOfNames);
+            PWORD ordinals = RVAToArray<WORD>(*this, exports->AddressOfNameOrdinals, exports->NumberOfNames);
+            if (nullptr == names || nullptr == ordinals)
+                return false;
             PDWORD lower = names;
             PDWORD upper = names + exports->NumberOfNames;
             int cmp = -1;
             // Binary Search for the name.
             while (lower != upper) {
                 PDWORD middle = lower + (upper - lower) / 2;
-                LPCSTR name = reinterpret_cast<LPCSTR>(RVAToAddr(*middle));
+                LPCSTR name = RVAToString(*middle);
+                if (nullptr == name)
+                    return false;
                 // This may be called by sandbox before MSVCRT dll loads, so can't use
                 // CRT function here.
                 cmp = strcmp(function_name, name);
@@ -193,22 +302,14 @@ namespace base::modules
             }
             if (cmp != 0)
                 return false;
-            PWORD ordinals = reinterpret_cast<PWORD>(
-                RVAToAddr(exports->AddressOfNameOrdinals));
             *ordinal = ordinals[lower - names] + static_cast<WORD>(exports->Base);
         }
         return true;
     }
 
     bool PEImage::EnumSections(_In_ EnumSectionsFunction callback, _In_opt_ PVOID cookie) const {
-        auto nt_headers     = GetNTHeaders();
-        UINT num_sections   = nt_headers->FileHeader.NumberOfSections;
-        auto section        = GetSectionHeader(0);
-
-        for (UINT i = 0; i < num_sections; i++, section++) {
-            PVOID section_start = RVAToAddr(section->VirtualAddress);
-            DWORD size = section->Misc.VirtualSize;
-            if (!callback(*this, section, section_start, size, cookie)) {
+        for (const auto& entry : Sections()) {
+            if (!callback(*this, entry.header, entry.section_start, entry.section_size, cookie)) {
                 return false;
             }
         }
@@ -217,55 +318,93 @@ namespace base::modules
     }
 
     bool PEImage::EnumExports(_In_ EnumExportsFunction callback, _In_opt_ PVOID cookie) const {
-        PVOID directory = GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_EXPORT);
-        DWORD size = GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_EXPORT);
+        for (const auto& entry : Exports()) {
+            if (!callback(*this, entry.ordinal, entry.hint, entry.name, entry.function, entry.forward, cookie))
+                return false;
+        }
+
+        return true;
+    }
+
+    PEExportRange::PEExportRange(_In_ const PEImage& image)
+        : _Image(image) {
+        PIMAGE_EXPORT_DIRECTORY exports = image.GetExportDirectory();
+        DWORD size = image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_EXPORT);
         // Check if there are any exports at all.
-        if (nullptr == directory || 0 == size) {
-            return true;
+        if (nullptr == exports || 0 == size) {
+            return;
+        }
+
+        // Ordinals are 16 bits; anything past that is not reachable, and
+        // a larger count would only size the table from a hostile header.
+        const DWORD num_functions = std::min<DWORD>(exports->NumberOfFunctions, 0x10000);
+
+        // The tables have to lie inside the image before anything is
+        // allocated for them.
+        _Directory      = reinterpret_cast<char*>(exports);
+        _DirectorySize  = size;
+        _OrdinalBase    = exports->Base;
+        _Functions      = RVAToArray<DWORD>(image, exports->AddressOfFunctions, num_functions);
+        _Names          = RVAToArray<DWORD>(image, exports->AddressOfNames, exports->NumberOfNames);
+        auto ordinals   = RVAToArray<WORD >(image, exports->AddressOfNameOrdinals, exports->NumberOfNames);
+
+        if (nullptr == _Functions) {
+            return;
         }
+        _NumFunctions = num_functions;
 
-        auto exports        = reinterpret_cast<PIMAGE_EXPORT_DIRECTORY>(directory);
-        UINT ordinal_base   = exports->Base;
-        UINT num_funcs      = exports->NumberOfFunctions;
-        UINT num_names      = exports->NumberOfNames;
-        auto functions      = reinterpret_cast<PDWORD>(RVAToAddr(exports->AddressOfFunctions));
-        auto names          = reinterpret_cast<PDWORD>(RVAToAddr(exports->AddressOfNames));
-        auto ordinals       = reinterpret_cast<PWORD >(RVAToAddr(exports->AddressOfNameOrdinals));
+        if (_NumFunctions <= kInlineFunctions) {
+            _NameOf = _InlineNameOf;
+        }
+        else {
+            _HeapNameOf.reset(new DWORD[_NumFunctions]);
+            _NameOf = _HeapNameOf.get();
+        }
+        std::fill_n(_NameOf, _NumFunctions, kNoName);
 
-        for (UINT count = 0; count < num_funcs; count++) {
-            PVOID func = RVAToAddr(functions[count]);
+        if (nullptr == _Names || nullptr == ordinals) {
+            return;
+        }
+
+        // One pass over the name table instead of one per function. A
+        // function exported under several names keeps the first.
+        for (DWORD hint = 0; hint < exports->NumberOfNames; hint++) {
+            const WORD index = ordinals[hint];
+            if (index < _NumFunctions && _NameOf[index] == kNoName) {
+                _NameOf[index] = hint;
+            }
+        }
+    }
+
+    DWORD PEExportRange::Next(_In_ DWORD index, _Out_ PEImage::ExportEntry* entry) const {
+        for (; index < _NumFunctions; index++) {
+            PVOID func = _Image.RVAToAddr(_Functions[index]);
             if (nullptr == func) {
                 continue;
             }
 
             // Check for a name.
             LPCSTR name = nullptr;
-            UINT hint = 0;
-            for (hint = 0; hint < num_names; hint++) {
-                if (ordinals[hint] == count) {
-                    name = reinterpret_cast<LPCSTR>(RVAToAddr(names[hint]));
-                    break;
-                }
-            }
-
-            if (name == nullptr) {
-                hint = 0;
+            DWORD hint = 0;
+            if (_NameOf[index] != kNoName) {
+                name = _Image.RVAToString(_Names[_NameOf[index]]);
+                hint = name ? _NameOf[index] : 0;
             }
 
             // Check for forwarded exports.
             LPCSTR forward = nullptr;
-            if (reinterpret_cast<char*>(func) >= reinterpret_cast<char*>(directory) &&
-                reinterpret_cast<char*>(func) <= reinterpret_cast<char*>(directory) +
-                size) {
+            if (reinterpret_cast<char*>(func) >= _Directory &&
+                reinterpret_cast<char*>(func) <= _Directory + _DirectorySize) {
                 forward = reinterpret_cast<LPCSTR>(func);
+                forward = _Image.IsString(forward) ? forward : nullptr;
                 func = nullptr;
             }
 
-            if (!callback(*this, ordinal_base + count, hint, name, func, forward, cookie))
-                return false;
+            *entry = { _OrdinalBase + index, hint, name, func, forward };
+            break;
         }
 
-        return true;
+        return index;
     }
 
     bool PEImage::EnumRelocs(_In_ EnumRelocsFunction callback, _In_opt_ PVOID cookie) const {
@@ -277,7 +416,12 @@ namespace base::modules
             return true;
         }
 
-        while (base->SizeOfBlock) {
+        // Every block has to hold its header and be readable as a whole.
+        while (IsReadable(base, sizeof(IMAGE_BASE_RELOCATION)) && base->SizeOfBlock) {
+            if (base->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) || !IsReadable(base, base->SizeOfBlock)) {
+                break;
+            }
+
             PWORD reloc = reinterpret_cast<PWORD>(base + 1);
             UINT num_relocs = (base->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
 
@@ -304,10 +448,10 @@ namespace base::modules
             return true;
         }
 
-        for (; import->FirstThunk; import++) {
-            auto module_name    = reinterpret_cast<LPCSTR>(RVAToAddr(import->Name));
-            auto name_table     = reinterpret_cast<PIMAGE_THUNK_DATA>(RVAToAddr(import->OriginalFirstThunk));
-            auto iat            = reinterpret_cast<PIMAGE_THUNK_DATA>(RVAToAddr(import->FirstThunk));
+        for (; IsReadable(import, sizeof(*import)) && import->FirstThunk; import++) {
+            auto module_name    = RVAToString(import->Name);
+            auto name_table     = reinterpret_cast<PIMAGE_THUNK_DATA>(RVAToAddr(import->OriginalFirstThunk, sizeof(IMAGE_THUNK_DATA)));
+            auto iat            = reinterpret_cast<PIMAGE_THUNK_DATA>(RVAToAddr(import->FirstThunk, sizeof(IMAGE_THUNK_DATA)));
 
             if (!callback(*this, module_name, name_table, iat, cookie)) {
                 return false;
@@ -328,7 +472,7 @@ namespace base::modules
             return false;
         }
 
-        for (; name_table && name_table->u1.Ordinal; name_table++, iat++) {
+        for (; IsReadable(name_table, sizeof(*name_table)) && name_table->u1.Ordinal; name_table++, iat++) {
             LPCSTR name = nullptr;
             WORD ordinal = 0;
             WORD hint = 0;
@@ -337,7 +481,11 @@ namespace base::modules
                 ordinal = static_cast<WORD>(IMAGE_ORDINAL32(name_table->u1.Ordinal));
             }
             else {
-                auto import = reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(RVAToAddr(name_table->u1.ForwarderString));
+                auto import = reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(RVAToAddr(name_table->u1.ForwarderString, sizeof(WORD)));
+                // Skip an import whose name cannot be read.
+                if (nullptr == import || !IsString(reinterpret_cast<LPCSTR>(&import->Name))) {
+                    continue;
+                }
                 hint = import->Hint;
                 name = reinterpret_cast<LPCSTR>(&import->Name);
             }
@@ -363,7 +511,7 @@ namespace base::modules
             return true;
         }
 
-        for (; delay_descriptor->rvaHmod; delay_descriptor++) {
+        for (; IsReadable(delay_descriptor, sizeof(*delay_descriptor)) && delay_descriptor->rvaHmod; delay_descriptor++) {
             PIMAGE_THUNK_DATA name_table = nullptr;
             PIMAGE_THUNK_DATA iat        = nullptr;
             PIMAGE_THUNK_DATA bound_iat  = nullptr;     // address of the optional bound IAT
@@ -385,8 +533,10 @@ namespace base::modules
                     RVAToAddr(delay_descriptor->rvaUnloadIAT));
             }
             else {
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4312)
+#endif
                 // These casts generate warnings because they are 32 bit specific.
                 module_name = reinterpret_cast<LPCSTR>(delay_descriptor->rvaDLLName);
                 name_table = reinterpret_cast<PIMAGE_THUNK_DATA>(
@@ -396,7 +546,16 @@ namespace base::modules
                     delay_descriptor->rvaBoundIAT);
                 unload_iat = reinterpret_cast<PIMAGE_THUNK_DATA>(
                     delay_descriptor->rvaUnloadIAT);
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
+            }
+
+            if (!IsString(module_name)) {
+                module_name = nullptr;
+            }
+            if (!IsReadable(name_table, sizeof(*name_table))) {
+                name_table = nullptr;
             }
 
             if (!callback(*this, delay_descriptor, module_name, name_table, iat, bound_iat, unload_iat, cookie)) {
@@ -420,7 +579,7 @@ namespace base::modules
         UNREFERENCED_PARAMETER(bound_iat);
         UNREFERENCED_PARAMETER(unload_iat);
 
-        for (; name_table->u1.Ordinal; name_table++, iat++) {
+        for (; IsReadable(name_table, sizeof(*name_table)) && name_table->u1.Ordinal; name_table++, iat++) {
             LPCSTR name = nullptr;
             WORD ordinal = 0;
             WORD hint = 0;
@@ -435,12 +594,20 @@ namespace base::modules
                         RVAToAddr(name_table->u1.ForwarderString));
                 }
                 else {
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4312)
+#endif
                     // This cast generates a warning because it is 32 bit specific.
                     import = reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(
                         name_table->u1.ForwarderString);
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
+                }
+                // Skip an import whose name cannot be read.
+                if (!IsReadable(import, sizeof(WORD)) || !IsString(reinterpret_cast<LPCSTR>(&import->Name))) {
+                    continue;
                 }
                 hint = import->Hint;
                 name = reinterpret_cast<LPCSTR>(&import->Name);
@@ -474,7 +641,9 @@ namespace base::modules
     }
 
     bool PEImage::ImageRVAToOnDiskOffset(_In_ size_t rva, _Out_ DWORD* on_disk_offset) const {
-        LPVOID address = RVAToAddr(rva);
+        // Don't use the virtual RVAToAddr: for an image mapped as data it
+        // already returns the on-disk location.
+        LPVOID address = PEImage::RVAToAddr(rva);
         return ImageAddrToOnDiskOffset(address, on_disk_offset);
     }
 
@@ -489,13 +658,17 @@ namespace base::modules
         if (nullptr == section_header) {
             return false;
         }
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4311)
+#endif
         // These casts generate warnings because they are 32 bit specific.
         // Don't follow the virtual RVAToAddr, use the one on the base.
         size_t offset_within_section = reinterpret_cast<size_t>(address) -
             reinterpret_cast<size_t>(PEImage::RVAToAddr(section_header->VirtualAddress));
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
 
         * on_disk_offset = static_cast<DWORD>(section_header->PointerToRawData + offset_within_section);
         return true;
@@ -507,6 +680,34 @@ namespace base::modules
         return reinterpret_cast<char*>(_Module) + rva;
     }
 
+    PVOID PEImage::RVAToAddr(_In_ size_t rva, _In_ size_t size) const {
+        PVOID address = RVAToAddr(rva);
+        return IsReadable(address, size) ? address : nullptr;
+    }
+
+    LPCSTR PEImage::RVAToString(_In_ size_t rva) const {
+        auto string = reinterpret_cast<LPCSTR>(RVAToAddr(rva));
+        return IsString(string) ? string : nullptr;
+    }
+
+    bool PEImage::IsReadable(_In_opt_ const void* address, _In_ size_t size) const {
+        return address != nullptr && size <= GetReadableSize(address);
+    }
+
+    bool PEImage::IsString(_In_opt_ LPCSTR string) const {
+        if (string == nullptr) {
+            return false;
+        }
+
+        const size_t size = GetReadableSize(string);
+        return size == SIZE_MAX || memchr(string, 0, size) != nullptr;
+    }
+
+    size_t PEImage::GetReadableSize(_In_ const void* address) const {
+        UNREFERENCED_PARAMETER(address);
+        return SIZE_MAX;
+    }
+
     PVOID PEImageAsData::RVAToAddr(_In_ size_t rva) const {
         if (rva == 0) {
             return nullptr;
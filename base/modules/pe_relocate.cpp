@@ -0,0 +1,321 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+#include "include/libbase/modules/pe_parser.h"
+#include "include/libbase/modules/pe_relocate.h"
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#   define LIBBASE_RELOCATE_X86 1
+#   include <immintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define LIBBASE_TARGET_AVX2 __attribute__((target("avx2")))
+#   else
+#       define LIBBASE_TARGET_AVX2
+#   endif
+#endif
+
+
+namespace base::modules
+{
+    namespace
+    {
+        // Adds delta to count values of type T stored back to back at
+        // address, which need not be aligned.
+        template<typename T>
+        void AddScalar(PBYTE address, size_t count, T delta) {
+            for (size_t i = 0; i < count; i++, address += sizeof(T)) {
+                T value;
+                memcpy(&value, address, sizeof(value));
+                value += delta;
+                memcpy(address, &value, sizeof(value));
+            }
+        }
+
+#ifdef LIBBASE_RELOCATE_X86
+        template<typename T>
+        void AddSSE2(PBYTE address, size_t count, T delta) {
+            constexpr size_t lanes = 16 / sizeof(T);
+
+            const __m128i addend = (sizeof(T) == 8)
+                ? _mm_set1_epi64x(static_cast<long long>(delta))
+                : _mm_set1_epi32(static_cast<int>(delta));
+
+            size_t i = 0;
+            for (; i + lanes <= count; i += lanes, address += 16) {
+                const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(address));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(address),
+                    (sizeof(T) == 8) ? _mm_add_epi64(value, addend) : _mm_add_epi32(value, addend));
+            }
+
+            AddScalar<T>(address, count - i, delta);
+        }
+
+        template<typename T>
+        LIBBASE_TARGET_AVX2
+        void AddAVX2(PBYTE address, size_t count, T delta) {
+            constexpr size_t lanes = 32 / sizeof(T);
+
+            const __m256i addend = (sizeof(T) == 8)
+                ? _mm256_set1_epi64x(static_cast<long long>(delta))
+                : _mm256_set1_epi32(static_cast<int>(delta));
+
+            size_t i = 0;
+            for (; i + lanes <= count; i += lanes, address += 32) {
+                const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(address));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(address),
+                    (sizeof(T) == 8) ? _mm256_add_epi64(value, addend) : _mm256_add_epi32(value, addend));
+            }
+
+            AddScalar<T>(address, count - i, delta);
+        }
+#endif
+
+        struct Adders {
+            void (*add32)(PBYTE address, size_t count, DWORD delta);
+            void (*add64)(PBYTE address, size_t count, ULONGLONG delta);
+        };
+
+        Adders SelectAdders() {
+#ifdef LIBBASE_RELOCATE_X86
+            if (memory::IsSearchEngineSupported(memory::SearchEngine::AVX2)) {
+                return { AddAVX2<DWORD>, AddAVX2<ULONGLONG> };
+            }
+            return { AddSSE2<DWORD>, AddSSE2<ULONGLONG> };
+#else
+            return { AddScalar<DWORD>, AddScalar<ULONGLONG> };
+#endif
+        }
+
+        // Shorter runs, most of them single entries, are cheaper added in
+        // place than through the vector adders.
+        constexpr size_t kMinVectorRun = 4;
+
+        // Returns the number of entries from entry on that have type and
+        // name consecutive slots of width bytes.
+        size_t RunLength(PWORD entry, PWORD end, WORD type, size_t width) {
+            const WORD first = *entry;
+            size_t count = 1;
+            while (entry + count < end &&
+                entry[count] == static_cast<WORD>(first + count * width) &&
+                (entry[count] >> 12) == type) {
+                count++;
+            }
+            return count;
+        }
+
+        // The bytes written by each relocation type, 0 for those that write
+        // nothing and for those ApplyRelocations does not handle.
+        constexpr BYTE kWidths[16] = {
+            0,                  // IMAGE_REL_BASED_ABSOLUTE
+            sizeof(WORD),       // IMAGE_REL_BASED_HIGH
+            sizeof(WORD),       // IMAGE_REL_BASED_LOW
+            sizeof(DWORD),      // IMAGE_REL_BASED_HIGHLOW
+            sizeof(WORD),       // IMAGE_REL_BASED_HIGHADJ
+            0, 0, 0, 0, 0,
+            sizeof(ULONGLONG),  // IMAGE_REL_BASED_DIR64
+        };
+
+        // The relocation types ApplyRelocations handles, as a mask of 1 << type.
+        constexpr DWORD kSupportedTypes =
+            (1u << IMAGE_REL_BASED_ABSOLUTE) |
+            (1u << IMAGE_REL_BASED_HIGH)     |
+            (1u << IMAGE_REL_BASED_LOW)      |
+            (1u << IMAGE_REL_BASED_HIGHLOW)  |
+            (1u << IMAGE_REL_BASED_HIGHADJ)  |
+            (1u << IMAGE_REL_BASED_DIR64);
+
+        // Returns true if any entry in [entry, end) has a type other than
+        // ABSOLUTE, HIGH, LOW, HIGHLOW and DIR64, that is, a type of 4
+        // (HIGHADJ, whose next entry is not a relocation) or more, other
+        // than 10 (DIR64).
+        bool HasOtherTypes(PWORD entry, PWORD end) {
+            WORD other = 0;
+
+#ifdef LIBBASE_RELOCATE_X86
+            const __m128i highlow = _mm_set1_epi16(IMAGE_REL_BASED_HIGHLOW);
+            const __m128i dir64   = _mm_set1_epi16(IMAGE_REL_BASED_DIR64);
+
+            __m128i found = _mm_setzero_si128();
+            for (; end - entry >= 8; entry += 8) {
+                const __m128i type = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(entry)), 12);
+                found = _mm_or_si128(found,
+                    _mm_andnot_si128(_mm_cmpeq_epi16(type, dir64), _mm_cmpgt_epi16(type, highlow)));
+            }
+            other = static_cast<WORD>(_mm_movemask_epi8(found));
+#endif
+
+            for (; entry < end; entry++) {
+                const WORD type = *entry >> 12;
+                other |= (type > IMAGE_REL_BASED_HIGHLOW && type != IMAGE_REL_BASED_DIR64) ? 1 : 0;
+            }
+            return other != 0;
+        }
+
+        // Checks the blocks and their entries against the image before
+        // anything is written.
+        DWORD ValidateRelocations(PBYTE directory, DWORD directory_size, DWORD image_size) {
+            PBYTE end = directory + directory_size;
+
+            for (PBYTE block = directory; end - block >= static_cast<ptrdiff_t>(sizeof(IMAGE_BASE_RELOCATION));) {
+                auto header = reinterpret_cast<PIMAGE_BASE_RELOCATION>(block);
+                if (header->SizeOfBlock == 0) {
+                    break;
+                }
+
+                if (header->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) ||
+                    header->SizeOfBlock > static_cast<size_t>(end - block) ||
+                    header->VirtualAddress >= image_size) {
+                    return ERROR_BAD_EXE_FORMAT;
+                }
+
+                auto entry       = reinterpret_cast<PWORD>(header + 1);
+                auto entries_end = reinterpret_cast<PWORD>(block + (header->SizeOfBlock & ~1u));
+
+                // Most blocks cover a page well inside the image, and then
+                // no offset can reach past it; unless a block also has
+                // entries other than ABSOLUTE, HIGH, LOW, HIGHLOW and DIR64
+                // only its types need checking, which is done in bulk.
+                const bool whole_page = static_cast<ULONGLONG>(header->VirtualAddress) + 0x1000 + sizeof(ULONGLONG) <= image_size;
+                if (whole_page && !HasOtherTypes(entry, entries_end)) {
+                    block += header->SizeOfBlock;
+                    continue;
+                }
+
+                for (; entry < entries_end; entry++) {
+                    const WORD type   = *entry >> 12;
+                    const WORD offset = *entry & 0x0FFF;
+                    if ((kSupportedTypes & (1u << type)) == 0) {
+                        return ERROR_NOT_SUPPORTED;
+                    }
+
+                    if (kWidths[type] != 0 &&
+                        static_cast<ULONGLONG>(header->VirtualAddress) + offset + kWidths[type] > image_size) {
+                        return ERROR_BAD_EXE_FORMAT;
+                    }
+
+                    // The low half of a HIGHADJ target follows as the next entry.
+                    if (type == IMAGE_REL_BASED_HIGHADJ && ++entry == entries_end) {
+                        return ERROR_BAD_EXE_FORMAT;
+                    }
+                }
+
+                block += header->SizeOfBlock;
+            }
+
+            return NO_ERROR;
+        }
+    }  // namespace
+
+    DWORD ApplyRelocations(
+        _In_ const PEImage& image,
+        _In_ ULONGLONG new_base
+    ) {
+        if (image.Module() == nullptr || !image.VerifyMagic()) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        PIMAGE_NT_HEADERS nt_headers = image.GetNTHeaders();
+        const ULONGLONG delta = new_base - nt_headers->OptionalHeader.ImageBase;
+        if (delta == 0) {
+            return NO_ERROR;
+        }
+
+        if (nt_headers->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED) {
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        auto  directory      = reinterpret_cast<PBYTE>(image.GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_BASERELOC));
+        DWORD directory_size = image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_BASERELOC);
+        DWORD image_size     = nt_headers->OptionalHeader.SizeOfImage;
+
+        if (directory != nullptr && directory_size != 0) {
+            if (static_cast<ULONGLONG>(nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress) +
+                directory_size > image_size) {
+                return ERROR_BAD_EXE_FORMAT;
+            }
+
+            DWORD error = ValidateRelocations(directory, directory_size, image_size);
+            if (error != NO_ERROR) {
+                return error;
+            }
+
+            const Adders adders = SelectAdders();
+            const auto delta32 = static_cast<DWORD>(delta);
+            const auto base = reinterpret_cast<PBYTE>(image.Module());
+
+            PBYTE end = directory + directory_size;
+            for (PBYTE block = directory; end - block >= static_cast<ptrdiff_t>(sizeof(IMAGE_BASE_RELOCATION));) {
+                auto header = reinterpret_cast<PIMAGE_BASE_RELOCATION>(block);
+                if (header->SizeOfBlock == 0) {
+                    break;
+                }
+
+                PBYTE page = base + header->VirtualAddress;
+                auto entry       = reinterpret_cast<PWORD>(header + 1);
+                auto entries_end = reinterpret_cast<PWORD>(block + (header->SizeOfBlock & ~1u));
+
+                while (entry < entries_end) {
+                    PBYTE target = page + (*entry & 0x0FFF);
+
+                    switch (*entry >> 12) {
+                    case IMAGE_REL_BASED_DIR64: {
+                        const size_t count = RunLength(entry, entries_end, IMAGE_REL_BASED_DIR64, sizeof(ULONGLONG));
+                        if (count < kMinVectorRun) {
+                            AddScalar<ULONGLONG>(target, count, delta);
+                        }
+                        else {
+                            adders.add64(target, count, delta);
+                        }
+                        entry += count;
+                        break;
+                    }
+                    case IMAGE_REL_BASED_HIGHLOW: {
+                        const size_t count = RunLength(entry, entries_end, IMAGE_REL_BASED_HIGHLOW, sizeof(DWORD));
+                        if (count < kMinVectorRun) {
+                            AddScalar<DWORD>(target, count, delta32);
+                        }
+                        else {
+                            adders.add32(target, count, delta32);
+                        }
+                        entry += count;
+                        break;
+                    }
+                    case IMAGE_REL_BASED_HIGH:
+                        AddScalar<WORD>(target, 1, HIWORD(delta32));
+                        entry++;
+                        break;
+                    case IMAGE_REL_BASED_LOW:
+                        AddScalar<WORD>(target, 1, LOWORD(delta32));
+                        entry++;
+                        break;
+                    case IMAGE_REL_BASED_HIGHADJ: {
+                        // The high half of a 32-bit value whose low half is
+                        // the next entry, rounded.
+                        WORD high = 0;
+                        memcpy(&high, target, sizeof(high));
+                        DWORD value = (static_cast<DWORD>(high) << 16) + static_cast<DWORD>(static_cast<SHORT>(entry[1]));
+                        value += delta32 + 0x8000;
+                        high = static_cast<WORD>(value >> 16);
+                        memcpy(target, &high, sizeof(high));
+                        entry += 2;
+                        break;
+                    }
+                    default:
+                        // IMAGE_REL_BASED_ABSOLUTE: padding.
+                        entry++;
+                        break;
+                    }
+                }
+
+                block += header->SizeOfBlock;
+            }
+        }
+
+        nt_headers->OptionalHeader.ImageBase = static_cast<decltype(nt_headers->OptionalHeader.ImageBase)>(new_base);
+        return NO_ERROR;
+    }
+}
@@ -0,0 +1,75 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+#include "include/libbase/modules/pe_parser.h"
+#include "include/libbase/modules/pe_search.h"
+
+
+namespace base::modules
+{
+    namespace
+    {
+        // MemorySearch guards the scan with SEH on Windows. Elsewhere there is
+        // no SEH: the sections were checked with IsReadable, so search them
+        // directly.
+        PBYTE SearchSection(_In_ PVOID address, _In_ DWORD size, _In_ const memory::BytePattern& pattern)
+        {
+#ifdef _WIN32
+            return static_cast<PBYTE>(memory::MemorySearch(address, size, pattern));
+#else
+            const auto first = static_cast<const uint8_t*>(address);
+            return const_cast<PBYTE>(pattern.Find(first, first + size));
+#endif
+        }
+    }
+
+    bool SearchImageSections(
+        _In_ const PEImage& image,
+        _In_ const memory::BytePattern& pattern,
+        _Out_ SectionMatch* match,
+        _In_opt_ DWORD characteristics
+    ) {
+        if (match == nullptr) {
+            return false;
+        }
+
+        *match = {};
+
+        if (!pattern.IsValid() || image.Module() == nullptr) {
+            return false;
+        }
+
+        for (const auto& entry : image.Sections()) {
+            PIMAGE_SECTION_HEADER header = entry.header;
+            if ((header->Characteristics & characteristics) != characteristics ||
+                entry.section_start == nullptr) {
+                continue;
+            }
+
+            // Past SizeOfRawData the section is zero-filled in memory and absent
+            // from the file.
+            DWORD size = entry.section_size ? entry.section_size : header->SizeOfRawData;
+            if (header->SizeOfRawData < size) {
+                size = header->SizeOfRawData;
+            }
+
+            // A section cut short by the end of a truncated file.
+            if (!image.IsReadable(entry.section_start, size)) {
+                continue;
+            }
+
+            auto hit = SearchSection(entry.section_start, size, pattern);
+            if (hit != nullptr) {
+                match->Rva = header->VirtualAddress +
+                    static_cast<DWORD>(hit - static_cast<PBYTE>(entry.section_start));
+                match->Section = header;
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,384 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/portable.inl"
+#include "include/libbase/modules/pe_view.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace base::modules
+{
+    PEView::PEView(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_opt_ Layout layout)
+        : _Data(static_cast<const uint8_t*>(data))
+        , _Size(data ? size : 0)
+        , _Layout(layout)
+    {
+        _Valid = ValidateHeaders();
+        if (!_Valid) {
+            _NTHeaders32 = nullptr;
+            _NTHeaders64 = nullptr;
+            _FileHeader = nullptr;
+            _DataDirectory = nullptr;
+            _SectionHeaders = nullptr;
+            _Sections.clear();
+            return;
+        }
+
+        const auto num_directories = std::min<DWORD>(_NumberOfRvaAndSizes, IMAGE_NUMBEROF_DIRECTORY_ENTRIES);
+
+        for (DWORD i = 0; i < num_directories; ++i) {
+            const auto& entry = _DataDirectory[i];
+            if (entry.VirtualAddress == 0 || entry.Size == 0) {
+                continue;
+            }
+
+            const uint8_t* address = nullptr;
+            if (i == IMAGE_DIRECTORY_ENTRY_SECURITY) {
+                // A file offset, and the loader does not map it.
+                if (_Layout == Layout::File &&
+                    static_cast<uint64_t>(entry.VirtualAddress) + entry.Size <= _Size) {
+                    address = _Data + entry.VirtualAddress;
+                }
+            }
+            else {
+                address = RVAToAddr(entry.VirtualAddress, entry.Size);
+            }
+
+            if (address) {
+                _Directories[i] = { address, entry.Size };
+            }
+        }
+
+        ValidateExports();
+    }
+
+    bool PEView::ValidateHeaders()
+    {
+        if (_Size < sizeof(IMAGE_DOS_HEADER)) {
+            return false;
+        }
+
+        const auto dos_header = reinterpret_cast<const IMAGE_DOS_HEADER*>(_Data);
+        if (dos_header->e_magic != IMAGE_DOS_SIGNATURE || dos_header->e_lfanew <= 0) {
+            return false;
+        }
+
+        // The signature, the file header and the magic of the optional
+        // header are at the same offsets in PE32 and PE32+ files.
+        const auto nt_offset = static_cast<size_t>(dos_header->e_lfanew);
+        if (nt_offset > _Size || _Size - nt_offset < sizeof(IMAGE_NT_HEADERS32)) {
+            return false;
+        }
+
+        const auto nt_headers = reinterpret_cast<const IMAGE_NT_HEADERS32*>(_Data + nt_offset);
+        if (nt_headers->Signature != IMAGE_NT_SIGNATURE) {
+            return false;
+        }
+
+        size_t headers_size = 0;
+        if (nt_headers->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC &&
+            nt_headers->FileHeader.SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER32)) {
+            _NTHeaders32         = nt_headers;
+            _DataDirectory       = _NTHeaders32->OptionalHeader.DataDirectory;
+            _NumberOfRvaAndSizes = _NTHeaders32->OptionalHeader.NumberOfRvaAndSizes;
+            _SizeOfHeaders       = _NTHeaders32->OptionalHeader.SizeOfHeaders;
+            headers_size         = sizeof(IMAGE_NT_HEADERS32);
+        }
+        else if (nt_headers->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC &&
+            nt_headers->FileHeader.SizeOfOptionalHeader == sizeof(IMAGE_OPTIONAL_HEADER64) &&
+            _Size - nt_offset >= sizeof(IMAGE_NT_HEADERS64)) {
+            _NTHeaders64         = reinterpret_cast<const IMAGE_NT_HEADERS64*>(nt_headers);
+            _DataDirectory       = _NTHeaders64->OptionalHeader.DataDirectory;
+            _NumberOfRvaAndSizes = _NTHeaders64->OptionalHeader.NumberOfRvaAndSizes;
+            _SizeOfHeaders       = _NTHeaders64->OptionalHeader.SizeOfHeaders;
+            headers_size         = sizeof(IMAGE_NT_HEADERS64);
+        }
+        else {
+            return false;
+        }
+
+        _FileHeader = &nt_headers->FileHeader;
+
+        const auto num_sections = _FileHeader->NumberOfSections;
+        const auto table_offset = nt_offset + headers_size;
+        if (_Size - table_offset < num_sections * sizeof(IMAGE_SECTION_HEADER)) {
+            return false;
+        }
+
+        _SectionHeaders = reinterpret_cast<const IMAGE_SECTION_HEADER*>(_Data + table_offset);
+
+        // Clip each section to the buffer once, so translating an RVA of a
+        // file is a lookup and a compare.
+        _Sections.reserve(num_sections);
+        for (WORD i = 0; i < num_sections; ++i) {
+            const auto& header = _SectionHeaders[i];
+
+            Section section{};
+            section.VirtualAddress = header.VirtualAddress;
+            if (header.PointerToRawData < _Size) {
+                section.RawOffset = header.PointerToRawData;
+                section.RawSize   = std::min<DWORD>(header.SizeOfRawData,
+                    static_cast<DWORD>(std::min<uint64_t>(_Size - header.PointerToRawData, MAXDWORD)));
+            }
+            _Sections.push_back(section);
+        }
+
+        std::stable_sort(_Sections.begin(), _Sections.end(), [](const Section& left, const Section& right)
+        {
+            return left.VirtualAddress < right.VirtualAddress;
+        });
+
+        return true;
+    }
+
+    void PEView::ValidateExports()
+    {
+        const auto directory = _Directories[IMAGE_DIRECTORY_ENTRY_EXPORT];
+        if (directory.Size < sizeof(IMAGE_EXPORT_DIRECTORY)) {
+            return;
+        }
+
+        const auto exports = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(directory.Data);
+
+        // The counts come from the file; compute the sizes without overflow.
+        const auto functions = RVAToAddr(exports->AddressOfFunctions,
+            static_cast<size_t>(std::min<uint64_t>(exports->NumberOfFunctions * uint64_t(sizeof(DWORD)), SIZE_MAX)));
+        const auto names = RVAToAddr(exports->AddressOfNames,
+            static_cast<size_t>(std::min<uint64_t>(exports->NumberOfNames * uint64_t(sizeof(DWORD)), SIZE_MAX)));
+        const auto ordinals = RVAToAddr(exports->AddressOfNameOrdinals,
+            static_cast<size_t>(std::min<uint64_t>(exports->NumberOfNames * uint64_t(sizeof(WORD)), SIZE_MAX)));
+
+        if (exports->NumberOfFunctions == 0 || functions == nullptr) {
+            return;
+        }
+
+        _Exports = exports;
+        _ExportFunctions = reinterpret_cast<const DWORD*>(functions);
+
+        // Without valid name tables the exports are still usable by ordinal.
+        if (exports->NumberOfNames != 0 && names && ordinals) {
+            _ExportNames    = reinterpret_cast<const DWORD*>(names);
+            _ExportOrdinals = reinterpret_cast<const WORD*>(ordinals);
+        }
+    }
+
+    const uint8_t* PEView::Translate(_In_ DWORD rva, _Out_ size_t* available) const
+    {
+        *available = 0;
+        if (!_Valid) {
+            return nullptr;
+        }
+
+        if (_Layout == Layout::Image) {
+            if (rva >= _Size) {
+                return nullptr;
+            }
+            *available = _Size - rva;
+            return _Data + rva;
+        }
+
+        // The headers sit at the same offsets in the file and in memory.
+        const auto headers_size = std::min<uint64_t>(_SizeOfHeaders, _Size);
+        if (rva < headers_size) {
+            *available = static_cast<size_t>(headers_size - rva);
+            return _Data + rva;
+        }
+
+        auto section = std::upper_bound(_Sections.begin(), _Sections.end(), rva, [](DWORD value, const Section& item)
+        {
+            return value < item.VirtualAddress;
+        });
+        if (section == _Sections.begin()) {
+            return nullptr;
+        }
+        --section;
+
+        // Past the raw data the section is zero-filled in memory and has
+        // nothing behind it in the file.
+        const auto offset_within_section = rva - section->VirtualAddress;
+        if (offset_within_section >= section->RawSize) {
+            return nullptr;
+        }
+
+        *available = section->RawSize - offset_within_section;
+        return _Data + section->RawOffset + offset_within_section;
+    }
+
+    const uint8_t* PEView::RVAToAddr(_In_ DWORD rva, _In_opt_ size_t size) const
+    {
+        size_t available = 0;
+        const auto address = Translate(rva, &available);
+        return size <= available ? address : nullptr;
+    }
+
+    LPCSTR PEView::RVAToString(_In_ DWORD rva) const
+    {
+        // The string may run to the end of the section, but no further.
+        size_t available = 0;
+        const auto address = Translate(rva, &available);
+        if (address == nullptr || memchr(address, '\0', available) == nullptr) {
+            return nullptr;
+        }
+        return reinterpret_cast<LPCSTR>(address);
+    }
+
+    bool PEView::EnumExports(_In_ EnumExportsFunction callback, _In_opt_ PVOID cookie) const
+    {
+        if (_Exports == nullptr) {
+            return true;
+        }
+
+        const auto num_funcs = _Exports->NumberOfFunctions;
+        const auto num_names = _ExportNames ? _Exports->NumberOfNames : 0;
+
+        // Map each function to its first name once, instead of searching the
+        // name table per function.
+        constexpr DWORD kNoName = MAXDWORD;
+        std::vector<DWORD> name_of(num_funcs, kNoName);
+        for (DWORD hint = 0; hint < num_names; ++hint) {
+            const auto index = _ExportOrdinals[hint];
+            if (index < num_funcs && name_of[index] == kNoName) {
+                name_of[index] = hint;
+            }
+        }
+
+        const auto& directory = _DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+
+        for (DWORD count = 0; count < num_funcs; ++count) {
+            DWORD function_rva = _ExportFunctions[count];
+            if (function_rva == 0) {
+                continue;
+            }
+
+            LPCSTR name = nullptr;
+            DWORD  hint = 0;
+            if (name_of[count] != kNoName) {
+                name = RVAToString(_ExportNames[name_of[count]]);
+                hint = name ? name_of[count] : 0;
+            }
+
+            // Forwarded exports point into the export directory.
+            LPCSTR forward = nullptr;
+            if (function_rva >= directory.VirtualAddress &&
+                function_rva - directory.VirtualAddress < directory.Size) {
+                forward = RVAToString(function_rva);
+                function_rva = 0;
+                if (forward == nullptr) {
+                    continue;
+                }
+            }
+
+            if (!callback(*this, _Exports->Base + count, hint, name, function_rva, forward, cookie)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool PEView::EnumImports(_In_ EnumImportsFunction callback, _In_opt_ PVOID cookie) const
+    {
+        if (_Directories[IMAGE_DIRECTORY_ENTRY_IMPORT].Size < sizeof(IMAGE_IMPORT_DESCRIPTOR)) {
+            return true;
+        }
+
+        const auto& directory = _DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+
+        // Thunks are pointer sized: 4 bytes in PE32 files, 8 in PE32+.
+        const DWORD thunk_size = _NTHeaders64 ? sizeof(IMAGE_THUNK_DATA64) : sizeof(IMAGE_THUNK_DATA32);
+        const ULONGLONG ordinal_flag = _NTHeaders64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32;
+
+        // The table ends with a null descriptor, which may lie past the
+        // declared size; each descriptor is checked on its own.
+        for (DWORD descriptor_rva = directory.VirtualAddress;; descriptor_rva += sizeof(IMAGE_IMPORT_DESCRIPTOR)) {
+            const auto import = reinterpret_cast<const IMAGE_IMPORT_DESCRIPTOR*>(
+                RVAToAddr(descriptor_rva, sizeof(IMAGE_IMPORT_DESCRIPTOR)));
+            if (import == nullptr || import->FirstThunk == 0) {
+                break;
+            }
+
+            const auto module_name = RVAToString(import->Name);
+            if (module_name == nullptr) {
+                continue;
+            }
+
+            // Bound images overwrite the IAT; prefer the name table.
+            const DWORD name_table_rva = import->OriginalFirstThunk ? import->OriginalFirstThunk : import->FirstThunk;
+
+            for (DWORD index = 0;; ++index) {
+                const auto thunk_data = RVAToAddr(name_table_rva + index * thunk_size, thunk_size);
+                if (thunk_data == nullptr) {
+                    break;
+                }
+
+                ULONGLONG thunk = 0;
+                memcpy(&thunk, thunk_data, thunk_size);
+                if (thunk == 0) {
+                    break;
+                }
+
+                LPCSTR name = nullptr;
+                DWORD  ordinal = 0;
+                DWORD  hint = 0;
+
+                if (thunk & ordinal_flag) {
+                    ordinal = static_cast<WORD>(thunk);
+                }
+                else {
+                    const auto by_name_rva = static_cast<DWORD>(thunk);
+                    const auto by_name = reinterpret_cast<const IMAGE_IMPORT_BY_NAME*>(
+                        RVAToAddr(by_name_rva, sizeof(WORD)));
+                    name = RVAToString(by_name_rva + offsetof(IMAGE_IMPORT_BY_NAME, Name));
+                    if (by_name == nullptr || name == nullptr) {
+                        continue;
+                    }
+                    hint = by_name->Hint;
+                }
+
+                const DWORD iat_rva = import->FirstThunk + index * thunk_size;
+                if (!callback(*this, module_name, ordinal, name, hint, iat_rva, cookie)) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool PEView::EnumRelocs(_In_ EnumRelocsFunction callback, _In_opt_ PVOID cookie) const
+    {
+        const auto directory = _Directories[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+
+        size_t offset = 0;
+        while (directory.Size - offset >= sizeof(IMAGE_BASE_RELOCATION)) {
+            IMAGE_BASE_RELOCATION block{};
+            memcpy(&block, directory.Data + offset, sizeof(block));
+
+            // A block must hold its header and fit in the directory.
+            if (block.SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) ||
+                block.SizeOfBlock > directory.Size - offset) {
+                break;
+            }
+
+            const auto relocs = directory.Data + offset + sizeof(IMAGE_BASE_RELOCATION);
+            const auto num_relocs = (block.SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+
+            for (size_t i = 0; i < num_relocs; ++i) {
+                WORD reloc = 0;
+                memcpy(&reloc, relocs + i * sizeof(WORD), sizeof(reloc));
+
+                const WORD type = reloc >> 12;
+                if (!callback(*this, type, block.VirtualAddress + (reloc & 0x0FFF), cookie)) {
+                    return false;
+                }
+            }
+
+            offset += block.SizeOfBlock;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,206 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "base/universal.inl"
+#include <fstream>
+
+
+namespace base::modules
+{
+    namespace
+    {
+        constexpr DWORD kCacheMagic   = 0x4347534C; // "LSGC"
+        constexpr DWORD kCacheVersion = 1;
+
+        // FNV-1a.
+        uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        // Hashes the parts of the headers that identify the build. ImageBase
+        // is left out because the loader rewrites it on relocation.
+        uint64_t HashHeaders(const PEImage& image) {
+            PIMAGE_NT_HEADERS nt_headers = image.GetNTHeaders();
+
+            uint64_t hash = HashBytes(&nt_headers->FileHeader, sizeof(nt_headers->FileHeader));
+            hash = HashBytes(&nt_headers->OptionalHeader.AddressOfEntryPoint,
+                sizeof(nt_headers->OptionalHeader.AddressOfEntryPoint), hash);
+            hash = HashBytes(&nt_headers->OptionalHeader.SizeOfCode,
+                sizeof(nt_headers->OptionalHeader.SizeOfCode), hash);
+            hash = HashBytes(&nt_headers->OptionalHeader.CheckSum,
+                sizeof(nt_headers->OptionalHeader.CheckSum), hash);
+            hash = HashBytes(image.GetSectionHeader(0),
+                sizeof(IMAGE_SECTION_HEADER) * image.GetNumSections(), hash);
+            return hash;
+        }
+    }  // namespace
+
+    bool SignatureCache::RecordLess(const Record& left, const Record& right)
+    {
+        return left.PatternHash != right.PatternHash
+            ? left.PatternHash < right.PatternHash
+            : left.Characteristics < right.Characteristics;
+    }
+
+    SignatureCache::SignatureCache(_In_ const PEImage& image)
+        : _Image(image)
+    {
+        PIMAGE_NT_HEADERS nt_headers = image.GetNTHeaders();
+
+        _Identity.Magic         = kCacheMagic;
+        _Identity.Version       = kCacheVersion;
+        _Identity.TimeDateStamp = nt_headers->FileHeader.TimeDateStamp;
+        _Identity.SizeOfImage   = nt_headers->OptionalHeader.SizeOfImage;
+        _Identity.HeadersHash   = HashHeaders(image);
+    }
+
+    bool SignatureCache::Load(_In_ const std::filesystem::path& file_name)
+    {
+        _Records = nullptr;
+        _NumberOfRecords = 0;
+
+        if (!_File.Initialize(file_name)) {
+            return false;
+        }
+
+        if (_File.Length() < sizeof(FileHeader)) {
+            _File.Close();
+            return false;
+        }
+
+        const auto header = reinterpret_cast<const FileHeader*>(_File.Data());
+        if (header->Magic         != _Identity.Magic         ||
+            header->Version       != _Identity.Version       ||
+            header->TimeDateStamp != _Identity.TimeDateStamp ||
+            header->SizeOfImage   != _Identity.SizeOfImage   ||
+            header->HeadersHash   != _Identity.HeadersHash   ||
+            header->NumberOfRecords > (_File.Length() - sizeof(FileHeader)) / sizeof(Record)) {
+            _File.Close();
+            return false;
+        }
+
+        _Records = reinterpret_cast<const Record*>(header + 1);
+        _NumberOfRecords = static_cast<size_t>(header->NumberOfRecords);
+        return true;
+    }
+
+    bool SignatureCache::Save(_In_ const std::filesystem::path& file_name)
+    {
+        // Merge the mapped records with the resolved ones; resolved win.
+        std::vector<Record> records;
+        records.reserve(_NumberOfRecords + _Resolved.size());
+
+        std::merge(_Resolved.begin(), _Resolved.end(), _Records, _Records + _NumberOfRecords,
+            std::back_inserter(records), RecordLess);
+        records.erase(std::unique(records.begin(), records.end(), [](const Record& left, const Record& right) {
+            return !RecordLess(left, right) && !RecordLess(right, left);
+        }), records.end());
+
+        // The mapping may be the file that is about to be replaced.
+        _Records = nullptr;
+        _NumberOfRecords = 0;
+        _File.Close();
+        _Resolved = records;
+
+        auto temp_name = file_name;
+        temp_name += L".tmp";
+
+        {
+            std::ofstream stream(temp_name, std::ios::binary | std::ios::trunc);
+            if (!stream) {
+                return false;
+            }
+
+            FileHeader header = _Identity;
+            header.NumberOfRecords = records.size();
+
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            stream.write(reinterpret_cast<const char*>(records.data()),
+                static_cast<std::streamsize>(records.size() * sizeof(Record)));
+            if (!stream) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_name, file_name, error);
+        return !error;
+    }
+
+    const SignatureCache::Record* SignatureCache::Lookup(
+        _In_ uint64_t pattern_hash,
+        _In_ DWORD characteristics
+    ) const {
+        const Record key = { pattern_hash, 0, characteristics };
+
+        auto resolved = std::lower_bound(_Resolved.begin(), _Resolved.end(), key, RecordLess);
+        if (resolved != _Resolved.end() && !RecordLess(key, *resolved)) {
+            return &*resolved;
+        }
+
+        auto mapped = std::lower_bound(_Records, _Records + _NumberOfRecords, key, RecordLess);
+        if (mapped != _Records + _NumberOfRecords && !RecordLess(key, *mapped)) {
+            return mapped;
+        }
+
+        return nullptr;
+    }
+
+    bool SignatureCache::Resolve(
+        _In_ const memory::BytePattern& pattern,
+        _Out_ DWORD* rva,
+        _In_opt_ DWORD characteristics
+    ) {
+        if (rva == nullptr) {
+            return false;
+        }
+
+        *rva = 0;
+
+        if (!pattern.IsValid()) {
+            return false;
+        }
+
+        const auto pattern_hash = pattern.Hash();
+
+        if (auto record = Lookup(pattern_hash, characteristics)) {
+            if (record->Rva == kNotFound) {
+                return false;
+            }
+
+            // Validate the cached hit with a byte compare.
+            if (static_cast<ULONGLONG>(record->Rva) + pattern.MinSize() <= _Identity.SizeOfImage) {
+                const auto size = std::min<size_t>(pattern.Size(), _Identity.SizeOfImage - record->Rva);
+
+                auto address = _Image.RVAToAddr(record->Rva);
+                if (address && memory::MemorySearch(address, size, pattern) == address) {
+                    *rva = record->Rva;
+                    return true;
+                }
+            }
+        }
+
+        SectionMatch match{};
+        const bool found = SearchImageSections(_Image, pattern, &match, characteristics);
+
+        const Record record = { pattern_hash, found ? match.Rva : kNotFound, characteristics };
+
+        auto position = std::lower_bound(_Resolved.begin(), _Resolved.end(), record, RecordLess);
+        if (position != _Resolved.end() && !RecordLess(record, *position)) {
+            *position = record;
+        }
+        else {
+            _Resolved.insert(position, record);
+        }
+
+        if (found) {
+            *rva = match.Rva;
+        }
+        return found;
+    }
+}
@@ -0,0 +1,380 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#pragma once
+
+// The few Windows SDK names that the portable files of libbase (those that
+// do not include universal.inl) see through the public headers, so that
+// they build without the Windows headers.
+
+// C/C++ Header
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#   define NOMINMAX
+#   endif
+#   include <Windows.h>
+#else
+#   include <strings.h>
+
+#   define _In_
+#   define _In_opt_
+#   define _Inout_
+#   define _Out_
+#   define _Out_opt_
+#   define _In_bytecount_(size)
+#   define _In_reads_bytes_(size)
+
+typedef uint8_t         BYTE;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef int16_t         SHORT;
+typedef int32_t         LONG;
+typedef uint64_t        ULONGLONG;
+typedef unsigned int    UINT;
+typedef size_t          SIZE_T;
+typedef char            CHAR;
+typedef void*           PVOID;
+typedef void*           LPVOID;
+typedef BYTE*           PBYTE;
+typedef WORD*           PWORD;
+typedef DWORD*          PDWORD;
+typedef const char*     LPCSTR;
+
+typedef struct HINSTANCE__* HMODULE;
+typedef intptr_t (*FARPROC)();
+
+typedef struct _GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t  Data4[8];
+} GUID;
+
+#   define MAXDWORD     0xFFFFFFFF
+
+#   define LOWORD(l)                    ((WORD)(((uintptr_t)(l)) & 0xFFFF))
+#   define HIWORD(l)                    ((WORD)((((uintptr_t)(l)) >> 16) & 0xFFFF))
+#   define UNREFERENCED_PARAMETER(P)    (void)(P)
+#   define _strnicmp                    strncasecmp
+
+// winerror.h codes returned by the portable files.
+#   define NO_ERROR                 0L
+#   define ERROR_INVALID_FUNCTION   1L
+#   define ERROR_FILE_NOT_FOUND     2L
+#   define ERROR_ACCESS_DENIED      5L
+#   define ERROR_INVALID_HANDLE     6L
+#   define ERROR_NOT_ENOUGH_MEMORY  8L
+#   define ERROR_GEN_FAILURE        31L
+#   define ERROR_HANDLE_EOF         38L
+#   define ERROR_NOT_SUPPORTED      50L
+#   define ERROR_INVALID_PARAMETER  87L
+#   define ERROR_PROC_NOT_FOUND     127L
+#   define ERROR_BAD_EXE_FORMAT     193L
+#   define ERROR_INVALID_ADDRESS    487L
+
+// The PE format, as winnt.h declares it.
+#   define IMAGE_DOS_SIGNATURE                  0x5A4D
+#   define IMAGE_NT_SIGNATURE                   0x00004550
+#   define IMAGE_NT_OPTIONAL_HDR32_MAGIC        0x10B
+#   define IMAGE_NT_OPTIONAL_HDR64_MAGIC        0x20B
+#   define IMAGE_NUMBEROF_DIRECTORY_ENTRIES     16
+#   define IMAGE_SIZEOF_SHORT_NAME              8
+
+#   define IMAGE_FILE_RELOCS_STRIPPED           0x0001
+#   define IMAGE_FILE_DLL                       0x2000
+#   define IMAGE_FILE_MACHINE_I386              0x014C
+#   define IMAGE_FILE_MACHINE_AMD64             0x8664
+#   define IMAGE_FILE_MACHINE_ARM64             0xAA64
+
+#   define IMAGE_DIRECTORY_ENTRY_EXPORT         0
+#   define IMAGE_DIRECTORY_ENTRY_IMPORT         1
+#   define IMAGE_DIRECTORY_ENTRY_RESOURCE       2
+#   define IMAGE_DIRECTORY_ENTRY_EXCEPTION      3
+#   define IMAGE_DIRECTORY_ENTRY_SECURITY       4
+#   define IMAGE_DIRECTORY_ENTRY_BASERELOC      5
+#   define IMAGE_DIRECTORY_ENTRY_DEBUG          6
+#   define IMAGE_DIRECTORY_ENTRY_TLS            9
+#   define IMAGE_DIRECTORY_ENTRY_IAT            12
+#   define IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT   13
+
+#   define IMAGE_SCN_CNT_CODE                   0x00000020
+#   define IMAGE_SCN_CNT_INITIALIZED_DATA       0x00000040
+#   define IMAGE_SCN_CNT_UNINITIALIZED_DATA     0x00000080
+#   define IMAGE_SCN_MEM_EXECUTE                0x20000000
+#   define IMAGE_SCN_MEM_READ                   0x40000000
+#   define IMAGE_SCN_MEM_WRITE                  0x80000000
+
+#   define IMAGE_REL_BASED_ABSOLUTE             0
+#   define IMAGE_REL_BASED_HIGH                 1
+#   define IMAGE_REL_BASED_LOW                  2
+#   define IMAGE_REL_BASED_HIGHLOW              3
+#   define IMAGE_REL_BASED_HIGHADJ              4
+#   define IMAGE_REL_BASED_DIR64                10
+
+#   define IMAGE_DEBUG_TYPE_CODEVIEW            2
+
+#   define IMAGE_ORDINAL_FLAG32                 0x80000000
+#   define IMAGE_ORDINAL_FLAG64                 0x8000000000000000ull
+#   define IMAGE_ORDINAL32(Ordinal)             ((Ordinal) & 0xFFFF)
+#   define IMAGE_ORDINAL64(Ordinal)             ((Ordinal) & 0xFFFF)
+#   define IMAGE_SNAP_BY_ORDINAL32(Ordinal)     (((Ordinal) & IMAGE_ORDINAL_FLAG32) != 0)
+#   define IMAGE_SNAP_BY_ORDINAL64(Ordinal)     (((Ordinal) & IMAGE_ORDINAL_FLAG64) != 0)
+
+#pragma pack(push, 2)
+
+typedef struct _IMAGE_DOS_HEADER {
+    WORD e_magic;
+    WORD e_cblp;
+    WORD e_cp;
+    WORD e_crlc;
+    WORD e_cparhdr;
+    WORD e_minalloc;
+    WORD e_maxalloc;
+    WORD e_ss;
+    WORD e_sp;
+    WORD e_csum;
+    WORD e_ip;
+    WORD e_cs;
+    WORD e_lfarlc;
+    WORD e_ovno;
+    WORD e_res[4];
+    WORD e_oemid;
+    WORD e_oeminfo;
+    WORD e_res2[10];
+    LONG e_lfanew;
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+
+#pragma pack(pop)
+#pragma pack(push, 4)
+
+typedef struct _IMAGE_FILE_HEADER {
+    WORD  Machine;
+    WORD  NumberOfSections;
+    DWORD TimeDateStamp;
+    DWORD PointerToSymbolTable;
+    DWORD NumberOfSymbols;
+    WORD  SizeOfOptionalHeader;
+    WORD  Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY {
+    DWORD VirtualAddress;
+    DWORD Size;
+} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER {
+    WORD  Magic;
+    BYTE  MajorLinkerVersion;
+    BYTE  MinorLinkerVersion;
+    DWORD SizeOfCode;
+    DWORD SizeOfInitializedData;
+    DWORD SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint;
+    DWORD BaseOfCode;
+    DWORD BaseOfData;
+    DWORD ImageBase;
+    DWORD SectionAlignment;
+    DWORD FileAlignment;
+    WORD  MajorOperatingSystemVersion;
+    WORD  MinorOperatingSystemVersion;
+    WORD  MajorImageVersion;
+    WORD  MinorImageVersion;
+    WORD  MajorSubsystemVersion;
+    WORD  MinorSubsystemVersion;
+    DWORD Win32VersionValue;
+    DWORD SizeOfImage;
+    DWORD SizeOfHeaders;
+    DWORD CheckSum;
+    WORD  Subsystem;
+    WORD  DllCharacteristics;
+    DWORD SizeOfStackReserve;
+    DWORD SizeOfStackCommit;
+    DWORD SizeOfHeapReserve;
+    DWORD SizeOfHeapCommit;
+    DWORD LoaderFlags;
+    DWORD NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64 {
+    WORD      Magic;
+    BYTE      MajorLinkerVersion;
+    BYTE      MinorLinkerVersion;
+    DWORD     SizeOfCode;
+    DWORD     SizeOfInitializedData;
+    DWORD     SizeOfUninitializedData;
+    DWORD     AddressOfEntryPoint;
+    DWORD     BaseOfCode;
+    ULONGLONG ImageBase;
+    DWORD     SectionAlignment;
+    DWORD     FileAlignment;
+    WORD      MajorOperatingSystemVersion;
+    WORD      MinorOperatingSystemVersion;
+    WORD      MajorImageVersion;
+    WORD      MinorImageVersion;
+    WORD      MajorSubsystemVersion;
+    WORD      MinorSubsystemVersion;
+    DWORD     Win32VersionValue;
+    DWORD     SizeOfImage;
+    DWORD     SizeOfHeaders;
+    DWORD     CheckSum;
+    WORD      Subsystem;
+    WORD      DllCharacteristics;
+    ULONGLONG SizeOfStackReserve;
+    ULONGLONG SizeOfStackCommit;
+    ULONGLONG SizeOfHeapReserve;
+    ULONGLONG SizeOfHeapCommit;
+    DWORD     LoaderFlags;
+    DWORD     NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS {
+    DWORD                   Signature;
+    IMAGE_FILE_HEADER       FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+} IMAGE_NT_HEADERS32, *PIMAGE_NT_HEADERS32;
+
+typedef struct _IMAGE_NT_HEADERS64 {
+    DWORD                   Signature;
+    IMAGE_FILE_HEADER       FileHeader;
+    IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+} IMAGE_NT_HEADERS64, *PIMAGE_NT_HEADERS64;
+
+typedef struct _IMAGE_SECTION_HEADER {
+    BYTE Name[IMAGE_SIZEOF_SHORT_NAME];
+    union {
+        DWORD PhysicalAddress;
+        DWORD VirtualSize;
+    } Misc;
+    DWORD VirtualAddress;
+    DWORD SizeOfRawData;
+    DWORD PointerToRawData;
+    DWORD PointerToRelocations;
+    DWORD PointerToLinenumbers;
+    WORD  NumberOfRelocations;
+    WORD  NumberOfLinenumbers;
+    DWORD Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+typedef struct _IMAGE_EXPORT_DIRECTORY {
+    DWORD Characteristics;
+    DWORD TimeDateStamp;
+    WORD  MajorVersion;
+    WORD  MinorVersion;
+    DWORD Name;
+    DWORD Base;
+    DWORD NumberOfFunctions;
+    DWORD NumberOfNames;
+    DWORD AddressOfFunctions;
+    DWORD AddressOfNames;
+    DWORD AddressOfNameOrdinals;
+} IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
+
+typedef struct _IMAGE_IMPORT_DESCRIPTOR {
+    union {
+        DWORD Characteristics;
+        DWORD OriginalFirstThunk;
+    };
+    DWORD TimeDateStamp;
+    DWORD ForwarderChain;
+    DWORD Name;
+    DWORD FirstThunk;
+} IMAGE_IMPORT_DESCRIPTOR, *PIMAGE_IMPORT_DESCRIPTOR;
+
+typedef struct _IMAGE_IMPORT_BY_NAME {
+    WORD Hint;
+    CHAR Name[1];
+} IMAGE_IMPORT_BY_NAME, *PIMAGE_IMPORT_BY_NAME;
+
+typedef struct _IMAGE_THUNK_DATA32 {
+    union {
+        DWORD ForwarderString;
+        DWORD Function;
+        DWORD Ordinal;
+        DWORD AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA32, *PIMAGE_THUNK_DATA32;
+
+typedef struct _IMAGE_THUNK_DATA64 {
+    union {
+        ULONGLONG ForwarderString;
+        ULONGLONG Function;
+        ULONGLONG Ordinal;
+        ULONGLONG AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA64, *PIMAGE_THUNK_DATA64;
+
+typedef struct _IMAGE_BASE_RELOCATION {
+    DWORD VirtualAddress;
+    DWORD SizeOfBlock;
+} IMAGE_BASE_RELOCATION, *PIMAGE_BASE_RELOCATION;
+
+typedef struct _IMAGE_DEBUG_DIRECTORY {
+    DWORD Characteristics;
+    DWORD TimeDateStamp;
+    WORD  MajorVersion;
+    WORD  MinorVersion;
+    DWORD Type;
+    DWORD SizeOfData;
+    DWORD AddressOfRawData;
+    DWORD PointerToRawData;
+} IMAGE_DEBUG_DIRECTORY, *PIMAGE_DEBUG_DIRECTORY;
+
+#pragma pack(pop)
+
+// The delay load descriptor, as delayimp.h declares it.
+enum DLAttr {
+    dlattrRva = 0x1,
+};
+
+typedef struct ImgDelayDescr {
+    DWORD grAttrs;
+    DWORD rvaDLLName;
+    DWORD rvaHmod;
+    DWORD rvaIAT;
+    DWORD rvaINT;
+    DWORD rvaBoundIAT;
+    DWORD rvaUnloadIAT;
+    DWORD dwTimeStamp;
+} ImgDelayDescr, *PImgDelayDescr;
+
+typedef const ImgDelayDescr* PCImgDelayDescr;
+
+// The headers of the build's bitness, as _WIN64 selects them in winnt.h.
+#   if UINTPTR_MAX == UINT64_MAX
+#       define IMAGE_NT_OPTIONAL_HDR_MAGIC      IMAGE_NT_OPTIONAL_HDR64_MAGIC
+#       define IMAGE_ORDINAL_FLAG               IMAGE_ORDINAL_FLAG64
+#       define IMAGE_ORDINAL(Ordinal)           IMAGE_ORDINAL64(Ordinal)
+#       define IMAGE_SNAP_BY_ORDINAL(Ordinal)   IMAGE_SNAP_BY_ORDINAL64(Ordinal)
+
+typedef IMAGE_OPTIONAL_HEADER64     IMAGE_OPTIONAL_HEADER;
+typedef PIMAGE_OPTIONAL_HEADER64    PIMAGE_OPTIONAL_HEADER;
+typedef IMAGE_NT_HEADERS64          IMAGE_NT_HEADERS;
+typedef PIMAGE_NT_HEADERS64         PIMAGE_NT_HEADERS;
+typedef IMAGE_THUNK_DATA64          IMAGE_THUNK_DATA;
+typedef PIMAGE_THUNK_DATA64         PIMAGE_THUNK_DATA;
+#   else
+#       define IMAGE_NT_OPTIONAL_HDR_MAGIC      IMAGE_NT_OPTIONAL_HDR32_MAGIC
+#       define IMAGE_ORDINAL_FLAG               IMAGE_ORDINAL_FLAG32
+#       define IMAGE_ORDINAL(Ordinal)           IMAGE_ORDINAL32(Ordinal)
+#       define IMAGE_SNAP_BY_ORDINAL(Ordinal)   IMAGE_SNAP_BY_ORDINAL32(Ordinal)
+
+typedef IMAGE_OPTIONAL_HEADER32     IMAGE_OPTIONAL_HEADER;
+typedef PIMAGE_OPTIONAL_HEADER32    PIMAGE_OPTIONAL_HEADER;
+typedef IMAGE_NT_HEADERS32          IMAGE_NT_HEADERS;
+typedef PIMAGE_NT_HEADERS32         PIMAGE_NT_HEADERS;
+typedef IMAGE_THUNK_DATA32          IMAGE_THUNK_DATA;
+typedef PIMAGE_THUNK_DATA32         PIMAGE_THUNK_DATA;
+#   endif
+
+#   define IMAGE_FIRST_SECTION(NtHeaders) ((PIMAGE_SECTION_HEADER)        \
+        ((uintptr_t)(NtHeaders) + offsetof(IMAGE_NT_HEADERS, OptionalHeader) + \
+         ((NtHeaders))->FileHeader.SizeOfOptionalHeader))
+#endif
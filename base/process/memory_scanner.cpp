@@ -0,0 +1,315 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifdef _WIN32
+#   include "base/universal.inl"
+#else
+#   include "base/portable.inl"
+#   include "include/libbase/memory/search.h"
+#   include "include/libbase/process/memory_scanner.h"
+#   include <algorithm>
+#   include <atomic>
+#   include <cerrno>
+#   include <condition_variable>
+#   include <cstdio>
+#   include <cstring>
+#   include <mutex>
+#   include <string>
+#   include <thread>
+#   include <sys/uio.h>
+#endif
+#include <deque>
+
+
+namespace base::process
+{
+    namespace
+    {
+        // A buffer read from the target, queued for matching.
+        struct Batch
+        {
+            uint8_t* buffer;
+            PVOID    region;
+            SIZE_T   offset;    // Of the buffer within the region.
+            SIZE_T   length;
+            SIZE_T   owned;     // Hits at or past this belong to the next batch.
+        };
+
+        // The memory calls of the platform: VirtualQueryEx and
+        // ReadProcessMemory on Windows, /proc/<pid>/maps and process_vm_readv
+        // elsewhere.
+#ifdef _WIN32
+        // Calls visit(base, size) for the readable regions of the process in
+        // ascending address order, until it returns false.
+        template<typename Visit>
+        void EnumReadableRegions(_In_ HANDLE process, _In_ Visit&& visit)
+        {
+            SYSTEM_INFO system_info{};
+            GetSystemInfo(&system_info);
+
+            auto address = static_cast<uint8_t*>(system_info.lpMinimumApplicationAddress);
+            const auto last_address = static_cast<uint8_t*>(system_info.lpMaximumApplicationAddress);
+
+            while (address < last_address) {
+                MEMORY_BASIC_INFORMATION info{};
+                if (VirtualQueryEx(process, address, &info, sizeof(info)) != sizeof(info)) {
+                    break;
+                }
+
+                const auto region = static_cast<uint8_t*>(info.BaseAddress);
+                address = region + info.RegionSize;
+
+                if (memory::IsReadableRegion(info) && !visit(region, info.RegionSize)) {
+                    break;
+                }
+            }
+        }
+
+        // Returns the number of bytes read; the region can change under us.
+        SIZE_T ReadMemory(_In_ HANDLE process, _In_ const uint8_t* address, _Out_ uint8_t* buffer, _In_ SIZE_T length)
+        {
+            SIZE_T bytes_read = 0;
+            if (!ReadProcessMemory(process, address, buffer, length, &bytes_read)) {
+                bytes_read = (GetLastError() == ERROR_PARTIAL_COPY) ? bytes_read : 0;
+            }
+            return bytes_read;
+        }
+#else
+        std::string MapsPath(_In_ DWORD process_id)
+        {
+            return "/proc/" + std::to_string(process_id) + "/maps";
+        }
+
+        template<typename Visit>
+        void EnumReadableRegions(_In_ DWORD process_id, _In_ Visit&& visit)
+        {
+            FILE* maps = fopen(MapsPath(process_id).c_str(), "r");
+            if (maps == nullptr) {
+                return;
+            }
+
+            // The target keeps running: read the list first, then the memory.
+            struct Region
+            {
+                uint8_t* base;
+                SIZE_T   size;
+            };
+            std::vector<Region> regions;
+
+            char line[512];
+            bool line_start = true;
+
+            while (fgets(line, sizeof(line), maps)) {
+                // The rest of a line longer than the buffer is not a mapping.
+                const auto fragment = !line_start;
+                line_start = strchr(line, '\n') != nullptr;
+                if (fragment) {
+                    continue;
+                }
+
+                unsigned long long map_first = 0;
+                unsigned long long map_last = 0;
+                char permissions[5] = {};
+                if (sscanf(line, "%llx-%llx %4s", &map_first, &map_last, permissions) != 3 ||
+                    permissions[0] != 'r' || map_last <= map_first) {
+                    continue;
+                }
+
+                regions.push_back({ reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(map_first)),
+                    static_cast<SIZE_T>(map_last - map_first) });
+            }
+
+            fclose(maps);
+
+            for (const auto& region : regions) {
+                if (!visit(region.base, region.size)) {
+                    break;
+                }
+            }
+        }
+
+        // Returns the number of bytes read. A page that is gone ([vvar], a
+        // region unmapped since the list was read) ends the read.
+        SIZE_T ReadMemory(_In_ DWORD process_id, _In_ const uint8_t* address, _Out_ uint8_t* buffer, _In_ SIZE_T length)
+        {
+            iovec local{ buffer, length };
+            iovec remote{ const_cast<uint8_t*>(address), length };
+
+            const auto bytes_read = process_vm_readv(static_cast<pid_t>(process_id), &local, 1, &remote, 1, 0);
+            return bytes_read > 0 ? static_cast<SIZE_T>(bytes_read) : 0;
+        }
+#endif
+    }
+
+    ProcessMemoryScanner::ProcessMemoryScanner(
+        _In_opt_ SIZE_T buffer_size,
+        _In_opt_ size_t buffer_count)
+        : _BufferSize(buffer_size)
+    {
+        // One buffer is read while another is matched.
+        _Buffers.resize(std::max<size_t>(buffer_count, 2));
+    }
+
+    ProcessMemoryScanner::~ProcessMemoryScanner()
+    {
+        Close();
+    }
+
+    DWORD ProcessMemoryScanner::Open(_In_ DWORD process_id)
+    {
+        Close();
+
+#ifdef _WIN32
+        _Process = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process_id);
+        return _Process ? NO_ERROR : GetLastError();
+#else
+        // Reading the maps takes the same ptrace access as reading the memory.
+        FILE* maps = process_id ? fopen(MapsPath(process_id).c_str(), "r") : nullptr;
+        if (maps == nullptr) {
+            return (errno == EACCES || errno == EPERM) ? ERROR_ACCESS_DENIED : ERROR_INVALID_PARAMETER;
+        }
+
+        fclose(maps);
+        _Process = process_id;
+        return NO_ERROR;
+#endif
+    }
+
+#ifdef _WIN32
+    DWORD ProcessMemoryScanner::Open(_In_ HANDLE process)
+    {
+        Close();
+
+        if (!DuplicateHandle(GetCurrentProcess(), process, GetCurrentProcess(), &_Process,
+            PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, 0)) {
+            _Process = nullptr;
+            return GetLastError();
+        }
+        return NO_ERROR;
+    }
+#endif
+
+    void ProcessMemoryScanner::Close()
+    {
+#ifdef _WIN32
+        if (_Process) {
+            CloseHandle(_Process);
+        }
+#endif
+        _Process = {};
+    }
+
+    DWORD ProcessMemoryScanner::Scan(
+        _In_ const memory::BytePattern& pattern,
+        _In_ MatchFunction callback,
+        _In_opt_ PVOID cookie
+    )
+    {
+        if (!IsOpen()) {
+            return ERROR_INVALID_HANDLE;
+        }
+
+        if (!pattern.IsValid() || callback == nullptr || _BufferSize < pattern.Size()) {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        const auto overlap = pattern.Size() - 1;
+
+        std::mutex lock;
+        std::condition_variable signal;
+
+        std::vector<uint8_t*> free_buffers;
+        std::deque<Batch>     batches;
+        bool done = false;
+        std::atomic<bool> stopped{ false };
+
+        for (auto& buffer : _Buffers) {
+            if (!buffer) {
+                buffer = std::make_unique<uint8_t[]>(_BufferSize);
+            }
+            free_buffers.push_back(buffer.get());
+        }
+
+        std::thread matcher([&]()
+        {
+            for (;;) {
+                Batch batch{};
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    signal.wait(guard, [&]() { return done || !batches.empty(); });
+                    if (batches.empty()) {
+                        break;
+                    }
+
+                    batch = batches.front();
+                    batches.pop_front();
+                }
+
+                if (!stopped) {
+                    for (auto hit : memory::SearchAll(batch.buffer, batch.length, pattern)) {
+                        const auto offset = static_cast<SIZE_T>(hit - batch.buffer);
+                        if (offset >= batch.owned) {
+                            break;
+                        }
+
+                        if (!callback(batch.region, batch.offset + offset, cookie)) {
+                            stopped = true;
+                            break;
+                        }
+                    }
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                free_buffers.push_back(batch.buffer);
+                signal.notify_all();
+            }
+        });
+
+        EnumReadableRegions(_Process, [&](uint8_t* region, SIZE_T region_size)
+        {
+            for (SIZE_T offset = 0; offset < region_size && !stopped;) {
+                const auto length = std::min(_BufferSize, region_size - offset);
+
+                uint8_t* buffer = nullptr;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    signal.wait(guard, [&]() { return !free_buffers.empty(); });
+
+                    buffer = free_buffers.back();
+                    free_buffers.pop_back();
+                }
+
+                // The region can change under us; keep what was read.
+                const auto bytes_read = ReadMemory(_Process, region + offset, buffer, length);
+
+                const auto last_batch = (offset + length == region_size) || (bytes_read < length);
+                const auto owned = last_batch ? bytes_read : length - overlap;
+
+                std::lock_guard<std::mutex> guard(lock);
+                if (bytes_read != 0) {
+                    batches.push_back({ buffer, region, offset, bytes_read, owned });
+                }
+                else {
+                    free_buffers.push_back(buffer);
+                }
+                signal.notify_all();
+
+                if (last_batch) {
+                    break;
+                }
+                offset += owned;
+            }
+            return !stopped;
+        });
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done = true;
+            signal.notify_all();
+        }
+
+        matcher.join();
+        return NO_ERROR;
+    }
+}
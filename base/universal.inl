@@ -15,6 +15,11 @@
 // C/C++ Header
 #include <cwctype>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 
 // Self
 #include "include/libbase/libbase.h"
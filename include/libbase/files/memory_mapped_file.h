@@ -0,0 +1,56 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+
+namespace base::files
+{
+    // Maps a whole file read-only into the address space.
+    //
+    // Reference: https://github.com/chromium/chromium/blob/master/base/files/memory_mapped_file.h
+    class MemoryMappedFile
+    {
+    public:
+        MemoryMappedFile() = default;
+        MemoryMappedFile(const MemoryMappedFile&) = delete;
+        MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+        MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+        MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+
+        ~MemoryMappedFile();
+
+        // Opens an existing file and maps it into memory.
+        // Returns false if the file is missing, empty or cannot be mapped.
+        bool Initialize(_In_ const std::filesystem::path& file_name);
+
+        // Unmaps the file. It is safe to call Close repeatedly.
+        void Close();
+
+        const uint8_t* Data() const;
+        size_t Length() const;
+
+        // Returns true if a file is mapped.
+        bool IsValid() const;
+
+    private:
+        const uint8_t* _Data   = nullptr;
+        size_t         _Length = 0;
+    };
+
+    inline const uint8_t* MemoryMappedFile::Data() const {
+        return _Data;
+    }
+
+    inline size_t MemoryMappedFile::Length() const {
+        return _Length;
+    }
+
+    inline bool MemoryMappedFile::IsValid() const {
+        return _Data != nullptr;
+    }
+}
@@ -18,13 +18,29 @@ EXTERN_C IMAGE_DOS_HEADER __ImageBase;
 #include "strings/util.h"
 #include "strings/codepage.h"
 #include "memory/search.h"
+#include "memory/code_patch.h"
+#include "memory/pattern_set.h"
+#include "memory/stream_search.h"
+#include "memory/search_index.h"
+#include "memory/region_search.h"
 #include "memory/singleton.h"
 #include "memory/shared_memory.h"
 #include "process/info.h"
 #include "process/launch.h"
+#include "process/memory_scanner.h"
 #include "modules/library.h"
 #include "modules/resource.h"
 #include "modules/pe_parser.h"
+#include "modules/pe_search.h"
+#include "modules/export_index.h"
+#include "modules/pe_relocate.h"
 #include "modules/iat_patch_function.h"
 #include "files/version_info.h"
+#include "files/memory_mapped_file.h"
+#include "modules/pe_file.h"
+#include "modules/pe_view.h"
+#include "modules/image_mapper.h"
+#include "modules/pe_corpus_scanner.h"
+#include "modules/signature_cache.h"
+#include "modules/pe_metadata_cache.h"
 #include "notifications/module.h"
@@ -0,0 +1,88 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+
+namespace base::memory
+{
+    // Batches writes to code pages (code sites, IAT slots, ...).
+    //
+    // ModifyCode changes the page protection twice per write. A transaction
+    // collects the writes first; Commit() then groups them by page, changes
+    // the protection once per run of pages with the same protection, applies
+    // every write, and restores the protection. Either all the writes are
+    // applied or none is. A committed transaction can be rolled back.
+    //
+    // Protections are changed with VirtualProtect on Windows and with
+    // mprotect elsewhere; there the protections to restore are read from
+    // /proc/self/maps, and errno values are reported as the nearest
+    // winerror.h code.
+    //
+    // Use:
+    //   CodePatchTransaction patch;
+    //   patch.Add(&iat[0], &hook0, sizeof(hook0));
+    //   patch.Add(&iat[1], &hook1, sizeof(hook1));
+    //   if (patch.Commit() == NO_ERROR) { ... patch.Rollback(); }
+    class CodePatchTransaction
+    {
+    public:
+        CodePatchTransaction() = default;
+        CodePatchTransaction(const CodePatchTransaction&) = delete;
+        CodePatchTransaction& operator=(const CodePatchTransaction&) = delete;
+
+        // Stages a write of length bytes from new_code to address.
+        // Staged writes must not overlap. Returns false if the arguments are
+        // invalid or the transaction is already committed.
+        bool Add(
+            _Inout_ void* address,
+            _In_reads_bytes_(length) const void* new_code,
+            _In_ size_t length
+        );
+
+        // Applies every staged write.
+        //
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful.
+        // On failure nothing has been written.
+        DWORD Commit();
+
+        // Restores the bytes overwritten by Commit().
+        //
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful
+        DWORD Rollback();
+
+        // Returns the number of staged writes.
+        size_t Size() const;
+
+        bool IsCommitted() const;
+
+    private:
+        struct Write
+        {
+            uint8_t*             Address;
+            std::vector<uint8_t> NewCode;
+            std::vector<uint8_t> OldCode;
+        };
+
+        DWORD Apply(_In_ bool commit);
+
+        std::vector<Write> _Writes;
+        bool               _Committed = false;
+    };
+
+    inline size_t CodePatchTransaction::Size() const {
+        return _Writes.size();
+    }
+
+    inline bool CodePatchTransaction::IsCommitted() const {
+        return _Committed;
+    }
+}
+
+namespace base
+{
+    using memory::CodePatchTransaction;
+}
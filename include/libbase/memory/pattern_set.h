@@ -0,0 +1,96 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+namespace base::memory
+{
+    // A set of signature patterns that is matched against a buffer in a single
+    // pass, instead of one MemorySearch pass per pattern.
+    //
+    // Each pattern is keyed by its rarest pair of adjacent exact bytes (or its
+    // rarest exact byte). The scan tests every offset of the buffer against a
+    // 64K-bit filter of those keys and only verifies the patterns whose key
+    // hits, so the cost is roughly O(buffer) regardless of the pattern count.
+    class PatternSet
+    {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        // Callback to report matches.
+        // index is the value returned by Add() for the pattern, match is the
+        // address of the first byte. cookie is the value passed to Scan().
+        // Returns true to continue the scan.
+        using MatchFunction = bool (*)(
+            size_t index,
+            const uint8_t* match,
+            PVOID cookie);
+
+        PatternSet() = default;
+
+        // Adds a pattern to the set.
+        // Returns the index of the pattern, or npos if the pattern is invalid.
+        size_t Add(_In_ const BytePattern& aPattern);
+        size_t Add(_In_ std::string_view aPattern);
+
+        // Returns the number of patterns in the set.
+        size_t Size() const;
+
+        // Returns the pattern at the given index.
+        const BytePattern& Pattern(_In_ size_t aIndex) const;
+
+        // Reports every match of every pattern in [aFirst, aLast). Matches of
+        // one pattern are reported in ascending address order.
+        // Returns false if the callback stopped the scan.
+        bool Scan(
+            _In_ const uint8_t* aFirst,
+            _In_ const uint8_t* aLast,
+            _In_ MatchFunction aCallback,
+            _In_opt_ PVOID aCookie
+        ) const;
+
+        // Returns the first match of each pattern (nullptr if none), indexed
+        // like the set. Stops scanning once every pattern has been found.
+        std::vector<const uint8_t*> FindFirst(
+            _In_ const uint8_t* aFirst,
+            _In_ const uint8_t* aLast
+        ) const;
+
+    private:
+        struct Entry
+        {
+            uint32_t Key;       // Anchor gram (or byte).
+            uint32_t Offset;    // Offset of the anchor within the pattern.
+            size_t   Index;     // Pattern index.
+        };
+
+        std::vector<BytePattern> _Patterns;
+
+        // Entries sorted by key, plus a bit filter over the keys.
+        std::vector<Entry>    _Grams;
+        std::vector<Entry>    _Bytes;
+        std::vector<uint64_t> _GramFilter = std::vector<uint64_t>(0x10000 / 64);
+        uint64_t              _ByteFilter[4]{};
+
+        // Patterns without an exact byte in the head, tried at every offset.
+        std::vector<size_t>   _Wildcards;
+    };
+
+    inline size_t PatternSet::Size() const {
+        return _Patterns.size();
+    }
+
+    inline const BytePattern& PatternSet::Pattern(_In_ size_t aIndex) const {
+        return _Patterns[aIndex];
+    }
+}
+
+namespace base
+{
+    using memory::PatternSet;
+}
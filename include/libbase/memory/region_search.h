@@ -0,0 +1,72 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+
+namespace base::memory
+{
+#ifdef _WIN32
+    // Returns true if the region is committed and readable: not free or
+    // reserved, not PAGE_NOACCESS, PAGE_EXECUTE or a guard page.
+    bool IsReadableRegion(_In_ const MEMORY_BASIC_INFORMATION& aInfo);
+#endif
+
+    // Callback for EnumReadableRegions.
+    // base and bytes describe a run of committed, readable pages. cookie is
+    // the value passed to EnumReadableRegions().
+    // Returns true to continue the enumeration.
+    using ReadableRegionFunction = bool (*)(
+        void* base,
+        size_t bytes,
+        PVOID cookie);
+
+    // Enumerates the readable parts of [aAddress, aAddress + aBytes), clipped
+    // to that range. Adjacent readable regions are reported as one run.
+    //
+    // The regions come from VirtualQuery on Windows and from /proc/self/maps
+    // elsewhere, where a readable mapping is one with the 'r' permission
+    // ([vvar] excepted). A file mapping that extends past the end of its
+    // file is reported whole, although its last pages fault when read.
+    // Returns false if the callback stopped the enumeration.
+    bool EnumReadableRegions(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ ReadableRegionFunction aCallback,
+        _In_opt_ PVOID aCookie
+    );
+
+    // Variants of MemorySearch for sparse address ranges. The range is split
+    // into readable runs up front and only those are searched, so holes are
+    // skipped rather than ending the search on the first fault, and no
+    // exception handler is involved. Matches never span a hole.
+    //
+    // The regions are queried once: memory released by another thread while
+    // the search runs is not guarded against. Use MemorySearch for that.
+    void* MemorySearchReadable(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern
+    );
+
+    // Returns every match in ascending address order.
+    std::vector<uint8_t*> MemorySearchAllReadable(
+        _In_ void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode = SearchMode::Overlapping
+    );
+}
+
+namespace base
+{
+#ifdef _WIN32
+    using memory::IsReadableRegion;
+#endif
+    using memory::EnumReadableRegions;
+    using memory::MemorySearchReadable;
+    using memory::MemorySearchAllReadable;
+}
@@ -3,10 +3,16 @@
 // found in the LICENSE file.
 
 #pragma once
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 
 namespace base::memory
-{    
+{
     // Change the page protection (of code pages) to writable and copy
     // the data at the specified location
     //
@@ -22,16 +28,555 @@ namespace base::memory
         _In_ int length
     );
 
+    // Matcher variants used by BytePattern::Find.
+    enum class SearchEngine
+    {
+        Auto,       // The fastest engine supported by the running CPU.
+        Scalar,     // memchr on the anchor byte.
+        SSE2,       // 16 candidates per step.
+        AVX2,       // 32 candidates per step.
+    };
+
+    // Returns true if the running CPU (and OS) supports the engine.
+    bool IsSearchEngineSupported(_In_ SearchEngine aEngine);
+
+    // Returns the approximate occurrence rank of a byte value in x86/x64
+    // code. Higher is more common; rare values rank 0. Used to pick anchors.
+    uint8_t GetByteFrequencyRank(_In_ uint8_t aByte);
+
+    // A signature pattern ("48 8B ?? 05") compiled once into a byte array
+    // plus a compare mask, so that searching only compares bytes.
+    //
+    // Besides exact bytes and "??" (or "?"), the grammar accepts nibble masks
+    // ("4?", "?F"), byte sets ("[48|4C]", members may be nibble masks too) and
+    // skips ("{4}" or a bounded "{2-6}"), so compiler variants of one
+    // signature fit in a single pattern and a single scan. A variable skip
+    // makes the match length vary between MinSize() and Size(); it may not
+    // start or end the pattern.
+    //
+    // A compiled pattern is immutable and can be shared between threads and
+    // reused against any number of modules.
+    class BytePattern
+    {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        BytePattern() = default;
+
+        // Compiles the textual pattern. Tokens may be separated by spaces.
+        // A malformed pattern yields an empty (invalid) object.
+        explicit BytePattern(_In_ std::string_view aPattern);
+
+        // Returns true if the pattern was compiled successfully.
+        bool IsValid() const;
+
+        // Returns the number of bytes the longest match spans.
+        size_t Size() const;
+
+        // Returns the number of bytes the shortest match spans. Same as
+        // Size() unless the pattern has a variable skip.
+        size_t MinSize() const;
+
+        // Returns the number of leading pattern bytes that sit at a fixed
+        // offset from the match start, i.e. the bytes before the first
+        // variable skip (all of them if there is none).
+        size_t HeadSize() const;
+
+        // Returns the pattern bytes, already masked. The first HeadSize()
+        // entries map to match offsets 0..HeadSize()-1; the rest follow the
+        // variable skips.
+        const uint8_t* Bytes() const;
+
+        // Returns the compare mask. 0xFF must match, 0x00 is a wildcard,
+        // 0xF0/0x0F a nibble mask. A byte set is masked to the bits its
+        // members share and checked in full by Match().
+        const uint8_t* Mask() const;
+
+        // Compares the pattern against the data at aData. aAvailable is the
+        // number of readable bytes there; Match(aData) assumes Size().
+        bool Match(_In_ const uint8_t* aData) const;
+        bool Match(_In_ const uint8_t* aData, _In_ size_t aAvailable) const;
+
+        // Compares the pattern against aHeadBytes bytes at aHead followed by
+        // aTailBytes bytes at aTail, as if they were contiguous, without
+        // joining them. For matches that straddle two buffers.
+        bool Match(
+            _In_ const uint8_t* aHead,
+            _In_ size_t aHeadBytes,
+            _In_ const uint8_t* aTail,
+            _In_ size_t aTailBytes
+        ) const;
+
+        // Returns the first match in [aFirst, aLast), or nullptr.
+        //
+        // Candidates are located with the pattern's anchor bytes (the two
+        // rarest exact bytes of the head), 16 or 32 offsets at a time, and
+        // only then verified against the whole pattern.
+        const uint8_t* Find(
+            _In_ const uint8_t* aFirst,
+            _In_ const uint8_t* aLast,
+            _In_opt_ SearchEngine aEngine = SearchEngine::Auto
+        ) const;
+
+        // Returns a hash of the compiled pattern that is stable across
+        // processes, to key persistent caches.
+        uint64_t Hash() const;
+
+    private:
+        // A run of bytes at fixed offsets, preceded by a variable skip.
+        struct Segment
+        {
+            size_t Offset;      // Index of the first byte in _Bytes.
+            size_t Length;
+            size_t MinSkip;     // Skip before the segment.
+            size_t MaxSkip;
+        };
+
+        // A byte set that the mask alone does not describe exactly.
+        struct ByteSet
+        {
+            size_t   Offset;    // Index of the byte in _Bytes.
+            uint64_t Bits[4];
+        };
+
+        // Bytes in two pieces, indexed as one run.
+        struct SplitData
+        {
+            const uint8_t* Head;
+            size_t         HeadBytes;
+            const uint8_t* Tail;
+
+            uint8_t operator[](size_t aIndex) const {
+                return aIndex < HeadBytes ? Head[aIndex] : Tail[aIndex - HeadBytes];
+            }
+
+            SplitData operator+(size_t aOffset) const {
+                return aOffset < HeadBytes
+                    ? SplitData{ Head + aOffset, HeadBytes - aOffset, Tail }
+                    : SplitData{ nullptr, 0, Tail + (aOffset - HeadBytes) };
+            }
+        };
+
+        bool MatchComplex(_In_ const uint8_t* aData, _In_ size_t aAvailable) const;
+
+        // Data is a pointer or a SplitData.
+        template<typename Data>
+        bool MatchRange(_In_ const Data& aData, _In_ size_t aOffset, _In_ size_t aLength) const;
+        template<typename Data>
+        bool MatchSegments(_In_ const Data& aData, _In_ size_t aAvailable, _In_ size_t aSegment) const;
+
+        std::vector<uint8_t> _Bytes;
+        std::vector<uint8_t> _Mask;
+
+        // Both empty for a pattern of plain bytes, masks and fixed skips.
+        std::vector<Segment> _Segments;
+        std::vector<ByteSet> _Sets;
+
+        size_t _MinSize = 0;
+        size_t _MaxSize = 0;
+
+        // Offsets of the anchor bytes, or npos if the head has no exact byte.
+        size_t _Anchor[2] = { npos, npos };
+    };
+
+    // Note: aOptimization skips the bytes of a partial match and can miss
+    // overlapping matches. Prefer BytePattern with MemorySearch/SearchAll.
     void* MemorySearch(
         _In_bytecount_(aBytes)  void* aAddress,
         _In_ size_t aBytes,
         _In_ const char* aPattern,
         _In_opt_ bool aOptimization = true
     );
+
+    void* MemorySearch(
+        _In_bytecount_(aBytes)  void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern
+    );
+
+    enum class SearchMode
+    {
+        Overlapping,    // The next search starts one byte after a hit.
+        NonOverlapping, // The next search starts at the end of a hit (of its
+                        // shortest form, if the pattern has a variable skip).
+    };
+
+    // A lazy range over every match of a pattern in a buffer.
+    // Each increment resumes the search where the previous one stopped, so
+    // the buffer is scanned once and nothing is allocated.
+    //
+    // The range refers to the pattern; it must outlive the range. Unlike
+    // MemorySearch, the buffer must be readable as a whole.
+    //
+    // Use: for (auto hit : SearchAll(address, bytes, pattern)) { ... }
+    class SearchRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = uint8_t*;
+            using difference_type   = ptrdiff_t;
+            using pointer           = uint8_t* const*;
+            using reference         = uint8_t* const&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Hit;
+            }
+
+            iterator& operator++() {
+                const auto vNext = (_Range->_Mode == SearchMode::Overlapping)
+                    ? _Hit + 1 : _Hit + _Range->_Pattern->MinSize();
+
+                _Hit = const_cast<uint8_t*>(_Range->_Pattern->Find(vNext, _Range->_Last));
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto vPrevious = *this;
+                ++*this;
+                return vPrevious;
+            }
+
+            bool operator==(const iterator& aOther) const {
+                return _Hit == aOther._Hit;
+            }
+
+            bool operator!=(const iterator& aOther) const {
+                return _Hit != aOther._Hit;
+            }
+
+        private:
+            friend class SearchRange;
+
+            iterator(const SearchRange* aRange, uint8_t* aHit)
+                : _Range(aRange), _Hit(aHit) {
+                //
+            }
+
+            const SearchRange* _Range = nullptr;
+            uint8_t*           _Hit   = nullptr;
+        };
+
+        SearchRange(
+            _In_bytecount_(aBytes) void* aAddress,
+            _In_ size_t aBytes,
+            _In_ const BytePattern& aPattern,
+            _In_opt_ SearchMode aMode = SearchMode::Overlapping)
+            : _First(static_cast<const uint8_t*>(aAddress))
+            , _Last(static_cast<const uint8_t*>(aAddress) + aBytes)
+            , _Pattern(&aPattern)
+            , _Mode(aMode) {
+            //
+        }
+
+        iterator begin() const {
+            return iterator(this, const_cast<uint8_t*>(_Pattern->Find(_First, _Last)));
+        }
+
+        iterator end() const {
+            return iterator(this, nullptr);
+        }
+
+    private:
+        const uint8_t*      _First;
+        const uint8_t*      _Last;
+        const BytePattern*  _Pattern;
+        SearchMode          _Mode;
+    };
+
+    inline SearchRange SearchAll(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode = SearchMode::Overlapping
+    ) {
+        return SearchRange(aAddress, aBytes, aPattern, aMode);
+    }
+
+    // The range keeps a pointer to the pattern; a temporary would dangle.
+    SearchRange SearchAll(
+        _In_bytecount_(aBytes) void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern&& aPattern,
+        _In_opt_ SearchMode aMode = SearchMode::Overlapping
+    ) = delete;
+
+    // Parallel variants of MemorySearch for large images and dumps.
+    //
+    // The range is split into chunks that overlap by the pattern size - 1 and
+    // are scanned on aThreads worker threads (0 = one per hardware thread).
+    // Results are deterministic: MemorySearchParallel returns the same hit as
+    // MemorySearch, and chunks after the first hit are cancelled.
+    // MemorySearchAllParallel returns every hit in ascending address order,
+    // as SearchAll would yield them.
+    void* MemorySearchParallel(
+        _In_bytecount_(aBytes)  void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ unsigned aThreads = 0
+    );
+
+    std::vector<uint8_t*> MemorySearchAllParallel(
+        _In_bytecount_(aBytes)  void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const BytePattern& aPattern,
+        _In_opt_ SearchMode aMode = SearchMode::Overlapping,
+        _In_opt_ unsigned aThreads = 0
+    );
+
+    // A signature pattern compiled at compile time, with a length known to
+    // the compiler. Create it with LIBBASE_PATTERN:
+    //
+    //   constexpr auto kPattern = LIBBASE_PATTERN("48 8B ?? ?? 89");
+    //   auto hit = base::MemorySearch(address, bytes, kPattern);
+    //
+    // The grammar is the one of BytePattern without byte sets and skips; a
+    // malformed pattern does not compile. Match() is fully unrolled for the
+    // pattern length.
+    template<size_t N>
+    struct FixedPattern
+    {
+        static_assert(N > 0, "empty signature pattern");
+
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        uint8_t Bytes[N];
+        uint8_t Mask [N];
+
+        // Offset of the exact byte handed to memchr, or npos.
+        size_t  Anchor;
+
+        static constexpr size_t Size() {
+            return N;
+        }
+
+        bool Match(_In_ const uint8_t* aData) const {
+            return MatchUnrolled(aData, std::make_index_sequence<N>());
+        }
+
+        // Returns the first match in [aFirst, aLast), or nullptr.
+        const uint8_t* Find(_In_ const uint8_t* aFirst, _In_ const uint8_t* aLast) const {
+            if (aFirst == nullptr || aLast < aFirst || static_cast<size_t>(aLast - aFirst) < N) {
+                return nullptr;
+            }
+
+            // No exact byte: try every offset, unless every byte is a
+            // wildcard and every offset matches.
+            if (Anchor == npos) {
+                if (IsWildcard(std::make_index_sequence<N>())) {
+                    return aFirst;
+                }
+
+                for (auto vCursor = aFirst; vCursor + N <= aLast; ++vCursor) {
+                    if (Match(vCursor)) {
+                        return vCursor;
+                    }
+                }
+                return nullptr;
+            }
+
+            const auto vEnd = aLast - N + Anchor + 1;
+            for (auto vCursor = aFirst + Anchor; vCursor < vEnd;) {
+                auto vHit = static_cast<const uint8_t*>(memchr(vCursor, Bytes[Anchor], vEnd - vCursor));
+                if (vHit == nullptr) {
+                    break;
+                }
+
+                if (Match(vHit - Anchor)) {
+                    return vHit - Anchor;
+                }
+                vCursor = vHit + 1;
+            }
+            return nullptr;
+        }
+
+    private:
+        template<size_t... I>
+        bool MatchUnrolled(_In_ const uint8_t* aData, std::index_sequence<I...>) const {
+            return (((aData[I] & Mask[I]) == Bytes[I]) && ...);
+        }
+
+        template<size_t... I>
+        bool IsWildcard(std::index_sequence<I...>) const {
+            return ((Mask[I] == 0) && ...);
+        }
+    };
+
+    namespace details
+    {
+        constexpr int HexToInteger(char aChar) {
+            return (aChar >= '0' && aChar <= '9') ? aChar - '0'
+                : (aChar >= 'a' && aChar <= 'f') ? aChar - 'a' + 10
+                : (aChar >= 'A' && aChar <= 'F') ? aChar - 'A' + 10
+                : -1;
+        }
+
+        // Calls Visit(byte, mask) for each token of the pattern. A malformed
+        // pattern throws, which is a compile error in a constant expression.
+        template<typename Visitor>
+        constexpr void ParsePattern(const char* aPattern, Visitor&& aVisit) {
+            for (size_t i = 0; aPattern[i] != '\0';) {
+                if (aPattern[i] == ' ') {
+                    ++i;
+                }
+                else if (aPattern[i] == '?' && HexToInteger(aPattern[i + 1]) >= 0) {
+                    aVisit(static_cast<uint8_t>(HexToInteger(aPattern[i + 1])), 0x0F);
+                    i += 2;
+                }
+                else if (aPattern[i] == '?') {
+                    i += (aPattern[i + 1] == '?') ? 2 : 1;
+                    aVisit(0x00, 0x00);
+                }
+                else if (HexToInteger(aPattern[i]) >= 0 && HexToInteger(aPattern[i + 1]) >= 0) {
+                    aVisit(static_cast<uint8_t>((HexToInteger(aPattern[i]) << 4) | HexToInteger(aPattern[i + 1])), 0xFF);
+                    i += 2;
+                }
+                else if (HexToInteger(aPattern[i]) >= 0 && aPattern[i + 1] == '?') {
+                    aVisit(static_cast<uint8_t>(HexToInteger(aPattern[i]) << 4), 0xF0);
+                    i += 2;
+                }
+                else if (aPattern[i] == '[' || aPattern[i] == '{') {
+                    throw "byte sets and skips need a BytePattern";
+                }
+                else {
+                    throw "malformed signature pattern";
+                }
+            }
+        }
+
+        constexpr size_t PatternSize(const char* aPattern) {
+            size_t vSize = 0;
+            ParsePattern(aPattern, [&vSize](uint8_t, uint8_t) { ++vSize; });
+            return vSize;
+        }
+
+        template<size_t N>
+        constexpr FixedPattern<N> CompilePattern(const char* aPattern) {
+            FixedPattern<N> vPattern{};
+            size_t vSize = 0;
+            ParsePattern(aPattern, [&vPattern, &vSize](uint8_t aByte, uint8_t aMask) {
+                vPattern.Bytes[vSize] = aByte;
+                vPattern.Mask [vSize] = aMask;
+                ++vSize;
+            });
+
+            // Prefer an exact byte that is not one of the most common code bytes.
+            vPattern.Anchor = FixedPattern<N>::npos;
+            for (size_t i = 0; i < N; ++i) {
+                if (vPattern.Mask[i] != 0xFF) {
+                    continue;
+                }
+
+                const auto vByte = vPattern.Bytes[i];
+                const auto vCommon = vByte == 0x00 || vByte == 0xFF || vByte == 0xCC ||
+                    vByte == 0x90 || vByte == 0x48 || vByte == 0x8B || vByte == 0x89;
+
+                if (vPattern.Anchor == FixedPattern<N>::npos) {
+                    vPattern.Anchor = i;
+                }
+                if (!vCommon) {
+                    vPattern.Anchor = i;
+                    break;
+                }
+            }
+            return vPattern;
+        }
+
+        using FindFunction = const uint8_t* (*)(
+            const void* aPattern,
+            const uint8_t* aFirst,
+            const uint8_t* aLast);
+
+        // Runs aFind over the buffer, guarded against access faults the same
+        // way as MemorySearch.
+        void* GuardedSearch(
+            _In_bytecount_(aBytes) void* aAddress,
+            _In_ size_t aBytes,
+            _In_ FindFunction aFind,
+            _In_ const void* aPattern
+        );
+    }
+
+    template<size_t N>
+    void* MemorySearch(
+        _In_bytecount_(aBytes)  void* aAddress,
+        _In_ size_t aBytes,
+        _In_ const FixedPattern<N>& aPattern
+    ) {
+        return details::GuardedSearch(aAddress, aBytes,
+            [](const void* aPattern, const uint8_t* aFirst, const uint8_t* aLast) {
+                return static_cast<const FixedPattern<N>*>(aPattern)->Find(aFirst, aLast);
+            }, &aPattern);
+    }
+
+    inline bool BytePattern::IsValid() const {
+        return !_Bytes.empty();
+    }
+
+    inline size_t BytePattern::Size() const {
+        return _MaxSize;
+    }
+
+    inline size_t BytePattern::MinSize() const {
+        return _MinSize;
+    }
+
+    inline size_t BytePattern::HeadSize() const {
+        return _Segments.empty() ? _Bytes.size() : _Segments.front().Length;
+    }
+
+    inline const uint8_t* BytePattern::Bytes() const {
+        return _Bytes.data();
+    }
+
+    inline const uint8_t* BytePattern::Mask() const {
+        return _Mask.data();
+    }
+
+    inline bool BytePattern::Match(_In_ const uint8_t* aData) const {
+        return Match(aData, _MaxSize);
+    }
+
+    inline bool BytePattern::Match(_In_ const uint8_t* aData, _In_ size_t aAvailable) const {
+        if (!_Segments.empty() || !_Sets.empty()) {
+            return MatchComplex(aData, aAvailable);
+        }
+
+        const auto vSize = _Bytes.size();
+        if (aAvailable < vSize) {
+            return false;
+        }
+
+        for (size_t i = 0; i < vSize; ++i)
+        {
+            if ((aData[i] & _Mask[i]) != _Bytes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
 }
 
 namespace base
 {
     using memory::ModifyCode;
+    using memory::SearchEngine;
+    using memory::BytePattern;
     using memory::MemorySearch;
+    using memory::SearchMode;
+    using memory::SearchAll;
+    using memory::MemorySearchParallel;
+    using memory::MemorySearchAllParallel;
+    using memory::FixedPattern;
 }
+
+// Compiles a signature pattern at compile time into a FixedPattern.
+// See base::memory::FixedPattern.
+#define LIBBASE_PATTERN(text) \
+    (::base::memory::details::CompilePattern< \
+        ::base::memory::details::PatternSize(text)>(text))
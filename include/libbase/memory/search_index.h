@@ -0,0 +1,98 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+
+namespace base::memory
+{
+    // A 2-gram index over a buffer, for running many pattern queries against
+    // the same large image.
+    //
+    // Build() records, once, the positions of every pair of adjacent bytes.
+    // A query then looks up the rarest exact byte pair in the head of the
+    // pattern and verifies only its positions, so it costs O(candidates)
+    // instead of a pass over the whole buffer.
+    //
+    // The index costs 4 bytes per buffer byte plus a fixed 264 KB table. With
+    // a memory cap, the most frequent grams (padding, 00 00, CC CC) are left
+    // out until the index fits; a pattern made only of those is searched
+    // with a linear pass.
+    //
+    // The index refers to the buffer; it must stay mapped and unchanged. The
+    // buffer must be readable as a whole.
+    class SearchIndex
+    {
+    public:
+        SearchIndex() = default;
+
+        // Indexes the buffer. aMaxMemory caps the memory of the index in
+        // bytes (0 = no cap).
+        // Returns false if the buffer is larger than 4 GB or the cap is
+        // below the fixed table size.
+        bool Build(
+            _In_reads_bytes_(aBytes) const void* aAddress,
+            _In_ size_t aBytes,
+            _In_opt_ size_t aMaxMemory = 0
+        );
+
+        // Releases the index.
+        void Reset();
+
+        // Returns true if Build() succeeded.
+        bool IsValid() const;
+
+        // Returns the memory used by the index, in bytes.
+        size_t MemoryUsage() const;
+
+        // Returns the number of grams left out to honor the memory cap.
+        size_t DroppedGrams() const;
+
+        // Returns the first match in the buffer, or nullptr.
+        const uint8_t* Find(_In_ const BytePattern& aPattern) const;
+
+        // Returns every match in ascending address order (overlapping).
+        std::vector<const uint8_t*> FindAll(_In_ const BytePattern& aPattern) const;
+
+    private:
+        static constexpr size_t kGrams = 0x10000;
+        static constexpr size_t npos   = static_cast<size_t>(-1);
+
+        // Returns the offset in the pattern head of the indexed gram with the
+        // fewest positions, or npos if the head has none.
+        size_t SelectGram(_In_ const BytePattern& aPattern) const;
+
+        // Calls aVisit(match) for each match in ascending order until it
+        // returns false.
+        template<typename Visitor>
+        void ForEachMatch(_In_ const BytePattern& aPattern, Visitor&& aVisit) const;
+
+        const uint8_t* _Data  = nullptr;
+        size_t         _Bytes = 0;
+
+        // Positions of gram g are _Positions[_Starts[g] .. _Starts[g + 1]),
+        // ascending. A gram is keyed by its first byte | second byte << 8.
+        std::vector<uint32_t> _Starts;
+        std::vector<uint32_t> _Positions;
+
+        // Grams left out of the index.
+        std::vector<uint64_t> _Dropped;
+        size_t                _DroppedCount = 0;
+    };
+
+    inline bool SearchIndex::IsValid() const {
+        return !_Starts.empty();
+    }
+
+    inline size_t SearchIndex::DroppedGrams() const {
+        return _DroppedCount;
+    }
+}
+
+namespace base
+{
+    using memory::SearchIndex;
+}
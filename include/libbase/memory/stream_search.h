@@ -0,0 +1,87 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+
+namespace base::memory
+{
+    // Searches a pattern in a stream that arrives in arbitrary chunks (from
+    // ReadFile, a pipe or a decompressor), for sources too big to map whole.
+    //
+    // Only the last Size() - 1 bytes of the stream are kept between chunks,
+    // so matches that straddle chunk boundaries are found without copying
+    // the chunks. Hits are reported as absolute stream offsets, in order.
+    // Call Finish() after the last chunk: a pattern with a variable skip can
+    // still match in the last Size() - 1 bytes.
+    //
+    // The searcher refers to the pattern; it must outlive the searcher.
+    class StreamSearcher
+    {
+    public:
+        // Callback to report matches.
+        // offset is the stream offset of the first matched byte. cookie is the
+        // value passed to Feed().
+        // Returns true to continue the search.
+        using MatchFunction = bool (*)(
+            uint64_t offset,
+            PVOID cookie);
+
+        explicit StreamSearcher(
+            _In_ const BytePattern& aPattern,
+            _In_opt_ SearchMode aMode = SearchMode::Overlapping);
+
+        StreamSearcher(const StreamSearcher&) = delete;
+        StreamSearcher& operator=(const StreamSearcher&) = delete;
+
+        // Searches the next chunk of the stream.
+        // Returns false if the callback stopped the search.
+        bool Feed(
+            _In_reads_bytes_(aBytes) const void* aData,
+            _In_ size_t aBytes,
+            _In_ MatchFunction aCallback,
+            _In_opt_ PVOID aCookie
+        );
+
+        // Reports the matches that start in the last Size() - 1 bytes of the
+        // stream. Call once after the last Feed().
+        // Returns false if the callback stopped the search.
+        bool Finish(
+            _In_ MatchFunction aCallback,
+            _In_opt_ PVOID aCookie
+        );
+
+        // Returns the number of bytes fed so far.
+        uint64_t Offset() const;
+
+        // Forgets the stream, to search a new one.
+        void Reset();
+
+    private:
+        bool Report(
+            _In_ uint64_t aOffset,
+            _In_ MatchFunction aCallback,
+            _In_opt_ PVOID aCookie
+        );
+
+        const BytePattern*   _Pattern;
+        SearchMode           _Mode;
+        uint64_t             _Offset   = 0;
+        uint64_t             _NextHit  = 0;
+
+        // The last (up to) Size() - 1 bytes of the stream.
+        std::vector<uint8_t> _Tail;
+    };
+
+    inline uint64_t StreamSearcher::Offset() const {
+        return _Offset;
+    }
+}
+
+namespace base
+{
+    using memory::StreamSearcher;
+}
@@ -0,0 +1,103 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace base::modules
+{
+    // A hash index of the named exports of a PE, for resolving many symbols
+    // against the same module.
+    //
+    // PEImage::GetProcOrdinal binary-searches the export name table, paying
+    // O(log n) string compares and RVA translations per lookup. Build()
+    // walks the name table once into a flat open-addressing table with the
+    // hash of each name stored next to it; a lookup then costs one hash and,
+    // almost always, one string compare.
+    //
+    // Names are copied into the index, so it does not refer to the image
+    // after Build() returns.
+    class ExportIndex
+    {
+    public:
+        // A resolved export.
+        struct Export
+        {
+            WORD  Ordinal   = 0;        // Biased by the export base, as GetProcOrdinal.
+            DWORD RVA       = 0;        // Of the function, or of the forward string.
+            bool  Forwarded = false;
+        };
+
+        ExportIndex() = default;
+
+        // Indexes the named exports of the image.
+        // Returns false if the image has no export directory.
+        bool Build(_In_ const PEImage& image);
+
+        // Releases the index.
+        void Reset();
+
+        // Returns true if Build() succeeded.
+        bool IsValid() const;
+
+        // Returns the number of names indexed.
+        size_t Size() const;
+
+        // Looks up a name. Ordinals (see PEImage::IsOrdinal) are resolved
+        // through the function table.
+        // Returns false if the module has no such export.
+        bool Resolve(_In_ LPCSTR name, _Out_ Export* result) const;
+
+        // Resolves count names into results. Missing exports are left as
+        // Export{}.
+        // Returns the number of names resolved.
+        size_t ResolveMany(
+            _In_reads_(count) const LPCSTR* names,
+            _In_ size_t count,
+            _Out_writes_(count) Export* results
+        ) const;
+
+    private:
+        struct Slot
+        {
+            uint64_t Hash;
+            uint32_t Name;      // Offset of the name in _Names; npos if empty.
+            uint32_t Length;
+            Export   Value;
+        };
+
+        static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+        static uint64_t HashName(_In_reads_(length) const char* name, _In_ size_t length);
+
+        bool Find(_In_ uint64_t hash, _In_ LPCSTR name, _In_ size_t length, _Out_ Export* result) const;
+        bool ResolveOrdinal(_In_ WORD ordinal, _Out_ Export* result) const;
+
+        std::vector<Slot> _Slots;   // Power of two, at most half full.
+        std::string       _Names;   // Zero-terminated names, back to back.
+        size_t            _Count = 0;
+
+        // The function table, for ordinal lookups.
+        std::vector<DWORD> _Functions;
+        DWORD _Base = 0;
+        DWORD _DirectoryRVA  = 0;
+        DWORD _DirectorySize = 0;
+    };
+
+    inline bool ExportIndex::IsValid() const {
+        return !_Slots.empty();
+    }
+
+    inline size_t ExportIndex::Size() const {
+        return _Count;
+    }
+}
+
+namespace base
+{
+    using modules::ExportIndex;
+}
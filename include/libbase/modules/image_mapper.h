@@ -0,0 +1,125 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <filesystem>
+#include <vector>
+
+
+namespace base::modules
+{
+    // A PE file laid out in private memory as the loader would lay it out,
+    // for emulation and offline analysis: the headers and the raw data of
+    // each section are read to their RVAs in a region of SizeOfImage bytes,
+    // and the rest of the region (uninitialized data, alignment) is zero.
+    //
+    // The Windows loader is not involved: no code of the image runs, no
+    // dependency is loaded and nothing is registered with the process. The
+    // remaining steps of loading are left to the caller and done on request,
+    // in this order:
+    //
+    //   Relocate()        rebases the image to the address it is mapped at.
+    //   ResolveImports()  fills the import address table through the import
+    //                     resolvers added with AddImportResolver().
+    //   Protect()         gives each section the protection its
+    //                     characteristics ask for; the headers become
+    //                     read-only.
+    //
+    // Off Windows the region is mapped with mmap, and the whole pages of a
+    // section whose raw data is page-aligned in the file are mapped
+    // copy-on-write from the file instead of read; the file must then not
+    // be truncated while the image is mapped.
+    //
+    // Map() only accepts images of the bitness PEImage is built for.
+    // RVAToAddr returns NULL for an RVA outside the region.
+    //
+    // This class is not thread-safe.
+    class ImageMapper : public PEImage
+    {
+    public:
+        // Callback to resolve an import.
+        // Sets address to the value to store in the import address table
+        // slot. cookie is the value passed to AddImportResolver.
+        // Returns false if the resolver does not know the import.
+        using ImportResolver = bool (*)(
+            const ImageMapper& image,
+            const ImportEntry& import,
+            ULONGLONG* address,
+            PVOID cookie);
+
+        ImageMapper() : PEImage(static_cast<HMODULE>(nullptr)) {}
+        ~ImageMapper() override;
+
+        ImageMapper(const ImageMapper&) = delete;
+        ImageMapper& operator=(const ImageMapper&) = delete;
+
+        // Reads the file into a new region, replacing the image mapped
+        // before.
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful,
+        // ERROR_BAD_EXE_FORMAT if the file is not a PE file of the native
+        // bitness or its sections do not fit SizeOfImage.
+        DWORD Map(_In_ const std::filesystem::path& file_name);
+
+        // Releases the region. It is safe to call Unmap repeatedly.
+        void Unmap();
+
+        // Returns true if an image is mapped.
+        bool IsValid() const;
+
+        // Returns the size of the region, SizeOfImage.
+        size_t Size() const;
+
+        // Applies the base relocations for the address the image is mapped
+        // at. See ApplyRelocations.
+        DWORD Relocate();
+
+        // Adds a resolver to the end of the list ResolveImports() consults.
+        void AddImportResolver(_In_ ImportResolver resolver, _In_opt_ PVOID cookie);
+
+        // Asks the resolvers, in the order they were added, for each import
+        // until one resolves it. Delay-load imports are left as they are.
+        // Returns: Windows error code (winerror.h). NO_ERROR if every
+        // import was resolved, ERROR_PROC_NOT_FOUND if one was not; the
+        // imports resolved before it are kept.
+        DWORD ResolveImports();
+
+        // Sets the protection of the headers and of each section.
+        // Images whose SectionAlignment is smaller than a page have
+        // sections sharing pages; they are made PAGE_EXECUTE_READWRITE as a
+        // whole, as the loader does.
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful.
+        DWORD Protect();
+
+        using PEImage::RVAToAddr;
+        PVOID RVAToAddr(_In_ size_t rva) const override;
+
+    protected:
+        size_t GetReadableSize(_In_ const void* address) const override;
+
+    private:
+        struct Resolver
+        {
+            ImportResolver Function;
+            PVOID          Cookie;
+        };
+
+        PBYTE  _Region = nullptr;
+        size_t _Size   = 0;
+
+        std::vector<Resolver> _Resolvers;
+    };
+
+    inline bool ImageMapper::IsValid() const {
+        return _Region != nullptr;
+    }
+
+    inline size_t ImageMapper::Size() const {
+        return _Size;
+    }
+}
+
+namespace base
+{
+    using modules::ImageMapper;
+}
@@ -0,0 +1,133 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+namespace base::modules
+{
+    // The PE files found by PECorpusScanner, stored column by column: one
+    // vector per field, all the vectors of a table the same length. A file
+    // refers to its sections and imported modules as a run of rows in those
+    // tables (first_*, *_count). Strings are offsets into strings, where
+    // they are stored zero terminated, paths in UTF-8; module and section
+    // names are stored once.
+    struct PECorpusSummary
+    {
+        // Set in flags when the file has valid PE32 or PE32+ headers and the
+        // imports, exports and debug directory were read.
+        static constexpr uint8_t kParsed = 0x01;
+        // Set in flags when debug_guid and debug_age come from a CodeView
+        // (RSDS) debug record.
+        static constexpr uint8_t kHasDebugId = 0x02;
+
+        // Files.
+        std::vector<uint32_t> path;
+        std::vector<uint64_t> file_size;
+        std::vector<int64_t>  last_write_time;  // std::filesystem::file_time_type ticks.
+        std::vector<WORD>     machine;
+        std::vector<DWORD>    time_date_stamp;
+        std::vector<uint8_t>  flags;
+        std::vector<uint32_t> first_section;
+        std::vector<WORD>     section_count;
+        std::vector<uint32_t> first_import;
+        std::vector<uint32_t> import_count;
+        std::vector<uint32_t> export_count;
+        std::vector<GUID>     debug_guid;
+        std::vector<DWORD>    debug_age;
+
+        // Sections.
+        std::vector<uint32_t> section_name;
+        std::vector<DWORD>    section_rva;
+        std::vector<DWORD>    section_size;
+        std::vector<DWORD>    section_characteristics;
+
+        // Imported modules.
+        std::vector<uint32_t> import_module;
+        std::vector<uint32_t> import_functions;
+
+        std::string strings;
+
+        // Returns the number of files.
+        size_t Size() const;
+
+        // Returns the string at offset.
+        LPCSTR String(_In_ uint32_t offset) const;
+
+        void Clear();
+    };
+
+    // Counters of a PECorpusScanner::Scan.
+    struct PECorpusStats
+    {
+        uint64_t files  = 0;    // Regular files visited.
+        uint64_t images = 0;    // PE files among them.
+        uint64_t bytes  = 0;    // Bytes mapped.
+        uint64_t errors = 0;    // Files or directories that could not be opened.
+        double   seconds = 0;
+
+        double FilesPerSecond() const;
+    };
+
+    // Inventories the PE files under a set of directories.
+    //
+    // Directories are walked in parallel by a pool of threads. Each thread
+    // keeps a deque of pending directories: it pushes the subdirectories of
+    // the one it lists onto the back of its own deque and takes work from
+    // the back, depth first, and an idle thread steals from the front of
+    // another's. Files are scanned by the thread listing them, and only
+    // queued while another thread is idle, so the pending work is bounded
+    // by the directories being walked rather than by the files of the
+    // corpus. Each file is mapped read-only, parsed through a PEView and
+    // unmapped before the next; what is kept is its row in the summary.
+    //
+    // Symbolic links and junctions are not followed.
+    class PECorpusScanner
+    {
+    public:
+        // threads is the size of the pool; 0 uses one thread per processor.
+        explicit PECorpusScanner(_In_opt_ size_t threads = 0);
+
+        PECorpusScanner(const PECorpusScanner&) = delete;
+        PECorpusScanner& operator=(const PECorpusScanner&) = delete;
+
+        // Replaces the content of summary with the PE files found under the
+        // roots; a root may also be a file. Files that are not PE files are
+        // counted in stats but not summarized. Rows are in no particular
+        // order.
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful,
+        // even if some files could not be opened (see PECorpusStats::errors).
+        DWORD Scan(
+            _In_ const std::vector<std::filesystem::path>& roots,
+            _Out_ PECorpusSummary* summary,
+            _Out_opt_ PECorpusStats* stats = nullptr
+        );
+
+    private:
+        size_t _Threads;
+    };
+
+    inline size_t PECorpusSummary::Size() const {
+        return path.size();
+    }
+
+    inline LPCSTR PECorpusSummary::String(_In_ uint32_t offset) const {
+        return strings.c_str() + offset;
+    }
+
+    inline double PECorpusStats::FilesPerSecond() const {
+        return seconds > 0 ? files / seconds : 0;
+    }
+}
+
+namespace base
+{
+    using modules::PECorpusSummary;
+    using modules::PECorpusStats;
+    using modules::PECorpusScanner;
+}
@@ -0,0 +1,65 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <filesystem>
+
+
+namespace base::modules
+{
+    // A PE file mapped read-only as data, for offline analysis of files that
+    // are never loaded: nothing is copied and the Windows loader is not
+    // involved.
+    //
+    // The headers and the section table are checked against the file size
+    // when the file is opened. RVAToAddr translates through the section
+    // table to file offsets (see ImageRVAToOnDiskOffset) and returns NULL for
+    // an RVA that is not backed by raw data inside the file. Everything the
+    // accessors and enumerators of PEImage read is checked with IsReadable
+    // against the end of the file, so a truncated or hostile file is safe
+    // to enumerate.
+    class PEFile : public PEImageAsData
+    {
+    public:
+        PEFile() : PEImageAsData(nullptr) {}
+
+        PEFile(const PEFile&) = delete;
+        PEFile& operator=(const PEFile&) = delete;
+
+        // Maps the file and validates its headers.
+        // Returns false if the file cannot be mapped or is not a PE file.
+        bool Initialize(_In_ const std::filesystem::path& file_name);
+
+        // Unmaps the file.
+        void Close();
+
+        // Returns true if a valid PE file is mapped.
+        bool IsValid() const;
+
+        // Returns the mapping of the whole file.
+        const files::MemoryMappedFile& File() const;
+
+        using PEImageAsData::RVAToAddr;
+        PVOID RVAToAddr(_In_ size_t rva) const override;
+
+    protected:
+        size_t GetReadableSize(_In_ const void* address) const override;
+
+    private:
+        files::MemoryMappedFile _File;
+    };
+
+    inline bool PEFile::IsValid() const {
+        return _File.IsValid();
+    }
+
+    inline const files::MemoryMappedFile& PEFile::File() const {
+        return _File;
+    }
+}
+
+namespace base
+{
+    using modules::PEFile;
+}
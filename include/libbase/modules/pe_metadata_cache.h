@@ -0,0 +1,222 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace base::modules
+{
+    // A persistent store of the metadata of many PE files (sections, import
+    // chunks, exports, relocation counts), so that a restart does not parse
+    // unchanged binaries again.
+    //
+    // The store file is a header followed by flat arrays of fixed-size
+    // records (images, sections, import chunks, imports, exports) and a
+    // string table. Load() maps it and checks the header and the sizes of
+    // the arrays; Find() binary-searches the image array in place and hands
+    // out an Image that reads its records straight from the mapping. Nothing
+    // is deserialized.
+    //
+    // An image is keyed by its path, file size, last write time and a hash
+    // of the first page of the file, which holds the headers. A file that
+    // changed in any of them is not found. The store is versioned: a file
+    // written by another version is ignored by Load().
+    //
+    // Add() parses a file through a PEView and stages it; Save() writes the
+    // mapped images that were not staged again and the staged ones to a new
+    // store file. PE32 and PE32+ files are added alike, whatever the
+    // build's architecture; Machine tells them apart.
+    //
+    // This class is not thread-safe.
+    class PEMetadataCache
+    {
+        struct Tables;
+
+    public:
+        static constexpr uint32_t kNoString = 0xFFFFFFFF;
+
+        struct ImageRecord
+        {
+            uint64_t PathHash;
+            uint64_t FileSize;
+            int64_t  LastWriteTime;     // std::filesystem::file_time_type ticks.
+            uint64_t HeadersHash;
+            uint32_t Path;
+            DWORD    TimeDateStamp;
+            DWORD    SizeOfImage;
+            WORD     Machine;
+            WORD     Reserved;
+            uint32_t FirstSection;
+            uint32_t NumberOfSections;
+            uint32_t FirstImportChunk;
+            uint32_t NumberOfImportChunks;
+            uint32_t FirstExport;
+            uint32_t NumberOfExports;
+            uint32_t NumberOfRelocations;   // Not counting IMAGE_REL_BASED_ABSOLUTE.
+            uint32_t Reserved2;
+        };
+
+        struct SectionRecord
+        {
+            BYTE  Name[IMAGE_SIZEOF_SHORT_NAME];
+            DWORD VirtualAddress;
+            DWORD VirtualSize;
+            DWORD SizeOfRawData;
+            DWORD Characteristics;
+        };
+
+        // The imports of one module.
+        struct ImportChunkRecord
+        {
+            uint32_t Module;
+            uint32_t FirstImport;
+            uint32_t NumberOfImports;
+        };
+
+        struct ImportRecord
+        {
+            uint32_t Name;      // kNoString for an import by ordinal.
+            WORD     Ordinal;
+            WORD     Hint;
+        };
+
+        struct ExportRecord
+        {
+            uint32_t Name;      // kNoString for an export by ordinal.
+            DWORD    Ordinal;
+            DWORD    FunctionRVA;   // 0 for a forwarded export.
+            uint32_t Forward;   // kNoString unless forwarded.
+        };
+
+        // A run of records.
+        template<typename T>
+        struct Table
+        {
+            const T* Data = nullptr;
+            size_t   Size = 0;
+
+            const T* begin() const { return Data; }
+            const T* end() const { return Data + Size; }
+
+            const T& operator[](size_t index) const { return Data[index]; }
+        };
+
+        // A cached image. It refers to the cache and is valid until the
+        // next Load(), Add() or Save().
+        class Image
+        {
+        public:
+            Image() = default;
+
+            const ImageRecord& Record() const;
+
+            Table<SectionRecord>     Sections() const;
+            Table<ImportChunkRecord> ImportChunks() const;
+            Table<ImportRecord>      Imports(_In_ const ImportChunkRecord& chunk) const;
+            Table<ExportRecord>      Exports() const;
+
+            // Returns the string at offset, or NULL for kNoString.
+            LPCSTR String(_In_ uint32_t offset) const;
+
+        private:
+            friend class PEMetadataCache;
+
+            const Tables*      _Tables = nullptr;
+            const ImageRecord* _Record = nullptr;
+        };
+
+        PEMetadataCache() = default;
+
+        PEMetadataCache(const PEMetadataCache&) = delete;
+        PEMetadataCache& operator=(const PEMetadataCache&) = delete;
+
+        // Maps a store file written by Save().
+        // Returns false if the file is missing, corrupt or of another
+        // version.
+        bool Load(_In_ const std::filesystem::path& file_name);
+
+        // Parses a PE file and stages its metadata, replacing what the
+        // store has for the same path.
+        // Returns false if the file cannot be read or is not a PE32 or PE32+
+        // file.
+        bool Add(_In_ const std::filesystem::path& file_name);
+
+        // Writes the mapped and the staged images to a store file, then maps
+        // it as Load() does; nothing stays staged.
+        // Returns true on success.
+        bool Save(_In_ const std::filesystem::path& file_name);
+
+        // Looks up a file, checking its size, last write time and headers
+        // against the store.
+        // Returns false if the file is not in the store or has changed.
+        bool Find(_In_ const std::filesystem::path& file_name, _Out_ Image* image) const;
+
+    private:
+        // The arrays of the store file, mapped or staged.
+        struct Tables
+        {
+            Table<ImageRecord>       Images;
+            Table<SectionRecord>     Sections;
+            Table<ImportChunkRecord> ImportChunks;
+            Table<ImportRecord>      Imports;
+            Table<ExportRecord>      Exports;
+            Table<char>              Strings;
+        };
+
+        // Staged images, in the layout of the store file.
+        struct Staged
+        {
+            std::vector<ImageRecord>       Images;
+            std::vector<SectionRecord>     Sections;
+            std::vector<ImportChunkRecord> ImportChunks;
+            std::vector<ImportRecord>      Imports;
+            std::vector<ExportRecord>      Exports;
+            std::string                    Strings;
+
+            // Names repeat across images (modules, imports, sections);
+            // each is stored once.
+            std::unordered_map<std::string, uint32_t> Interned;
+
+            uint32_t AddString(_In_ std::string_view value);
+            uint32_t InternString(_In_ std::string_view value);
+
+            // Copies an image and its records from tables.
+            void Append(_In_ const Tables& tables, _In_ const ImageRecord& image);
+
+            Tables View() const;
+        };
+
+        // Returns true if the string and the runs of records of image are
+        // inside tables.
+        static bool IsInside(_In_ const Tables& tables, _In_ const ImageRecord& image);
+
+        // Returns true if record is an image of tables that has the path and
+        // the identity of key, and whose records are inside tables.
+        static bool Matches(
+            _In_ const Tables& tables,
+            _In_ const ImageRecord& record,
+            _In_ const ImageRecord& key,
+            _In_ std::string_view path);
+
+        files::MemoryMappedFile _File;
+        Tables                  _Mapped;
+
+        Staged                  _Staged;
+        Tables                  _StagedView;
+    };
+
+    inline const PEMetadataCache::ImageRecord& PEMetadataCache::Image::Record() const {
+        return *_Record;
+    }
+}
+
+namespace base
+{
+    using modules::PEMetadataCache;
+}
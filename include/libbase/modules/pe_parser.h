@@ -5,11 +5,23 @@
 // refs: https://chromium.googlesource.com/chromium/chromium/+/refs/heads/main/base/win/pe_image.h
 
 #pragma once
-#include <delayimp.h>
+#ifdef _WIN32
+#   include <delayimp.h>
+#endif
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <vector>
 
 
 namespace base::modules
 {
+    class PESectionRange;
+    class PEExportRange;
+    class PEImportRange;
+    class PEDelayImportRange;
+    class PERelocRange;
+
     // This class is a wrapper for the Portable Executable File Format (PE).
     // It's main purpose is to provide an easy way to work with imports and exports
     // from a file, mapped in memory as image.
@@ -82,6 +94,41 @@ namespace base::modules
             PVOID address,
             PVOID cookie);
 
+        // A section, as reported by EnumSections.
+        struct SectionEntry
+        {
+            PIMAGE_SECTION_HEADER header        = nullptr;
+            PVOID                 section_start = nullptr;
+            DWORD                 section_size  = 0;
+        };
+
+        // An export, as reported by EnumExports.
+        struct ExportEntry
+        {
+            DWORD  ordinal  = 0;
+            DWORD  hint     = 0;
+            LPCSTR name     = nullptr;
+            PVOID  function = nullptr;
+            LPCSTR forward  = nullptr;
+        };
+
+        // An import or delay import, as reported by EnumAllImports.
+        struct ImportEntry
+        {
+            LPCSTR            module  = nullptr;
+            DWORD             ordinal = 0;
+            LPCSTR            name    = nullptr;
+            DWORD             hint    = 0;
+            PIMAGE_THUNK_DATA iat     = nullptr;
+        };
+
+        // A relocation, as reported by EnumRelocs.
+        struct RelocEntry
+        {
+            WORD  type    = 0;
+            PVOID address = nullptr;
+        };
+
         explicit PEImage(HMODULE module)
             : _Module(module) {
             //
@@ -91,6 +138,16 @@ namespace base::modules
             _Module = reinterpret_cast<HMODULE>(const_cast<void*>(module));
         }
 
+        // The section table is not copied; the copy builds its own.
+        PEImage(const PEImage& other)
+            : _Module(other._Module) {
+            //
+        }
+
+        PEImage& operator=(const PEImage& other);
+
+        virtual ~PEImage();
+
         // Gets the HMODULE for this object.
         HMODULE Module() const;
         // Sets this object's HMODULE.
@@ -146,14 +203,23 @@ namespace base::modules
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
         bool EnumSections(_In_ EnumSectionsFunction callback, _In_opt_ PVOID cookie) const;
+        // Returns the PE sections as a range.
+        // Use: for (const auto& entry : image.Sections()) { ... }
+        PESectionRange Sections() const;
         // Enumerates PE exports.
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
         bool EnumExports(_In_ EnumExportsFunction callback, _In_opt_ PVOID cookie) const;
+        // Returns the PE exports as a range, in the order of EnumExports.
+        // Use: for (const auto& entry : image.Exports()) { ... }
+        PEExportRange Exports() const;
         // Enumerates PE imports.
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
         bool EnumAllImports(_In_ EnumImportsFunction callback, _In_opt_ PVOID cookie) const;
+        // Returns the PE imports as a range, in the order of EnumAllImports.
+        // Import blocks without a name table are skipped.
+        PEImportRange Imports() const;
         // Enumerates PE import blocks.
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
@@ -171,6 +237,9 @@ namespace base::modules
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
         bool EnumAllDelayImports(_In_ EnumImportsFunction callback, _In_opt_ PVOID cookie) const;
+        // Returns the PE delay imports as a range, in the order of
+        // EnumAllDelayImports. Blocks without a name table are skipped.
+        PEDelayImportRange DelayImports() const;
         // Enumerates PE delay import blocks.
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
@@ -191,11 +260,27 @@ namespace base::modules
         // cookie is a generic cookie to pass to the callback.
         // Returns true on success.
         bool EnumRelocs(_In_ EnumRelocsFunction callback, _In_opt_ PVOID cookie) const;
+        // Returns the PE relocation entries as a range. The walk stops at the
+        // end of the relocation directory or at a malformed block.
+        PERelocRange Relocs() const;
         // Verifies the magic values on the PE file.
         // Returns true if all values are correct.
         bool VerifyMagic() const;
         // Converts an rva value to the appropriate address.
         virtual PVOID RVAToAddr(_In_ size_t rva) const;
+        // Converts an rva value to the address of size bytes.
+        // Returns NULL unless all of them can be read (see IsReadable).
+        PVOID RVAToAddr(_In_ size_t rva, _In_ size_t size) const;
+        // Converts an rva value to the address of a zero terminated string.
+        // Returns NULL unless the string ends within the readable bytes.
+        LPCSTR RVAToString(_In_ size_t rva) const;
+        // Returns true if size bytes at address, an address returned by
+        // RVAToAddr, can be read. An image in memory is trusted; images
+        // over a buffer of known size, like PEFile, bound the address by it.
+        bool IsReadable(_In_opt_ const void* address, _In_ size_t size) const;
+        // Returns true if string is zero terminated within the readable
+        // bytes.
+        bool IsString(_In_opt_ LPCSTR string) const;
         // Converts an rva value to an offset on disk.
         // Returns true on success.
         bool ImageRVAToOnDiskOffset(_In_ size_t rva, _Out_ DWORD* on_disk_offset) const;
@@ -203,8 +288,20 @@ namespace base::modules
         // Returns true on success.
         bool ImageAddrToOnDiskOffset(_In_ LPVOID address, _Out_ DWORD* on_disk_offset) const;
 
+    protected:
+        // Returns the number of bytes that can be read at address, SIZE_MAX
+        // if the image is not bounded.
+        virtual size_t GetReadableSize(_In_ const void* address) const;
+
     private:
+        // The sections sorted by address, built on first use.
+        struct SectionTable;
+
+        const SectionTable* GetSectionTable() const;
+        void ResetSectionTable();
+
         HMODULE _Module;
+        mutable std::atomic<const SectionTable*> _SectionTable{ nullptr };
     };
 
     // This class is an extension to the PEImage class that allows working with PE
@@ -213,15 +310,604 @@ namespace base::modules
     {
     public:
         explicit PEImageAsData(HMODULE hModule) : PEImage(hModule) {}
+        using PEImage::RVAToAddr;
         virtual PVOID RVAToAddr(_In_ size_t rva) const;
     };
 
+    // The exports of a PE, by function index.
+    //
+    // The name of each function is looked up in an inverse ordinal table,
+    // built in one pass over the name table when the range is created, so a
+    // full enumeration is O(functions + names). The table lives inside the
+    // range for up to kInlineFunctions functions and on the heap beyond.
+    // Only the first 0x10000 functions, the ones an ordinal can reach, are
+    // enumerated, and an export table that is not inside the image is
+    // treated as empty.
+    //
+    // The range refers to the image; it must outlive the range.
+    class PEExportRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = PEImage::ExportEntry;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const PEImage::ExportEntry*;
+            using reference         = const PEImage::ExportEntry&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Entry;
+            }
+
+            pointer operator->() const {
+                return &_Entry;
+            }
+
+            iterator& operator++() {
+                _Index = _Range->Next(_Index + 1, &_Entry);
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const {
+                return _Index == other._Index;
+            }
+
+            bool operator!=(const iterator& other) const {
+                return _Index != other._Index;
+            }
+
+        private:
+            friend class PEExportRange;
+
+            iterator(const PEExportRange* range, DWORD index)
+                : _Range(range), _Index(index) {
+                //
+            }
+
+            const PEExportRange*  _Range = nullptr;
+            DWORD                 _Index = 0;
+            PEImage::ExportEntry  _Entry;
+        };
+
+        explicit PEExportRange(_In_ const PEImage& image);
+
+        // The inverse ordinal table may point into the range itself.
+        PEExportRange(const PEExportRange&) = delete;
+        PEExportRange& operator=(const PEExportRange&) = delete;
+
+        iterator begin() const {
+            iterator first(this, 0);
+            first._Index = Next(0, &first._Entry);
+            return first;
+        }
+
+        iterator end() const {
+            return iterator(this, _NumFunctions);
+        }
+
+    private:
+        static constexpr size_t kInlineFunctions = 512;
+        static constexpr DWORD  kNoName = 0xFFFFFFFF;
+
+        // Returns the index of the first export at or after index, filling
+        // entry, or _NumFunctions if there is none.
+        DWORD Next(_In_ DWORD index, _Out_ PEImage::ExportEntry* entry) const;
+
+        const PEImage& _Image;
+
+        char*  _Directory     = nullptr;
+        DWORD  _DirectorySize = 0;
+        DWORD  _OrdinalBase   = 0;
+        DWORD  _NumFunctions  = 0;
+        PDWORD _Functions     = nullptr;
+        PDWORD _Names         = nullptr;
+
+        // Index in _Names of the first name of each function, or kNoName.
+        DWORD* _NameOf = nullptr;
+        DWORD  _InlineNameOf[kInlineFunctions];
+        std::unique_ptr<DWORD[]> _HeapNameOf;
+    };
+
+    // The ranges below walk a table of a PE in place: the iterator holds the
+    // position and the current entry, and incrementing decodes the next
+    // entry. Nothing is allocated and there is no callback, so a for loop
+    // over a range compiles to a plain loop and can stop with break.
+    //
+    // A range refers to the image; it must outlive the range.
+
+    class PESectionRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = PEImage::SectionEntry;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const PEImage::SectionEntry*;
+            using reference         = const PEImage::SectionEntry&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Entry;
+            }
+
+            pointer operator->() const {
+                return &_Entry;
+            }
+
+            iterator& operator++() {
+                ++_Index;
+                Load();
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const {
+                return _Index == other._Index;
+            }
+
+            bool operator!=(const iterator& other) const {
+                return _Index != other._Index;
+            }
+
+        private:
+            friend class PESectionRange;
+
+            iterator(const PEImage* image, UINT index, UINT count)
+                : _Image(image), _Index(index), _Count(count) {
+                Load();
+            }
+
+            void Load() {
+                if (_Index < _Count) {
+                    PIMAGE_SECTION_HEADER header = _Image->GetSectionHeader(_Index);
+                    _Entry = { header, _Image->RVAToAddr(header->VirtualAddress), header->Misc.VirtualSize };
+                }
+            }
+
+            const PEImage*         _Image = nullptr;
+            UINT                   _Index = 0;
+            UINT                   _Count = 0;
+            PEImage::SectionEntry  _Entry;
+        };
+
+        explicit PESectionRange(_In_ const PEImage& image)
+            : _Image(&image), _Count(image.GetNumSections()) {
+            //
+        }
+
+        iterator begin() const {
+            return iterator(_Image, 0, _Count);
+        }
+
+        iterator end() const {
+            return iterator(_Image, _Count, _Count);
+        }
+
+    private:
+        const PEImage* _Image;
+        UINT           _Count;
+    };
+
+    class PEImportRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = PEImage::ImportEntry;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const PEImage::ImportEntry*;
+            using reference         = const PEImage::ImportEntry&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Entry;
+            }
+
+            pointer operator->() const {
+                return &_Entry;
+            }
+
+            iterator& operator++() {
+                ++_NameTable;
+                ++_Entry.iat;
+                Find();
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const {
+                return _NameTable == other._NameTable;
+            }
+
+            bool operator!=(const iterator& other) const {
+                return _NameTable != other._NameTable;
+            }
+
+        private:
+            friend class PEImportRange;
+
+            iterator(const PEImage* image, PIMAGE_IMPORT_DESCRIPTOR descriptor)
+                : _Image(image), _Descriptor(descriptor) {
+                EnterChunk();
+                Find();
+            }
+
+            // Moves to the first import at or after _NameTable that can be
+            // decoded, entering the next blocks at the end of this one.
+            void Find() {
+                while (_NameTable) {
+                    if (!_Image->IsReadable(_NameTable, sizeof(*_NameTable)) || !_NameTable->u1.Ordinal) {
+                        ++_Descriptor;
+                        EnterChunk();
+                    }
+                    else if (Load()) {
+                        return;
+                    }
+                    else {
+                        ++_NameTable;
+                        ++_Entry.iat;
+                    }
+                }
+            }
+
+            // Moves to the name table of the current block or of the next
+            // block that has one.
+            void EnterChunk() {
+                for (; _Image->IsReadable(_Descriptor, sizeof(*_Descriptor)) && _Descriptor->FirstThunk; ++_Descriptor) {
+                    _NameTable = reinterpret_cast<PIMAGE_THUNK_DATA>(
+                        _Image->RVAToAddr(_Descriptor->OriginalFirstThunk, sizeof(IMAGE_THUNK_DATA)));
+                    if (_NameTable && _NameTable->u1.Ordinal) {
+                        _Entry.module = _Image->RVAToString(_Descriptor->Name);
+                        _Entry.iat    = reinterpret_cast<PIMAGE_THUNK_DATA>(
+                            _Image->RVAToAddr(_Descriptor->FirstThunk, sizeof(IMAGE_THUNK_DATA)));
+                        return;
+                    }
+                }
+                _NameTable = nullptr;
+            }
+
+            // Returns false for an import whose name cannot be read.
+            bool Load() {
+                if (IMAGE_SNAP_BY_ORDINAL(_NameTable->u1.Ordinal)) {
+                    _Entry.ordinal = static_cast<WORD>(IMAGE_ORDINAL32(_NameTable->u1.Ordinal));
+                    _Entry.name    = nullptr;
+                    _Entry.hint    = 0;
+                    return true;
+                }
+
+                auto import = reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(
+                    _Image->RVAToAddr(_NameTable->u1.ForwarderString, sizeof(WORD)));
+                if (!import || !_Image->IsString(reinterpret_cast<LPCSTR>(&import->Name))) {
+                    return false;
+                }
+                _Entry.ordinal = 0;
+                _Entry.name    = reinterpret_cast<LPCSTR>(&import->Name);
+                _Entry.hint    = import->Hint;
+                return true;
+            }
+
+            const PEImage*           _Image      = nullptr;
+            PIMAGE_IMPORT_DESCRIPTOR _Descriptor = nullptr;
+            PIMAGE_THUNK_DATA        _NameTable  = nullptr;
+            PEImage::ImportEntry     _Entry;
+        };
+
+        explicit PEImportRange(_In_ const PEImage& image)
+            : _Image(&image) {
+            if (image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_IMPORT) >= sizeof(IMAGE_IMPORT_DESCRIPTOR)) {
+                _First = image.GetFirstImportChunk();
+            }
+        }
+
+        iterator begin() const {
+            return iterator(_Image, _First);
+        }
+
+        iterator end() const {
+            return iterator(_Image, nullptr);
+        }
+
+    private:
+        const PEImage*           _Image;
+        PIMAGE_IMPORT_DESCRIPTOR _First = nullptr;
+    };
+
+    class PEDelayImportRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = PEImage::ImportEntry;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const PEImage::ImportEntry*;
+            using reference         = const PEImage::ImportEntry&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Entry;
+            }
+
+            pointer operator->() const {
+                return &_Entry;
+            }
+
+            iterator& operator++() {
+                ++_NameTable;
+                ++_Entry.iat;
+                Find();
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const {
+                return _NameTable == other._NameTable;
+            }
+
+            bool operator!=(const iterator& other) const {
+                return _NameTable != other._NameTable;
+            }
+
+        private:
+            friend class PEDelayImportRange;
+
+            iterator(const PEImage* image, PImgDelayDescr descriptor)
+                : _Image(image), _Descriptor(descriptor) {
+                EnterChunk();
+                Find();
+            }
+
+            // VC7-style descriptors hold RVAs, VC6-style ones addresses.
+            PVOID ToAddr(_In_ DWORD value) const {
+                if (_Descriptor->grAttrs & dlattrRva) {
+                    return _Image->RVAToAddr(value);
+                }
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4312)
+#endif
+                // This cast generates a warning because it is 32 bit specific.
+                return reinterpret_cast<PVOID>(static_cast<size_t>(value));
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+            }
+
+            // Moves to the first import at or after _NameTable that can be
+            // decoded, entering the next blocks at the end of this one.
+            void Find() {
+                while (_NameTable) {
+                    if (!_Image->IsReadable(_NameTable, sizeof(*_NameTable)) || !_NameTable->u1.Ordinal) {
+                        ++_Descriptor;
+                        EnterChunk();
+                    }
+                    else if (Load()) {
+                        return;
+                    }
+                    else {
+                        ++_NameTable;
+                        ++_Entry.iat;
+                    }
+                }
+            }
+
+            // Moves to the name table of the current block or of the next
+            // block that has one.
+            void EnterChunk() {
+                for (; _Image->IsReadable(_Descriptor, sizeof(*_Descriptor)) && _Descriptor->rvaHmod; ++_Descriptor) {
+                    _NameTable = reinterpret_cast<PIMAGE_THUNK_DATA>(ToAddr(_Descriptor->rvaINT));
+                    if (_Image->IsReadable(_NameTable, sizeof(*_NameTable)) && _NameTable->u1.Ordinal) {
+                        _Entry.module = reinterpret_cast<LPCSTR>(ToAddr(_Descriptor->rvaDLLName));
+                        _Entry.module = _Image->IsString(_Entry.module) ? _Entry.module : nullptr;
+                        _Entry.iat    = reinterpret_cast<PIMAGE_THUNK_DATA>(ToAddr(_Descriptor->rvaIAT));
+                        return;
+                    }
+                }
+                _NameTable = nullptr;
+            }
+
+            // Returns false for an import whose name cannot be read.
+            bool Load() {
+                if (IMAGE_SNAP_BY_ORDINAL(_NameTable->u1.Ordinal)) {
+                    _Entry.ordinal = static_cast<WORD>(IMAGE_ORDINAL32(_NameTable->u1.Ordinal));
+                    _Entry.name    = nullptr;
+                    _Entry.hint    = 0;
+                    return true;
+                }
+
+                auto import = reinterpret_cast<PIMAGE_IMPORT_BY_NAME>(
+                    ToAddr(static_cast<DWORD>(_NameTable->u1.ForwarderString)));
+                if (!_Image->IsReadable(import, sizeof(WORD)) ||
+                    !_Image->IsString(reinterpret_cast<LPCSTR>(&import->Name))) {
+                    return false;
+                }
+                _Entry.ordinal = 0;
+                _Entry.name    = reinterpret_cast<LPCSTR>(&import->Name);
+                _Entry.hint    = import->Hint;
+                return true;
+            }
+
+            const PEImage*       _Image      = nullptr;
+            PImgDelayDescr       _Descriptor = nullptr;
+            PIMAGE_THUNK_DATA    _NameTable  = nullptr;
+            PEImage::ImportEntry _Entry;
+        };
+
+        explicit PEDelayImportRange(_In_ const PEImage& image)
+            : _Image(&image) {
+            if (image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT) != 0) {
+                _First = reinterpret_cast<PImgDelayDescr>(
+                    image.GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT));
+            }
+        }
+
+        iterator begin() const {
+            return iterator(_Image, _First);
+        }
+
+        iterator end() const {
+            return iterator(_Image, nullptr);
+        }
+
+    private:
+        const PEImage* _Image;
+        PImgDelayDescr _First = nullptr;
+    };
+
+    class PERelocRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = PEImage::RelocEntry;
+            using difference_type   = ptrdiff_t;
+            using pointer           = const PEImage::RelocEntry*;
+            using reference         = const PEImage::RelocEntry&;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return _Entry;
+            }
+
+            pointer operator->() const {
+                return &_Entry;
+            }
+
+            iterator& operator++() {
+                if (++_Reloc != _BlockEnd) {
+                    Load();
+                }
+                else {
+                    _Block = reinterpret_cast<PIMAGE_BASE_RELOCATION>(_BlockEnd);
+                    EnterBlock();
+                }
+                return *this;
+            }
+
+            iterator operator++(int) {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator& other) const {
+                return _Reloc == other._Reloc;
+            }
+
+            bool operator!=(const iterator& other) const {
+                return _Reloc != other._Reloc;
+            }
+
+        private:
+            friend class PERelocRange;
+
+            iterator(const PEImage* image, PIMAGE_BASE_RELOCATION block, PBYTE end)
+                : _Image(image), _Block(block), _End(end) {
+                EnterBlock();
+            }
+
+            // Moves to the first entry of the current block or of the next
+            // block that has one. A block must hold its header, fit in the
+            // directory and be readable.
+            void EnterBlock() {
+                while (_Block && _End - reinterpret_cast<PBYTE>(_Block) >= static_cast<ptrdiff_t>(sizeof(IMAGE_BASE_RELOCATION)) &&
+                    _Image->IsReadable(_Block, sizeof(IMAGE_BASE_RELOCATION)) &&
+                    _Block->SizeOfBlock >= sizeof(IMAGE_BASE_RELOCATION) &&
+                    _Block->SizeOfBlock <= static_cast<size_t>(_End - reinterpret_cast<PBYTE>(_Block)) &&
+                    _Image->IsReadable(_Block, _Block->SizeOfBlock)) {
+                    _Reloc    = reinterpret_cast<PWORD>(_Block + 1);
+                    _BlockEnd = reinterpret_cast<PWORD>(reinterpret_cast<PBYTE>(_Block) + (_Block->SizeOfBlock & ~1u));
+                    if (_Reloc != _BlockEnd) {
+                        Load();
+                        return;
+                    }
+                    _Block = reinterpret_cast<PIMAGE_BASE_RELOCATION>(_BlockEnd);
+                }
+                _Reloc = nullptr;
+            }
+
+            void Load() {
+                _Entry.type    = *_Reloc >> 12;
+                _Entry.address = _Image->RVAToAddr(_Block->VirtualAddress + (*_Reloc & 0x0FFF));
+            }
+
+            const PEImage*         _Image    = nullptr;
+            PIMAGE_BASE_RELOCATION _Block    = nullptr;
+            PBYTE                  _End      = nullptr;
+            PWORD                  _Reloc    = nullptr;
+            PWORD                  _BlockEnd = nullptr;
+            PEImage::RelocEntry    _Entry;
+        };
+
+        explicit PERelocRange(_In_ const PEImage& image)
+            : _Image(&image) {
+            auto directory = reinterpret_cast<PBYTE>(image.GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_BASERELOC));
+            if (directory != nullptr) {
+                _First = reinterpret_cast<PIMAGE_BASE_RELOCATION>(directory);
+                _End   = directory + image.GetImageDirectoryEntrySize(IMAGE_DIRECTORY_ENTRY_BASERELOC);
+            }
+        }
+
+        iterator begin() const {
+            return iterator(_Image, _First, _End);
+        }
+
+        iterator end() const {
+            return iterator(_Image, nullptr, nullptr);
+        }
+
+    private:
+        const PEImage*         _Image;
+        PIMAGE_BASE_RELOCATION _First = nullptr;
+        PBYTE                  _End   = nullptr;
+    };
+
     inline bool PEImage::IsOrdinal(_In_ LPCSTR name) {
+#ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable: 4311)
+#endif
         // This cast generates a warning because it is 32 bit specific.
         return reinterpret_cast<size_t>(name) <= 0xFFFF;
+#ifdef _MSC_VER
 #pragma warning(pop)
+#endif
     }
 
     inline WORD PEImage::ToOrdinal(_In_ LPCSTR name) {
@@ -233,13 +919,35 @@ namespace base::modules
     }
 
     inline PIMAGE_IMPORT_DESCRIPTOR PEImage::GetFirstImportChunk() const {
-        return reinterpret_cast<PIMAGE_IMPORT_DESCRIPTOR>(
+        auto import = reinterpret_cast<PIMAGE_IMPORT_DESCRIPTOR>(
             GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_IMPORT));
+        return IsReadable(import, sizeof(*import)) ? import : nullptr;
     }
 
     inline PIMAGE_EXPORT_DIRECTORY PEImage::GetExportDirectory() const {
-        return reinterpret_cast<PIMAGE_EXPORT_DIRECTORY>(
+        auto exports = reinterpret_cast<PIMAGE_EXPORT_DIRECTORY>(
             GetImageDirectoryEntryAddr(IMAGE_DIRECTORY_ENTRY_EXPORT));
+        return IsReadable(exports, sizeof(*exports)) ? exports : nullptr;
+    }
+
+    inline PESectionRange PEImage::Sections() const {
+        return PESectionRange(*this);
+    }
+
+    inline PEExportRange PEImage::Exports() const {
+        return PEExportRange(*this);
+    }
+
+    inline PEImportRange PEImage::Imports() const {
+        return PEImportRange(*this);
+    }
+
+    inline PEDelayImportRange PEImage::DelayImports() const {
+        return PEDelayImportRange(*this);
+    }
+
+    inline PERelocRange PEImage::Relocs() const {
+        return PERelocRange(*this);
     }
 
 }
@@ -0,0 +1,37 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+
+namespace base::modules
+{
+    // Rebases an image to new_base: adds new_base - ImageBase to every
+    // location named by the base relocations, then sets ImageBase to
+    // new_base so the image can be rebased again.
+    //
+    // The image must be laid out as loaded (sections at their RVAs, as by
+    // the loader) and writable; a file mapped as data is not.
+    //
+    // The relocation blocks are validated before anything is written, so a
+    // malformed table leaves the image untouched. Each block is then applied
+    // in one pass, specialized per relocation type; runs of adjacent
+    // HIGHLOW and DIR64 entries (pointer tables, vtables) are added with
+    // SIMD.
+    //
+    // Returns: Windows error code (winerror.h). NO_ERROR if successful or if
+    // the image already is at new_base. ERROR_BAD_EXE_FORMAT if a block or a
+    // location is outside the image, ERROR_NOT_SUPPORTED if the image has
+    // its relocations stripped or uses a relocation type other than
+    // ABSOLUTE, HIGH, LOW, HIGHLOW, HIGHADJ and DIR64.
+    DWORD ApplyRelocations(
+        _In_ const PEImage& image,
+        _In_ ULONGLONG new_base
+    );
+}
+
+namespace base
+{
+    using modules::ApplyRelocations;
+}
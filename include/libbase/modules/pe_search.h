@@ -0,0 +1,40 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+
+namespace base::modules
+{
+    // A pattern match inside a PE section.
+    struct SectionMatch
+    {
+        DWORD                 Rva;          // RVA of the first matched byte.
+        PIMAGE_SECTION_HEADER Section;      // Section that contains the match.
+    };
+
+    // Searches a signature only in the sections of a PE image whose
+    // characteristics include all the bits of characteristics (by default,
+    // executable code), instead of the whole range of the image. Headers,
+    // resources and relocations are never scanned.
+    //
+    // Works for images loaded by the loader (PEImage) and for files mapped
+    // as data (PEImageAsData, PEFile). Only the initialized part of each
+    // section (SizeOfRawData) is scanned; a section cut short by the end of
+    // a truncated file is skipped.
+    //
+    // Returns true and fills match with the first hit, in section order.
+    bool SearchImageSections(
+        _In_ const PEImage& image,
+        _In_ const memory::BytePattern& pattern,
+        _Out_ SectionMatch* match,
+        _In_opt_ DWORD characteristics = IMAGE_SCN_MEM_EXECUTE
+    );
+}
+
+namespace base
+{
+    using modules::SectionMatch;
+    using modules::SearchImageSections;
+}
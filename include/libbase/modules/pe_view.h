@@ -0,0 +1,217 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+
+namespace base::modules
+{
+    // A read-only view of a PE held in an untrusted buffer (a file read from
+    // disk, a dump, a network payload).
+    //
+    // Unlike PEImage, which trusts every header field, the view validates
+    // the headers, the section table and the data directories once, when it
+    // is constructed. Accessors then read validated data directly; the only
+    // checks left are a bounds compare per RVA translation and per
+    // variable-length record (a string, a relocation block, an import thunk).
+    // A malformed input costs branches, never an access fault, so no
+    // exception handler is needed.
+    //
+    // Both PE32 and PE32+ files are accepted, whatever the build's
+    // architecture: the enumerators and directories work the same for
+    // either. GetNTHeaders returns the headers only when they are of the
+    // build's bitness, as PEImage would read them; GetNTHeaders32 and
+    // GetNTHeaders64 give either. The view refers to the buffer; it must
+    // outlive the view.
+    class PEView
+    {
+    public:
+        // How the buffer is laid out.
+        enum class Layout
+        {
+            File,   // As on disk: RVAs are translated through the section table.
+            Image,  // As mapped by the loader: an RVA is an offset.
+        };
+
+        // A validated range of the buffer.
+        struct Span
+        {
+            const uint8_t* Data = nullptr;
+            size_t         Size = 0;
+
+            bool Empty() const { return Size == 0; }
+        };
+
+        // Callback to enumerate exports.
+        // function_rva is 0 for a forwarded export; forward is the forward
+        // string then. name is nullptr for an export by ordinal.
+        // Returns true to continue the enumeration.
+        using EnumExportsFunction = bool (*)(
+            const PEView& view,
+            DWORD ordinal,
+            DWORD hint,
+            LPCSTR name,
+            DWORD function_rva,
+            LPCSTR forward,
+            PVOID cookie);
+        // Callback to enumerate imports.
+        // name is nullptr for an import by ordinal. iat_rva is the RVA of the
+        // import address table slot.
+        // Returns true to continue the enumeration.
+        using EnumImportsFunction = bool (*)(
+            const PEView& view,
+            LPCSTR module,
+            DWORD ordinal,
+            LPCSTR name,
+            DWORD hint,
+            DWORD iat_rva,
+            PVOID cookie);
+        // Callback to enumerate relocations.
+        // rva is the location to patch.
+        // Returns true to continue the enumeration.
+        using EnumRelocsFunction = bool (*)(
+            const PEView& view,
+            WORD type,
+            DWORD rva,
+            PVOID cookie);
+
+        PEView() = default;
+
+        // Validates the buffer. Check IsValid() afterwards.
+        PEView(_In_reads_bytes_(size) const void* data, _In_ size_t size, _In_opt_ Layout layout = Layout::File);
+
+        // Returns true if the headers and the section table are valid.
+        // Directories that failed validation are reported as empty.
+        bool IsValid() const;
+
+        Layout GetLayout() const;
+
+        const IMAGE_DOS_HEADER* GetDosHeader() const;
+        const IMAGE_FILE_HEADER* GetFileHeader() const;
+        // Returns NULL unless the headers are of the build's bitness.
+        const IMAGE_NT_HEADERS* GetNTHeaders() const;
+        // Return NULL unless the file is PE32, or PE32+, respectively.
+        const IMAGE_NT_HEADERS32* GetNTHeaders32() const;
+        const IMAGE_NT_HEADERS64* GetNTHeaders64() const;
+
+        WORD GetNumSections() const;
+        // Returns NULL if there is no such section.
+        const IMAGE_SECTION_HEADER* GetSectionHeader(_In_ UINT section) const;
+
+        // Returns the bytes of a data directory, or an empty span if the
+        // directory is absent or not inside the buffer.
+        Span GetDirectory(_In_ UINT directory) const;
+
+        // Returns the address of size bytes at rva, or NULL unless all of
+        // them are inside the buffer.
+        const uint8_t* RVAToAddr(_In_ DWORD rva, _In_opt_ size_t size = 1) const;
+
+        // Returns the zero terminated string at rva, or NULL if it is not
+        // terminated inside the buffer.
+        LPCSTR RVAToString(_In_ DWORD rva) const;
+
+        // Enumerators. Records that fail validation are skipped.
+        // cookie is a generic cookie to pass to the callback.
+        // Returns false if the callback stopped the enumeration.
+        bool EnumExports(_In_ EnumExportsFunction callback, _In_opt_ PVOID cookie) const;
+        bool EnumImports(_In_ EnumImportsFunction callback, _In_opt_ PVOID cookie) const;
+        bool EnumRelocs(_In_ EnumRelocsFunction callback, _In_opt_ PVOID cookie) const;
+
+    private:
+        // A section, with its raw data clipped to the buffer.
+        struct Section
+        {
+            DWORD VirtualAddress;
+            DWORD RawOffset;
+            DWORD RawSize;
+        };
+
+        bool ValidateHeaders();
+        void ValidateExports();
+
+        // Returns the address of rva and the number of bytes readable from
+        // there, or NULL.
+        const uint8_t* Translate(_In_ DWORD rva, _Out_ size_t* available) const;
+
+        const uint8_t* _Data   = nullptr;
+        size_t         _Size   = 0;
+        Layout         _Layout = Layout::File;
+        bool           _Valid  = false;
+
+        // One of the two is set, after the optional header magic.
+        const IMAGE_NT_HEADERS32*   _NTHeaders32 = nullptr;
+        const IMAGE_NT_HEADERS64*   _NTHeaders64 = nullptr;
+
+        // The fields the view uses, from either kind of optional header.
+        const IMAGE_FILE_HEADER*    _FileHeader = nullptr;
+        const IMAGE_DATA_DIRECTORY* _DataDirectory = nullptr;
+        DWORD                       _NumberOfRvaAndSizes = 0;
+        DWORD                       _SizeOfHeaders = 0;
+
+        const IMAGE_SECTION_HEADER* _SectionHeaders = nullptr;
+
+        // Sorted by VirtualAddress, for RVA translation.
+        std::vector<Section> _Sections;
+
+        Span _Directories[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+
+        // Export tables, validated against the buffer.
+        const IMAGE_EXPORT_DIRECTORY* _Exports = nullptr;
+        const DWORD* _ExportFunctions = nullptr;
+        const DWORD* _ExportNames     = nullptr;
+        const WORD*  _ExportOrdinals  = nullptr;
+    };
+
+    inline bool PEView::IsValid() const {
+        return _Valid;
+    }
+
+    inline PEView::Layout PEView::GetLayout() const {
+        return _Layout;
+    }
+
+    inline const IMAGE_DOS_HEADER* PEView::GetDosHeader() const {
+        return _Valid ? reinterpret_cast<const IMAGE_DOS_HEADER*>(_Data) : nullptr;
+    }
+
+    inline const IMAGE_FILE_HEADER* PEView::GetFileHeader() const {
+        return _FileHeader;
+    }
+
+    inline const IMAGE_NT_HEADERS* PEView::GetNTHeaders() const {
+        if constexpr (IMAGE_NT_OPTIONAL_HDR_MAGIC == IMAGE_NT_OPTIONAL_HDR64_MAGIC) {
+            return reinterpret_cast<const IMAGE_NT_HEADERS*>(_NTHeaders64);
+        }
+        else {
+            return reinterpret_cast<const IMAGE_NT_HEADERS*>(_NTHeaders32);
+        }
+    }
+
+    inline const IMAGE_NT_HEADERS32* PEView::GetNTHeaders32() const {
+        return _NTHeaders32;
+    }
+
+    inline const IMAGE_NT_HEADERS64* PEView::GetNTHeaders64() const {
+        return _NTHeaders64;
+    }
+
+    inline WORD PEView::GetNumSections() const {
+        return _FileHeader ? _FileHeader->NumberOfSections : 0;
+    }
+
+    inline const IMAGE_SECTION_HEADER* PEView::GetSectionHeader(_In_ UINT section) const {
+        return section < GetNumSections() ? _SectionHeaders + section : nullptr;
+    }
+
+    inline PEView::Span PEView::GetDirectory(_In_ UINT directory) const {
+        return directory < IMAGE_NUMBEROF_DIRECTORY_ENTRIES ? _Directories[directory] : Span{};
+    }
+}
+
+namespace base
+{
+    using modules::PEView;
+}
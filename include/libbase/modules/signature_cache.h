@@ -0,0 +1,92 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+
+namespace base::modules
+{
+    // A persistent cache of signature resolutions (pattern -> RVA) for one
+    // module, so that a process start does not rescan an unchanged binary.
+    //
+    // The cache file is keyed by the module identity: TimeDateStamp and
+    // SizeOfImage from the NT headers plus a hash of the headers and the
+    // section table. A file written for another build of the module is
+    // ignored. The file is a flat array of records sorted by pattern hash;
+    // Load() maps it and lookups binary-search the mapping in place.
+    //
+    // A cached hit is validated by comparing the pattern against the image
+    // at the cached RVA before it is returned. A miss (or a failed
+    // validation) falls back to SearchImageSections and records the result.
+    //
+    // This class is not thread-safe.
+    class SignatureCache
+    {
+    public:
+        static constexpr DWORD kNotFound = 0xFFFFFFFF;
+
+        explicit SignatureCache(_In_ const PEImage& image);
+
+        SignatureCache(const SignatureCache&) = delete;
+        SignatureCache& operator=(const SignatureCache&) = delete;
+
+        // Maps a cache file written by Save().
+        // Returns false if the file is missing, corrupt or belongs to another
+        // build of the module.
+        bool Load(_In_ const std::filesystem::path& file_name);
+
+        // Writes the mapped and the newly resolved records to a cache file.
+        // Returns true on success.
+        bool Save(_In_ const std::filesystem::path& file_name);
+
+        // Resolves the RVA of the first match of pattern in the sections
+        // that match characteristics. See SearchImageSections.
+        // Returns true and sets rva if the pattern was found.
+        bool Resolve(
+            _In_ const memory::BytePattern& pattern,
+            _Out_ DWORD* rva,
+            _In_opt_ DWORD characteristics = IMAGE_SCN_MEM_EXECUTE
+        );
+
+    private:
+        struct Record
+        {
+            uint64_t PatternHash;
+            DWORD    Rva;
+            DWORD    Characteristics;
+        };
+
+        struct FileHeader
+        {
+            DWORD    Magic;
+            DWORD    Version;
+            DWORD    TimeDateStamp;
+            DWORD    SizeOfImage;
+            uint64_t HeadersHash;
+            uint64_t NumberOfRecords;
+        };
+
+        static bool RecordLess(const Record& left, const Record& right);
+
+        const Record* Lookup(_In_ uint64_t pattern_hash, _In_ DWORD characteristics) const;
+
+        const PEImage&          _Image;
+        FileHeader              _Identity{};
+
+        files::MemoryMappedFile _File;
+        const Record*           _Records = nullptr;
+        size_t                  _NumberOfRecords = 0;
+
+        // Resolved since Load(), sorted like the file.
+        std::vector<Record>     _Resolved;
+    };
+}
+
+namespace base
+{
+    using modules::SignatureCache;
+}
@@ -0,0 +1,88 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+#include <memory>
+#include <vector>
+
+
+namespace base::process
+{
+    // Searches the memory of another process for a pattern.
+    //
+    // The committed, readable regions of the target are enumerated with
+    // VirtualQueryEx and read in batches of up to buffer_size bytes with
+    // ReadProcessMemory into a pool of reusable buffers. Off Windows the
+    // regions come from /proc/<pid>/maps and are read with
+    // process_vm_readv, which needs the ptrace access of the target. Linux
+    // has no committed state: every readable mapping is read, including
+    // large reservations that Windows would skip as MEM_RESERVE. Reading and matching
+    // are pipelined: while a worker thread matches one batch, the calling
+    // thread reads the next. Consecutive batches of a region overlap by the
+    // pattern size - 1, so hits that straddle batches are found.
+    class ProcessMemoryScanner
+    {
+    public:
+        // Callback to report matches.
+        // region is the base address of the region in the target process,
+        // offset the position of the match in it. cookie is the value passed
+        // to Scan().
+        // Returns true to continue the scan.
+        using MatchFunction = bool (*)(
+            PVOID region,
+            SIZE_T offset,
+            PVOID cookie);
+
+        explicit ProcessMemoryScanner(
+            _In_opt_ SIZE_T buffer_size = 1024 * 1024,
+            _In_opt_ size_t buffer_count = 3);
+        ~ProcessMemoryScanner();
+
+        ProcessMemoryScanner(const ProcessMemoryScanner&) = delete;
+        ProcessMemoryScanner& operator=(const ProcessMemoryScanner&) = delete;
+
+        // Opens the target process for querying and reading.
+        // Returns: Windows error code (winerror.h). NO_ERROR if successful
+        DWORD Open(_In_ DWORD process_id);
+
+#ifdef _WIN32
+        // Uses a handle with PROCESS_QUERY_INFORMATION and PROCESS_VM_READ
+        // access. The handle is duplicated; the caller keeps ownership.
+        DWORD Open(_In_ HANDLE process);
+#endif
+
+        void Close();
+
+        bool IsOpen() const;
+
+        // Reports every match in the readable memory of the target, region
+        // by region in ascending address order.
+        // Returns: Windows error code (winerror.h). NO_ERROR if the scan
+        // completed or the callback stopped it.
+        DWORD Scan(
+            _In_ const memory::BytePattern& pattern,
+            _In_ MatchFunction callback,
+            _In_opt_ PVOID cookie
+        );
+
+    private:
+#ifdef _WIN32
+        HANDLE _Process = nullptr;
+#else
+        DWORD  _Process = 0;    // The process id.
+#endif
+
+        SIZE_T _BufferSize;
+        std::vector<std::unique_ptr<uint8_t[]>> _Buffers;
+    };
+
+    inline bool ProcessMemoryScanner::IsOpen() const {
+        return _Process != decltype(_Process){};
+    }
+}
+
+namespace base
+{
+    using process::ProcessMemoryScanner;
+}
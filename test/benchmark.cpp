@@ -0,0 +1,203 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <include/libbase/libbase.h>
+#include "test/benchmark.h"
+#include <thread>
+
+namespace
+{
+    // The string matcher is quadratic; larger buffers take minutes.
+    constexpr size_t kMaxStringSearchBytes = 16 * 1024 * 1024;
+
+    // The index costs 4 bytes per buffer byte.
+    constexpr size_t kMaxIndexBytes = 256 * 1024 * 1024;
+
+    // Adds the matchers that need Windows to the portable ones.
+    void BenchCaseMatchers(std::vector<uint8_t>& aBuffer, const BenchCase& aCase)
+    {
+        const auto vData     = aBuffer.data();
+        const auto vBytes    = aCase.Bytes;
+        const auto vText     = aCase.Pattern->Text;
+        const auto vExpected = ExpectedHit(aBuffer, aCase);
+
+        if (vBytes <= kMaxStringSearchBytes)
+        {
+            Run("MemorySearch.String", aCase, vExpected, [&]()
+            {
+                return static_cast<const uint8_t*>(base::MemorySearch(vData, vBytes, vText));
+            });
+        }
+
+        const base::BytePattern vPattern(vText);
+
+        BenchPortableMatchers(aBuffer, aCase, vPattern);
+
+        base::PatternSet vSet;
+        vSet.Add(vPattern);
+
+        Run("PatternSet", aCase, vExpected, [&]()
+        {
+            return vSet.FindFirst(vData, vData + vBytes)[0];
+        });
+
+        Run("MemorySearchParallel", aCase, vExpected, [&]()
+        {
+            return static_cast<const uint8_t*>(base::MemorySearchParallel(vData, vBytes, vPattern));
+        });
+
+        if (vBytes <= kMaxIndexBytes)
+        {
+            base::SearchIndex vIndex;
+
+            const auto vBuild = Measure(1, [&]()
+            {
+                vIndex.Build(vData, vBytes);
+            });
+
+            // The build always reads the whole buffer.
+            auto vBuildCase = aCase;
+            vBuildCase.Scanned = vBytes;
+            Report("SearchIndex.Build", vBuildCase, vBuild);
+
+            Run("SearchIndex", aCase, vExpected, [&]()
+            {
+                return vIndex.Find(vPattern);
+            });
+        }
+    }
+
+    // Parallel search scaling: the pattern sits at the very end of the
+    // buffer so every chunk is scanned.
+    void BenchParallelScaling(std::vector<uint8_t>& aBuffer)
+    {
+        const auto vBytes = aBuffer.size();
+        memcpy(&aBuffer[vBytes - 8], kSignature, 8);
+
+        const base::BytePattern vPattern("48 89 5C ?? 08 57 48 ??");
+        const auto vHardware = std::max(1u, std::thread::hardware_concurrency());
+
+        printf("threads,seconds,gbps,speedup\n");
+
+        auto vBaseline = 0.0;
+        for (auto vThreads = 1u; ; vThreads = std::min(vThreads * 2, vHardware))
+        {
+            const auto vSeconds = Measure(3, [&]()
+            {
+                if (base::MemorySearchParallel(aBuffer.data(), vBytes, vPattern, vThreads) == nullptr)
+                {
+                    abort();
+                }
+            });
+
+            if (vThreads == 1)
+            {
+                vBaseline = vSeconds;
+            }
+
+            printf("%u,%.6f,%.3f,%.2f\n", vThreads, vSeconds,
+                vBytes / vSeconds / 1e9, vBaseline / vSeconds);
+
+            if (vThreads == vHardware)
+            {
+                break;
+            }
+        }
+    }
+
+    // PE corpus scan throughput, per thread count, over a directory tree.
+    void BenchCorpus(const char* aRoot)
+    {
+        const auto vHardware = std::max(1u, std::thread::hardware_concurrency());
+
+        printf("threads,files,images,mb,seconds,files_per_second\n");
+
+        for (auto vThreads = 1u; ; vThreads = std::min(vThreads * 2, vHardware))
+        {
+            base::PECorpusSummary vSummary;
+            base::PECorpusStats   vStats;
+
+            base::PECorpusScanner vScanner(vThreads);
+            if (vScanner.Scan({ aRoot }, &vSummary, &vStats) != NO_ERROR)
+            {
+                abort();
+            }
+
+            printf("%u,%llu,%llu,%.1f,%.3f,%.0f\n", vThreads,
+                static_cast<unsigned long long>(vStats.files), static_cast<unsigned long long>(vStats.images),
+                vStats.bytes / 1e6, vStats.seconds, vStats.FilesPerSecond());
+
+            if (vThreads == vHardware)
+            {
+                break;
+            }
+        }
+    }
+}
+
+// Usage: libbase.bench [--max-mb N] [--baseline results.csv] [--tolerance percent] [--scaling]
+//                      [--corpus directory]
+//
+// Prints one CSV row per measurement to stdout. With --baseline, rows that
+// lost more than --tolerance (default 10) percent of throughput against an
+// earlier run are listed on stderr and the exit code is 1.
+// --scaling runs the thread scaling benchmark of MemorySearchParallel instead.
+// --corpus scans the PE files under a directory with PECorpusScanner instead,
+// once per thread count, and reports files per second.
+int main(int argc, char* argv[])
+{
+    BenchOptions vOptions;
+    auto vScaling = false;
+    auto vCorpus  = (const char*)nullptr;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        const std::string vArgument = argv[i];
+
+        if (ParseBenchOption(argc, argv, &i, &vOptions))
+        {
+            continue;
+        }
+        else if (vArgument == "--scaling")
+        {
+            vScaling = true;
+        }
+        else if (vArgument == "--corpus" && i + 1 < argc)
+        {
+            vCorpus = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--max-mb N] [--baseline results.csv] [--tolerance percent] [--scaling] [--corpus directory]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (vCorpus)
+    {
+        BenchCorpus(vCorpus);
+        return 0;
+    }
+
+    auto vBuffer = MakeBenchBuffer(vOptions.Megabytes);
+
+    if (vScaling)
+    {
+        BenchParallelScaling(vBuffer);
+        return 0;
+    }
+
+    BenchMatrix(vBuffer, BenchCaseMatchers);
+
+    if (vOptions.Baseline && CompareBaseline(vOptions.Baseline, vOptions.Tolerance) != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,426 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// The harness of libbase.bench and libbase.portable.bench: the patterns,
+// the buffer, the timing, the CSV rows and the baseline comparison, and the
+// matchers both of them run. Include it after the libbase headers.
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Returns the best of aRuns wall-clock timings of aBody, in seconds.
+    template<typename Body>
+    double Measure(int aRuns, Body&& aBody)
+    {
+        auto vBest = 1e300;
+        for (auto i = 0; i < aRuns; ++i)
+        {
+            const auto vStart = std::chrono::steady_clock::now();
+            aBody();
+            const auto vElapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - vStart).count();
+
+            vBest = std::min(vBest, vElapsed);
+        }
+        return vBest;
+    }
+
+    // Fills the buffer with pseudo-random bytes skewed like x86 code.
+    void FillBuffer(std::vector<uint8_t>& aBuffer)
+    {
+        uint32_t vState = 0x12345678;
+        for (auto& vByte : aBuffer)
+        {
+            vState = vState * 1664525u + 1013904223u;
+            vByte  = (vState >> 28) < 6 ? 0x00 : static_cast<uint8_t>(vState >> 20);
+        }
+    }
+
+    // The signature every benchmark pattern is a prefix of, with wildcards.
+    const uint8_t kSignature[] = {
+        0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20, 0x48, 0x8B, 0xF9, 0xE8, 0x3B, 0x12,
+        0x00, 0x00, 0x48, 0x8B, 0xCF, 0x48, 0x8B, 0xD8, 0xFF, 0x15, 0xA2, 0x9F, 0x01, 0x00, 0x85, 0xC0,
+    };
+
+    using FixedSearchFunction = void* (*)(void* aAddress, size_t aBytes);
+
+    struct BenchPattern
+    {
+        unsigned            Length;
+        unsigned            Wildcards;  // Percent of wildcard bytes.
+        const char*         Text;
+        FixedSearchFunction SearchFixed;
+    };
+
+// MemorySearch guards the search with SEH, which only Windows has.
+#ifdef _WIN32
+#   define BENCH_FIXED_SEARCH(pattern, address, bytes) base::MemorySearch(address, bytes, pattern)
+#else
+#   define BENCH_FIXED_SEARCH(pattern, address, bytes) \
+        const_cast<uint8_t*>(pattern.Find(static_cast<const uint8_t*>(address), static_cast<const uint8_t*>(address) + bytes))
+#endif
+
+#define BENCH_PATTERN(length, wildcards, text)                                      \
+    BenchPattern{ length, wildcards, text, [](void* aAddress, size_t aBytes) -> void* \
+    {                                                                               \
+        static constexpr auto kPattern = LIBBASE_PATTERN(text);                     \
+        return BENCH_FIXED_SEARCH(kPattern, aAddress, aBytes);                      \
+    } }
+
+    const BenchPattern kPatterns[] = {
+        BENCH_PATTERN( 4,  0, "48 89 5C 24"),
+        BENCH_PATTERN( 4, 25, "48 89 5C ??"),
+        BENCH_PATTERN( 4, 50, "48 ?? 5C ??"),
+        BENCH_PATTERN( 8,  0, "48 89 5C 24 08 57 48 83"),
+        BENCH_PATTERN( 8, 25, "48 89 5C ?? 08 57 48 ??"),
+        BENCH_PATTERN( 8, 50, "48 ?? 5C ?? 08 ?? 48 ??"),
+        BENCH_PATTERN(16,  0, "48 89 5C 24 08 57 48 83 EC 20 48 8B F9 E8 3B 12"),
+        BENCH_PATTERN(16, 25, "48 89 5C ?? 08 57 48 ?? EC 20 48 ?? F9 E8 3B ??"),
+        BENCH_PATTERN(16, 50, "48 ?? 5C ?? 08 ?? 48 ?? EC ?? 48 ?? F9 ?? 3B ??"),
+        BENCH_PATTERN(32,  0, "48 89 5C 24 08 57 48 83 EC 20 48 8B F9 E8 3B 12 00 00 48 8B CF 48 8B D8 FF 15 A2 9F 01 00 85 C0"),
+        BENCH_PATTERN(32, 25, "48 89 5C ?? 08 57 48 ?? EC 20 48 ?? F9 E8 3B ?? 00 00 48 ?? CF 48 8B ?? FF 15 A2 ?? 01 00 85 ??"),
+        BENCH_PATTERN(32, 50, "48 ?? 5C ?? 08 ?? 48 ?? EC ?? 48 ?? F9 ?? 3B ?? 00 ?? 48 ?? CF ?? 8B ?? FF ?? A2 ?? 01 ?? 85 ??"),
+    };
+
+#undef BENCH_PATTERN
+#undef BENCH_FIXED_SEARCH
+
+    const size_t kBufferSizes[] = {
+        4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 256 * 1024 * 1024, 1024 * 1024 * 1024,
+    };
+
+    enum class HitPosition
+    {
+        None,
+        Start,
+        Middle,
+        End,
+    };
+
+    const char* HitPositionName(HitPosition aHit)
+    {
+        switch (aHit)
+        {
+        case HitPosition::Start:  return "start";
+        case HitPosition::Middle: return "middle";
+        case HitPosition::End:    return "end";
+        default:                  return "none";
+        }
+    }
+
+    // Small buffers are searched repeatedly so that a timing covers at least
+    // this many bytes.
+    constexpr size_t kMinBytesPerRun = 4 * 1024 * 1024;
+
+    // StreamSearcher is fed in chunks of this size, as from ReadFile.
+    constexpr size_t kStreamChunkBytes = 64 * 1024;
+
+    struct BenchCase
+    {
+        size_t              Bytes;
+        const BenchPattern* Pattern;
+        HitPosition         Hit;
+        size_t              Scanned;    // Bytes a first-hit search has to look at.
+    };
+
+    // One CSV row per measurement. The first five columns identify it.
+    std::map<std::string, double> gResults;
+
+    void Report(const std::string& aMatcher, const BenchCase& aCase, double aSeconds)
+    {
+        std::ostringstream vKey;
+        vKey << aMatcher << ',' << aCase.Bytes << ',' << aCase.Pattern->Length << ','
+            << aCase.Pattern->Wildcards << ',' << HitPositionName(aCase.Hit);
+
+        const auto vGbps = aCase.Scanned / aSeconds / 1e9;
+        printf("%s,%zu,%.9f,%.3f\n", vKey.str().c_str(), aCase.Scanned, aSeconds, vGbps);
+        fflush(stdout);
+
+        gResults[vKey.str()] = vGbps;
+    }
+
+    // Times one first-hit search; aSearch returns the hit.
+    template<typename Search>
+    void Run(const std::string& aMatcher, const BenchCase& aCase, const uint8_t* aExpected, Search&& aSearch)
+    {
+        const auto vRepeat = std::max<size_t>(1, kMinBytesPerRun / aCase.Bytes);
+
+        const auto vSeconds = Measure(3, [&]()
+        {
+            for (size_t i = 0; i < vRepeat; ++i)
+            {
+                if (aSearch() != aExpected)
+                {
+                    fprintf(stderr, "%s: wrong result\n", aMatcher.c_str());
+                    abort();
+                }
+            }
+        });
+
+        Report(aMatcher, aCase, vSeconds / vRepeat);
+    }
+
+    // Times a search for every hit; it reads the whole buffer whatever
+    // the hit. aSearch returns the first hit.
+    template<typename Search>
+    void RunAll(const std::string& aMatcher, BenchCase aCase, const uint8_t* aExpected, Search&& aSearch)
+    {
+        aCase.Scanned = aCase.Bytes;
+        Run(aMatcher, aCase, aExpected, aSearch);
+    }
+
+    // Returns the hit aCase plants in aBuffer, or NULL.
+    const uint8_t* ExpectedHit(const std::vector<uint8_t>& aBuffer, const BenchCase& aCase)
+    {
+        switch (aCase.Hit)
+        {
+        case HitPosition::Start:  return aBuffer.data();
+        case HitPosition::Middle: return aBuffer.data() + aCase.Bytes / 2;
+        case HitPosition::End:    return aBuffer.data() + aCase.Bytes - aCase.Pattern->Length;
+        default:                  return nullptr;
+        }
+    }
+
+    // The matchers of the files that build without the Windows headers:
+    // the search engines, FixedPattern, SearchAll, StreamSearcher and the
+    // region search.
+    void BenchPortableMatchers(std::vector<uint8_t>& aBuffer, const BenchCase& aCase, const base::BytePattern& aPattern)
+    {
+        const auto vData     = aBuffer.data();
+        const auto vBytes    = aCase.Bytes;
+        const auto vExpected = ExpectedHit(aBuffer, aCase);
+
+        const std::pair<base::SearchEngine, const char*> vEngines[] = {
+            { base::SearchEngine::Scalar, "BytePattern.Scalar" },
+            { base::SearchEngine::SSE2,   "BytePattern.SSE2"   },
+            { base::SearchEngine::AVX2,   "BytePattern.AVX2"   },
+        };
+
+        for (const auto& vEngine : vEngines)
+        {
+            if (!base::memory::IsSearchEngineSupported(vEngine.first))
+            {
+                continue;
+            }
+
+            Run(vEngine.second, aCase, vExpected, [&]()
+            {
+                return aPattern.Find(vData, vData + vBytes, vEngine.first);
+            });
+        }
+
+        Run("FixedPattern", aCase, vExpected, [&]()
+        {
+            return static_cast<const uint8_t*>(aCase.Pattern->SearchFixed(vData, vBytes));
+        });
+
+        RunAll("SearchAll", aCase, vExpected, [&]()
+        {
+            const uint8_t* vFirst = nullptr;
+            for (const auto vHit : base::SearchAll(vData, vBytes, aPattern))
+            {
+                vFirst = vFirst ? vFirst : vHit;
+            }
+            return vFirst;
+        });
+
+        Run("StreamSearcher", aCase, vExpected, [&]()
+        {
+            const base::StreamSearcher::MatchFunction vStop = [](uint64_t aOffset, PVOID aCookie)
+            {
+                *static_cast<uint64_t*>(aCookie) = aOffset;
+                return false;
+            };
+
+            base::StreamSearcher vStream(aPattern);
+            auto vHit = UINT64_MAX;
+
+            for (size_t vOffset = 0; vOffset < vBytes && vHit == UINT64_MAX; vOffset += kStreamChunkBytes)
+            {
+                vStream.Feed(vData + vOffset, std::min(kStreamChunkBytes, vBytes - vOffset), vStop, &vHit);
+            }
+            if (vHit == UINT64_MAX)
+            {
+                vStream.Finish(vStop, &vHit);
+            }
+            return vHit == UINT64_MAX ? nullptr : vData + vHit;
+        });
+
+        Run("MemorySearchReadable", aCase, vExpected, [&]()
+        {
+            return static_cast<const uint8_t*>(base::MemorySearchReadable(vData, vBytes, aPattern));
+        });
+
+        RunAll("MemorySearchAllReadable", aCase, vExpected, [&]()
+        {
+            const auto vHits = base::memory::MemorySearchAllReadable(vData, vBytes, aPattern);
+            return vHits.empty() ? nullptr : static_cast<const uint8_t*>(vHits.front());
+        });
+    }
+
+    // Times the matchers of one case; the signature is planted.
+    using BenchMatchersFunction = void (*)(std::vector<uint8_t>& aBuffer, const BenchCase& aCase);
+
+    // Runs aMatchers over every buffer size, pattern and hit position.
+    void BenchMatrix(std::vector<uint8_t>& aBuffer, BenchMatchersFunction aMatchers)
+    {
+        printf("matcher,buffer_bytes,pattern_length,wildcard_pct,hit,scanned_bytes,seconds,gbps\n");
+
+        for (const auto vBytes : kBufferSizes)
+        {
+            if (vBytes > aBuffer.size())
+            {
+                break;
+            }
+
+            for (const auto& vPattern : kPatterns)
+            {
+                for (const auto vHit : { HitPosition::None, HitPosition::Start, HitPosition::Middle, HitPosition::End })
+                {
+                    auto vOffset = size_t(0);
+                    switch (vHit)
+                    {
+                    case HitPosition::Middle: vOffset = vBytes / 2; break;
+                    case HitPosition::End:    vOffset = vBytes - vPattern.Length; break;
+                    default: break;
+                    }
+
+                    const BenchCase vCase = {
+                        vBytes, &vPattern, vHit, vHit == HitPosition::None ? vBytes : vOffset + vPattern.Length
+                    };
+
+                    // Plant the signature, and remove it again afterwards.
+                    std::vector<uint8_t> vSaved;
+                    if (vHit != HitPosition::None)
+                    {
+                        vSaved.assign(&aBuffer[vOffset], &aBuffer[vOffset] + vPattern.Length);
+                        memcpy(&aBuffer[vOffset], kSignature, vPattern.Length);
+                    }
+
+                    aMatchers(aBuffer, vCase);
+
+                    if (vHit != HitPosition::None)
+                    {
+                        memcpy(&aBuffer[vOffset], vSaved.data(), vSaved.size());
+                    }
+                }
+            }
+        }
+    }
+
+    // Compares the results with a CSV written by an earlier run. A matcher
+    // that lost more than aTolerance percent of its throughput is reported.
+    // Returns the number of regressions.
+    size_t CompareBaseline(const char* aPath, double aTolerance)
+    {
+        std::ifstream vFile(aPath);
+        if (!vFile)
+        {
+            fprintf(stderr, "cannot open baseline %s\n", aPath);
+            return 1;
+        }
+
+        size_t vRegressions = 0;
+
+        std::string vLine;
+        while (std::getline(vFile, vLine))
+        {
+            // matcher,buffer_bytes,pattern_length,wildcard_pct,hit | scanned_bytes,seconds,gbps
+            std::vector<std::string> vColumns;
+            std::istringstream vStream(vLine);
+            for (std::string vColumn; std::getline(vStream, vColumn, ',');)
+            {
+                vColumns.push_back(vColumn);
+            }
+
+            if (vColumns.size() != 8 || vColumns[0] == "matcher")
+            {
+                continue;
+            }
+
+            // Timings under 10us are mostly noise.
+            if (atof(vColumns[6].c_str()) < 10e-6)
+            {
+                continue;
+            }
+
+            const auto vKey = vColumns[0] + ',' + vColumns[1] + ',' + vColumns[2] + ',' + vColumns[3] + ',' + vColumns[4];
+            const auto vResult = gResults.find(vKey);
+            if (vResult == gResults.end())
+            {
+                continue;
+            }
+
+            const auto vBaseline = atof(vColumns[7].c_str());
+            if (vResult->second < vBaseline * (1.0 - aTolerance / 100.0))
+            {
+                fprintf(stderr, "regression: %s %.3f -> %.3f GB/s\n", vKey.c_str(), vBaseline, vResult->second);
+                vRegressions += 1;
+            }
+        }
+
+        return vRegressions;
+    }
+
+    // The options of both benchmarks; see the usage of each.
+    struct BenchOptions
+    {
+        size_t      Megabytes = 1024;
+        double      Tolerance = 10.0;
+        const char* Baseline  = nullptr;
+    };
+
+    // Parses the option at argv[*aIndex], advancing past its value.
+    // Returns false if it is not a common option.
+    bool ParseBenchOption(int argc, char* argv[], int* aIndex, BenchOptions* aOptions)
+    {
+        const std::string vArgument = argv[*aIndex];
+        if (*aIndex + 1 >= argc)
+        {
+            return false;
+        }
+
+        if (vArgument == "--max-mb")
+        {
+            aOptions->Megabytes = strtoul(argv[++*aIndex], nullptr, 10);
+        }
+        else if (vArgument == "--baseline")
+        {
+            aOptions->Baseline = argv[++*aIndex];
+        }
+        else if (vArgument == "--tolerance")
+        {
+            aOptions->Tolerance = atof(argv[++*aIndex]);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Returns the buffer every benchmark searches.
+    std::vector<uint8_t> MakeBenchBuffer(size_t aMegabytes)
+    {
+        std::vector<uint8_t> vBuffer(std::max<size_t>(aMegabytes, 1) * 1024 * 1024);
+        FillBuffer(vBuffer);
+
+        // Every benchmark pattern starts with 48, so without it the signature
+        // only occurs where it is planted.
+        std::replace(vBuffer.begin(), vBuffer.end(), uint8_t(0x48), uint8_t(0x49));
+        return vBuffer;
+    }
+}
@@ -0,0 +1,48 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Benchmarks of the search files that build without the Windows headers
+// (see the portable file list in xmake.lua), so that they also run on Linux.
+// The CSV rows match those of libbase.bench, for the matchers both run.
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+#include "include/libbase/memory/stream_search.h"
+#include "include/libbase/memory/region_search.h"
+#include "test/benchmark.h"
+
+namespace
+{
+    void BenchCaseMatchers(std::vector<uint8_t>& aBuffer, const BenchCase& aCase)
+    {
+        const base::BytePattern vPattern(aCase.Pattern->Text);
+
+        BenchPortableMatchers(aBuffer, aCase, vPattern);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions vOptions;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        if (!ParseBenchOption(argc, argv, &i, &vOptions))
+        {
+            fprintf(stderr, "usage: %s [--max-mb N] [--baseline results.csv] [--tolerance percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    auto vBuffer = MakeBenchBuffer(vOptions.Megabytes);
+
+    BenchMatrix(vBuffer, BenchCaseMatchers);
+
+    if (vOptions.Baseline && CompareBaseline(vOptions.Baseline, vOptions.Tolerance) != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
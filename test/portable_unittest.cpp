@@ -0,0 +1,1356 @@
+// Copyright 2021 The Tapirus-Team Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests of the files that build without the Windows headers (see the
+// portable file list in xmake.lua), so that they also run on Linux.
+
+#include "base/portable.inl"
+#include "include/libbase/memory/search.h"
+#include "include/libbase/memory/stream_search.h"
+#include "include/libbase/modules/pe_view.h"
+#include "include/libbase/files/memory_mapped_file.h"
+#include "include/libbase/modules/pe_parser.h"
+#include "include/libbase/modules/pe_file.h"
+#include "include/libbase/modules/pe_search.h"
+#include "include/libbase/process/memory_scanner.h"
+#include "include/libbase/modules/pe_relocate.h"
+#include "include/libbase/modules/image_mapper.h"
+#include "include/libbase/modules/pe_corpus_scanner.h"
+#include "include/libbase/modules/pe_metadata_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   include <sys/wait.h>
+#   include <unistd.h>
+#endif
+
+namespace
+{
+    // Reports a failed check.
+    bool Fail(const char* aTest, const char* aWhat)
+    {
+        std::cerr << aTest << ": " << aWhat << std::endl;
+        return false;
+    }
+
+    // A pattern with no exact byte has no anchor: every offset must still
+    // be checked against the masks.
+    bool TestFixedPattern()
+    {
+        const uint8_t vZeros[16] = {};
+        const uint8_t vData [16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x7F, 0x00 };
+
+        constexpr auto kNibbles = LIBBASE_PATTERN("4? ??");
+        if (kNibbles.Find(vZeros, vZeros + sizeof(vZeros)) != nullptr)
+        {
+            return Fail(__FUNCTION__, "a nibble pattern matched zeros");
+        }
+        if (kNibbles.Find(vData, vData + sizeof(vData)) != vData + 5)
+        {
+            return Fail(__FUNCTION__, "a nibble pattern missed its match");
+        }
+
+        constexpr auto kLowNibble = LIBBASE_PATTERN("?F");
+        if (kLowNibble.Find(vData, vData + sizeof(vData)) != vData + 6)
+        {
+            return Fail(__FUNCTION__, "a low nibble pattern missed its match");
+        }
+        if (kLowNibble.Find(vData, vData + 6) != nullptr)
+        {
+            return Fail(__FUNCTION__, "a low nibble pattern matched past its range");
+        }
+
+        constexpr auto kWildcards = LIBBASE_PATTERN("?? ??");
+        if (kWildcards.Find(vZeros, vZeros + 2) != vZeros || kWildcards.Find(vZeros, vZeros + 1) != nullptr)
+        {
+            return Fail(__FUNCTION__, "a wildcard pattern did not match at the start");
+        }
+
+        // The same patterns as BytePatterns agree on every offset.
+        std::mt19937 vRandom(7);
+        std::vector<uint8_t> vBuffer(4096);
+        for (auto& vByte : vBuffer)
+        {
+            vByte = static_cast<uint8_t>(vRandom() % 4 == 0 ? 0x40 | (vRandom() & 0x0F) : vRandom() & 0x0F);
+        }
+
+        const base::BytePattern vReference("4? ?? 4?");
+        constexpr auto kFixed = LIBBASE_PATTERN("4? ?? 4?");
+        const auto vFirst = vBuffer.data();
+        const auto vLast  = vBuffer.data() + vBuffer.size();
+
+        for (auto vCursor = vFirst; vCursor < vLast; ++vCursor)
+        {
+            if (kFixed.Find(vCursor, vLast) != vReference.Find(vCursor, vLast, base::SearchEngine::Scalar))
+            {
+                return Fail(__FUNCTION__, "FixedPattern and BytePattern disagree");
+            }
+        }
+
+        return true;
+    }
+
+    // One token of a random pattern, as the reference matcher reads it.
+    struct PatternToken
+    {
+        enum class Kind { Byte, Set, Skip } Type;
+
+        uint8_t Value;
+        uint8_t Mask;
+        uint8_t Members[2];
+        size_t  MinSkip;
+        size_t  MaxSkip;
+    };
+
+    // Returns true if the tokens from aToken on match at aData, trying every
+    // length of each skip.
+    bool MatchReference(
+        const std::vector<PatternToken>& aTokens,
+        size_t aToken,
+        const uint8_t* aData,
+        size_t aAvailable
+    )
+    {
+        if (aToken == aTokens.size())
+        {
+            return true;
+        }
+
+        const auto& vToken = aTokens[aToken];
+        if (vToken.Type == PatternToken::Kind::Skip)
+        {
+            for (auto vSkip = vToken.MinSkip; vSkip <= vToken.MaxSkip && vSkip <= aAvailable; ++vSkip)
+            {
+                if (MatchReference(aTokens, aToken + 1, aData + vSkip, aAvailable - vSkip))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        if (aAvailable == 0)
+        {
+            return false;
+        }
+
+        const auto vMatched = (vToken.Type == PatternToken::Kind::Byte)
+            ? (aData[0] & vToken.Mask) == vToken.Value
+            : aData[0] == vToken.Members[0] || aData[0] == vToken.Members[1];
+
+        return vMatched && MatchReference(aTokens, aToken + 1, aData + 1, aAvailable - 1);
+    }
+
+    // Builds a random pattern over the byte values 0x00-0x02 and 0x40-0x42,
+    // with nibble masks, byte sets and skips.
+    std::string RandomPattern(std::mt19937& aRandom, std::vector<PatternToken>& aTokens)
+    {
+        const auto RandomByte = [&aRandom]() {
+            return static_cast<uint8_t>((aRandom() % 2 ? 0x40 : 0x00) | (aRandom() % 3));
+        };
+
+        std::string vPattern;
+        char vText[32];
+
+        const auto vLength = 1 + aRandom() % 6;
+        for (size_t i = 0; i < vLength; ++i)
+        {
+            PatternToken vToken{ PatternToken::Kind::Byte, 0, 0xFF, {}, 0, 0 };
+
+            switch (aRandom() % 8)
+            {
+            case 0:
+                vToken.Mask = 0x00;
+                snprintf(vText, sizeof(vText), "?? ");
+                break;
+            case 1:
+                vToken.Mask  = 0x0F;
+                vToken.Value = static_cast<uint8_t>(aRandom() % 3);
+                snprintf(vText, sizeof(vText), "?%X ", vToken.Value);
+                break;
+            case 2:
+                vToken.Mask  = 0xF0;
+                vToken.Value = 0x40;
+                snprintf(vText, sizeof(vText), "4? ");
+                break;
+            case 3:
+                vToken.Type       = PatternToken::Kind::Set;
+                vToken.Members[0] = RandomByte();
+                vToken.Members[1] = RandomByte();
+                snprintf(vText, sizeof(vText), "[%02X|%02X] ", vToken.Members[0], vToken.Members[1]);
+                break;
+            case 4:
+                // A skip may not start or end the pattern.
+                if (i > 0 && i + 1 < vLength)
+                {
+                    vToken.Type    = PatternToken::Kind::Skip;
+                    vToken.MinSkip = aRandom() % 3;
+                    vToken.MaxSkip = vToken.MinSkip + aRandom() % 3;
+                    snprintf(vText, sizeof(vText), "{%zu-%zu} ", vToken.MinSkip, vToken.MaxSkip);
+                    break;
+                }
+                [[fallthrough]];
+            default:
+                vToken.Value = RandomByte();
+                snprintf(vText, sizeof(vText), "%02X ", vToken.Value);
+                break;
+            }
+
+            aTokens.push_back(vToken);
+            vPattern += vText;
+        }
+        return vPattern;
+    }
+
+    bool CollectOffset(uint64_t aOffset, PVOID aCookie)
+    {
+        static_cast<std::vector<uint64_t>*>(aCookie)->push_back(aOffset);
+        return true;
+    }
+
+    // Feeds random buffers to StreamSearcher in random chunks, down to
+    // single bytes, and checks the hits against a reference matcher run on
+    // the whole buffer.
+    bool TestStreamSearcher()
+    {
+        std::mt19937 vRandom(11);
+
+        for (auto vRound = 0; vRound < 20000; ++vRound)
+        {
+            std::vector<PatternToken> vTokens;
+            const base::BytePattern vPattern(RandomPattern(vRandom, vTokens));
+            if (!vPattern.IsValid())
+            {
+                return Fail(__FUNCTION__, "a random pattern did not compile");
+            }
+
+            std::vector<uint8_t> vBuffer(vRandom() % 200);
+            for (auto& vByte : vBuffer)
+            {
+                vByte = static_cast<uint8_t>((vRandom() % 2 ? 0x40 : 0x00) | (vRandom() % 3));
+            }
+
+            const auto vMode = (vRandom() % 2) ? base::SearchMode::Overlapping : base::SearchMode::NonOverlapping;
+
+            std::vector<uint64_t> vExpected;
+            for (size_t vStart = 0; vStart < vBuffer.size(); ++vStart)
+            {
+                if (!vExpected.empty() && vMode == base::SearchMode::NonOverlapping &&
+                    vStart < vExpected.back() + vPattern.MinSize())
+                {
+                    continue;
+                }
+                if (MatchReference(vTokens, 0, vBuffer.data() + vStart, vBuffer.size() - vStart))
+                {
+                    vExpected.push_back(vStart);
+                }
+            }
+
+            base::StreamSearcher vSearcher(vPattern, vMode);
+            std::vector<uint64_t> vHits;
+
+            for (size_t vOffset = 0; vOffset < vBuffer.size();)
+            {
+                const auto vChunk = std::min<size_t>(vBuffer.size() - vOffset, 1 + vRandom() % 9);
+
+                // Each chunk is a copy of its own, so that reading past it is
+                // caught by the sanitizers.
+                const std::vector<uint8_t> vCopy(vBuffer.begin() + vOffset, vBuffer.begin() + vOffset + vChunk);
+                vSearcher.Feed(vCopy.data(), vCopy.size(), CollectOffset, &vHits);
+                vOffset += vChunk;
+            }
+            vSearcher.Finish(CollectOffset, &vHits);
+
+            if (vHits != vExpected)
+            {
+                return Fail(__FUNCTION__, "the chunked hits differ from the reference");
+            }
+        }
+
+        return true;
+    }
+
+    // A small PE file laid out as a linker writes it: the headers, .text,
+    // .rdata with an export table, an import table and a CodeView debug
+    // record, and .reloc. aPE32 selects the 32-bit format.
+    class TestPE
+    {
+    public:
+        static constexpr DWORD kTextRva   = 0x1000;
+        static constexpr DWORD kRDataRva  = 0x2000;
+        static constexpr DWORD kRelocRva  = 0x3000;
+        static constexpr DWORD kImportRva = 0x2200;
+        static constexpr DWORD kDebugRva  = 0x2400;
+
+        // Offset of the search signature in .text.
+        static constexpr DWORD kSignatureRva = 0x1040;
+
+        explicit TestPE(bool aPE32)
+            : _Bytes(0xE00)
+            , _PE32(aPE32)
+        {
+            auto vDosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(_Bytes.data());
+            vDosHeader->e_magic  = IMAGE_DOS_SIGNATURE;
+            vDosHeader->e_lfanew = 0x80;
+
+            IMAGE_FILE_HEADER vFileHeader{};
+            vFileHeader.Machine          = aPE32 ? IMAGE_FILE_MACHINE_I386 : IMAGE_FILE_MACHINE_AMD64;
+            vFileHeader.NumberOfSections = 3;
+            vFileHeader.TimeDateStamp    = 0x5EADBEEF;
+
+            IMAGE_DATA_DIRECTORY vDirectories[IMAGE_NUMBEROF_DIRECTORY_ENTRIES]{};
+            vDirectories[IMAGE_DIRECTORY_ENTRY_EXPORT]    = { kRDataRva, 0x110 };
+            vDirectories[IMAGE_DIRECTORY_ENTRY_IMPORT]    = { kImportRva, 3 * sizeof(IMAGE_IMPORT_DESCRIPTOR) };
+            vDirectories[IMAGE_DIRECTORY_ENTRY_DEBUG]     = { kDebugRva, sizeof(IMAGE_DEBUG_DIRECTORY) };
+            vDirectories[IMAGE_DIRECTORY_ENTRY_BASERELOC] = { kRelocRva, 12 };
+
+            size_t vSectionTable = 0;
+            if (aPE32)
+            {
+                IMAGE_NT_HEADERS32 vNtHeaders{};
+                vNtHeaders.Signature  = IMAGE_NT_SIGNATURE;
+                vNtHeaders.FileHeader = vFileHeader;
+                vNtHeaders.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER32);
+                vNtHeaders.OptionalHeader.Magic     = IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+                vNtHeaders.OptionalHeader.ImageBase = 0x00400000;
+                SetOptionalHeader(vNtHeaders.OptionalHeader, vDirectories);
+
+                memcpy(&_Bytes[0x80], &vNtHeaders, sizeof(vNtHeaders));
+                vSectionTable = 0x80 + sizeof(vNtHeaders);
+            }
+            else
+            {
+                IMAGE_NT_HEADERS64 vNtHeaders{};
+                vNtHeaders.Signature  = IMAGE_NT_SIGNATURE;
+                vNtHeaders.FileHeader = vFileHeader;
+                vNtHeaders.FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+                vNtHeaders.OptionalHeader.Magic     = IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+                vNtHeaders.OptionalHeader.ImageBase = 0x140000000ull;
+                SetOptionalHeader(vNtHeaders.OptionalHeader, vDirectories);
+
+                memcpy(&_Bytes[0x80], &vNtHeaders, sizeof(vNtHeaders));
+                vSectionTable = 0x80 + sizeof(vNtHeaders);
+            }
+
+            const IMAGE_SECTION_HEADER vSections[] = {
+                { { '.', 't', 'e', 'x', 't' }, { 0x100 }, kTextRva, 0x200, 0x400, 0, 0, 0, 0,
+                    IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ },
+                { { '.', 'r', 'd', 'a', 't', 'a' }, { 0x600 }, kRDataRva, 0x600, 0x600, 0, 0, 0, 0,
+                    IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ },
+                { { '.', 'r', 'e', 'l', 'o', 'c' }, { 0x10 }, kRelocRva, 0x200, 0xC00, 0, 0, 0, 0,
+                    IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ },
+            };
+            memcpy(&_Bytes[vSectionTable], vSections, sizeof(vSections));
+
+            const uint8_t vSignature[] = { 0x48, 0x8B, 0x05, 0x11, 0x22, 0x33, 0x44, 0xE8 };
+            Put(kSignatureRva, vSignature, sizeof(vSignature));
+
+            WriteExports();
+            WriteImports();
+            WriteDebug();
+            WriteRelocs();
+        }
+
+        const std::vector<uint8_t>& Bytes() const
+        {
+            return _Bytes;
+        }
+
+        // The file laid out as the loader maps it.
+        std::vector<uint8_t> Image() const
+        {
+            std::vector<uint8_t> vImage(0x4000);
+            memcpy(vImage.data(), _Bytes.data(), 0x400);
+            memcpy(&vImage[kTextRva],  &_Bytes[0x400], 0x200);
+            memcpy(&vImage[kRDataRva], &_Bytes[0x600], 0x600);
+            memcpy(&vImage[kRelocRva], &_Bytes[0xC00], 0x200);
+            return vImage;
+        }
+
+    private:
+        template<typename OptionalHeader>
+        static void SetOptionalHeader(
+            OptionalHeader& aHeader,
+            const IMAGE_DATA_DIRECTORY (&aDirectories)[IMAGE_NUMBEROF_DIRECTORY_ENTRIES]
+        )
+        {
+            aHeader.SectionAlignment    = 0x1000;
+            aHeader.FileAlignment       = 0x200;
+            aHeader.SizeOfImage         = 0x4000;
+            aHeader.SizeOfHeaders       = 0x400;
+            aHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+            memcpy(aHeader.DataDirectory, aDirectories, sizeof(aDirectories));
+        }
+
+        // Returns the file offset of an RVA of .text, .rdata or .reloc.
+        static size_t ToOffset(DWORD aRva)
+        {
+            return aRva >= kRelocRva ? aRva - kRelocRva + 0xC00
+                : aRva >= kRDataRva ? aRva - kRDataRva + 0x600
+                : aRva - kTextRva + 0x400;
+        }
+
+        void Put(DWORD aRva, const void* aData, size_t aBytes)
+        {
+            memcpy(&_Bytes[ToOffset(aRva)], aData, aBytes);
+        }
+
+        template<typename T>
+        void Put(DWORD aRva, const T& aValue)
+        {
+            Put(aRva, &aValue, sizeof(aValue));
+        }
+
+        void PutString(DWORD aRva, const char* aString)
+        {
+            Put(aRva, aString, strlen(aString) + 1);
+        }
+
+        // Alpha and Beta, and Fwd forwarded to other.Func; ordinals 1-3.
+        void WriteExports()
+        {
+            IMAGE_EXPORT_DIRECTORY vExports{};
+            vExports.Name                  = 0x2050;
+            vExports.Base                  = 1;
+            vExports.NumberOfFunctions     = 3;
+            vExports.NumberOfNames         = 3;
+            vExports.AddressOfFunctions    = 0x2028;
+            vExports.AddressOfNames        = 0x2034;
+            vExports.AddressOfNameOrdinals = 0x2040;
+            Put(kRDataRva, vExports);
+
+            const DWORD vFunctions[] = { 0x1000, 0x1010, 0x2100 };
+            const DWORD vNames[]     = { 0x2060, 0x2068, 0x2070 };
+            const WORD  vOrdinals[]  = { 0, 1, 2 };
+            Put(vExports.AddressOfFunctions, vFunctions);
+            Put(vExports.AddressOfNames, vNames);
+            Put(vExports.AddressOfNameOrdinals, vOrdinals);
+
+            PutString(vExports.Name, "test.dll");
+            PutString(0x2060, "Alpha");
+            PutString(0x2068, "Beta");
+            PutString(0x2070, "Fwd");
+            PutString(0x2100, "other.Func");
+        }
+
+        // KERNEL32.dll!CreateFileW, #17 and CloseHandle; USER32.dll!MessageBoxW.
+        void WriteImports()
+        {
+            const DWORD vThunkSize = _PE32 ? sizeof(IMAGE_THUNK_DATA32) : sizeof(IMAGE_THUNK_DATA64);
+            const ULONGLONG vOrdinalFlag = _PE32 ? IMAGE_ORDINAL_FLAG32 : IMAGE_ORDINAL_FLAG64;
+
+            const struct
+            {
+                const char* Module;
+                DWORD       ModuleRva;
+                ULONGLONG   Thunks[4];
+                DWORD       NameTable;
+                DWORD       AddressTable;
+            } vChunks[] = {
+                { "KERNEL32.dll", 0x2240, { 0x2260, vOrdinalFlag | 17, 0x2270, 0 }, 0x2300, 0x2380 },
+                { "USER32.dll",   0x2250, { 0x2280, 0 },                            0x2320, 0x23A0 },
+            };
+
+            for (size_t i = 0; i < std::size(vChunks); ++i)
+            {
+                IMAGE_IMPORT_DESCRIPTOR vDescriptor{};
+                vDescriptor.OriginalFirstThunk = vChunks[i].NameTable;
+                vDescriptor.Name               = vChunks[i].ModuleRva;
+                vDescriptor.FirstThunk         = vChunks[i].AddressTable;
+                Put(static_cast<DWORD>(kImportRva + i * sizeof(vDescriptor)), vDescriptor);
+
+                PutString(vChunks[i].ModuleRva, vChunks[i].Module);
+                for (DWORD j = 0; j < 4; ++j)
+                {
+                    Put(vChunks[i].NameTable + j * vThunkSize, &vChunks[i].Thunks[j], vThunkSize);
+                    Put(vChunks[i].AddressTable + j * vThunkSize, &vChunks[i].Thunks[j], vThunkSize);
+                }
+            }
+
+            Put(0x2260, WORD(1));
+            PutString(0x2262, "CreateFileW");
+            Put(0x2270, WORD(2));
+            PutString(0x2272, "CloseHandle");
+            Put(0x2280, WORD(3));
+            PutString(0x2282, "MessageBoxW");
+        }
+
+        // An RSDS record: GUID 01 02 .. 10, age 7, a.pdb.
+        void WriteDebug()
+        {
+            const uint8_t vRecord[] = {
+                'R', 'S', 'D', 'S', 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                7, 0, 0, 0, 'a', '.', 'p', 'd', 'b', 0,
+            };
+
+            IMAGE_DEBUG_DIRECTORY vDebug{};
+            vDebug.Type             = IMAGE_DEBUG_TYPE_CODEVIEW;
+            vDebug.SizeOfData       = sizeof(vRecord);
+            vDebug.AddressOfRawData = kDebugRva + 0x20;
+            vDebug.PointerToRawData = static_cast<DWORD>(ToOffset(kDebugRva + 0x20));
+            Put(kDebugRva, vDebug);
+            Put(kDebugRva + 0x20, vRecord);
+        }
+
+        // Two pointer-sized fixups in .text.
+        void WriteRelocs()
+        {
+            const WORD vType = _PE32 ? IMAGE_REL_BASED_HIGHLOW : IMAGE_REL_BASED_DIR64;
+            const IMAGE_BASE_RELOCATION vBlock{ kTextRva, 12 };
+            const WORD vEntries[] = { WORD(vType << 12 | 0x100), WORD(vType << 12 | 0x108) };
+
+            Put(kRelocRva, vBlock);
+            Put(kRelocRva + sizeof(vBlock), vEntries);
+        }
+
+        std::vector<uint8_t> _Bytes;
+        bool                 _PE32;
+    };
+
+    bool CollectViewExport(
+        const base::PEView& /*aView*/,
+        DWORD aOrdinal,
+        DWORD /*aHint*/,
+        LPCSTR aName,
+        DWORD aFunctionRva,
+        LPCSTR aForward,
+        PVOID aCookie
+    )
+    {
+        auto vEntry = std::to_string(aOrdinal) + ":" + (aName ? aName : "") + "@" + std::to_string(aFunctionRva);
+        if (aForward)
+        {
+            vEntry += std::string("->") + aForward;
+        }
+        static_cast<std::vector<std::string>*>(aCookie)->push_back(vEntry);
+        return true;
+    }
+
+    bool CollectViewImport(
+        const base::PEView& /*aView*/,
+        LPCSTR aModule,
+        DWORD aOrdinal,
+        LPCSTR aName,
+        DWORD /*aHint*/,
+        DWORD aIatRva,
+        PVOID aCookie
+    )
+    {
+        static_cast<std::vector<std::string>*>(aCookie)->push_back(std::string(aModule) + "!" +
+            (aName ? aName : "#" + std::to_string(aOrdinal)) + "@" + std::to_string(aIatRva));
+        return true;
+    }
+
+    bool CollectViewReloc(const base::PEView& /*aView*/, WORD aType, DWORD aRva, PVOID aCookie)
+    {
+        static_cast<std::vector<std::string>*>(aCookie)->push_back(std::to_string(aType) + "@" + std::to_string(aRva));
+        return true;
+    }
+
+    // Returns every export, import and relocation of the view.
+    std::vector<std::string> CollectView(const base::PEView& aView)
+    {
+        std::vector<std::string> vEntries;
+        aView.EnumExports(CollectViewExport, &vEntries);
+        aView.EnumImports(CollectViewImport, &vEntries);
+        aView.EnumRelocs(CollectViewReloc, &vEntries);
+        return vEntries;
+    }
+
+    // Reads PE32 and PE32+ files in both layouts, then corrupted and
+    // truncated copies of them. Each copy is an allocation of its own, so
+    // that the sanitizers catch a read past the buffer.
+    bool TestPEView()
+    {
+        for (const auto vPE32 : { false, true })
+        {
+            const TestPE vFile(vPE32);
+            const auto   vImage = vFile.Image();
+
+            const base::PEView vFileView(vFile.Bytes().data(), vFile.Bytes().size());
+            const base::PEView vImageView(vImage.data(), vImage.size(), base::PEView::Layout::Image);
+            if (!vFileView.IsValid() || !vImageView.IsValid())
+            {
+                return Fail(__FUNCTION__, "a well-formed file was rejected");
+            }
+
+            if ((vFileView.GetNTHeaders32() != nullptr) != vPE32 || (vFileView.GetNTHeaders64() != nullptr) == vPE32 ||
+                vFileView.GetFileHeader()->TimeDateStamp != 0x5EADBEEF || vFileView.GetNumSections() != 3)
+            {
+                return Fail(__FUNCTION__, "the headers were misread");
+            }
+
+            const auto vThunk = vPE32 ? 4 : 8;
+            const auto vType  = std::to_string(vPE32 ? IMAGE_REL_BASED_HIGHLOW : IMAGE_REL_BASED_DIR64);
+            const std::vector<std::string> vExpected = {
+                "1:Alpha@4096", "2:Beta@4112", "3:Fwd@0->other.Func",
+                "KERNEL32.dll!CreateFileW@" + std::to_string(0x2380),
+                "KERNEL32.dll!#17@" + std::to_string(0x2380 + vThunk),
+                "KERNEL32.dll!CloseHandle@" + std::to_string(0x2380 + 2 * vThunk),
+                "USER32.dll!MessageBoxW@" + std::to_string(0x23A0),
+                vType + "@" + std::to_string(0x1100), vType + "@" + std::to_string(0x1108),
+            };
+
+            if (CollectView(vFileView) != vExpected || CollectView(vImageView) != vExpected)
+            {
+                return Fail(__FUNCTION__, "the entries differ from those written");
+            }
+
+            std::mt19937 vRandom(vPE32 ? 32 : 64);
+            for (auto vRound = 0; vRound < 20000; ++vRound)
+            {
+                const auto  vLayout = (vRound & 1) ? base::PEView::Layout::Image : base::PEView::Layout::File;
+                const auto& vSource = (vRound & 1) ? vImage : vFile.Bytes();
+
+                std::vector<uint8_t> vCopy(vSource);
+                for (auto vChanges = 1 + vRandom() % 8; vChanges != 0; --vChanges)
+                {
+                    // Mostly the headers, sometimes anywhere.
+                    const auto vOffset = (vRandom() % 4 == 0) ? vRandom() % vCopy.size() : vRandom() % 0x600;
+                    vCopy[vOffset] = (vRandom() % 3 == 0) ? 0xFF : static_cast<uint8_t>(vRandom());
+                }
+                if (vRandom() % 5 == 0)
+                {
+                    vCopy.resize(vRandom() % vCopy.size());
+                    vCopy.shrink_to_fit();
+                }
+
+                const base::PEView vView(vCopy.data(), vCopy.size(), vLayout);
+                if (!vView.IsValid())
+                {
+                    continue;
+                }
+
+                CollectView(vView);
+                for (UINT i = 0; i < IMAGE_NUMBEROF_DIRECTORY_ENTRIES; ++i)
+                {
+                    const auto vDirectory = vView.GetDirectory(i);
+                    if (!vDirectory.Empty() && vDirectory.Data + vDirectory.Size > vCopy.data() + vCopy.size())
+                    {
+                        return Fail(__FUNCTION__, "a directory reaches past the buffer");
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+    // Writes a file for the file mapping tests.
+    bool WriteTestFile(const std::filesystem::path& aPath, const uint8_t* aData, size_t aBytes)
+    {
+        const auto vFile = std::fopen(aPath.string().c_str(), "wb");
+        if (vFile == nullptr)
+        {
+            return false;
+        }
+
+        const auto vWritten = aBytes ? std::fwrite(aData, 1, aBytes, vFile) : 0;
+        return std::fclose(vFile) == 0 && vWritten == aBytes;
+    }
+
+    // Returns true if the string lies inside the mapping of the file.
+    bool InsideFile(const base::PEImage& aImage, LPCSTR aString)
+    {
+        const auto& vFile = static_cast<const base::PEFile&>(aImage).File();
+        const auto  vData = reinterpret_cast<const char*>(vFile.Data());
+        return aString >= vData && aString + std::strlen(aString) < vData + vFile.Length();
+    }
+
+    bool CollectFileExport(
+        const base::PEImage& aImage,
+        DWORD aOrdinal,
+        DWORD /*aHint*/,
+        LPCSTR aName,
+        PVOID /*aFunction*/,
+        LPCSTR aForward,
+        PVOID aCookie
+    )
+    {
+        if ((aName && !InsideFile(aImage, aName)) || (aForward && !InsideFile(aImage, aForward)))
+        {
+            return false;
+        }
+
+        auto vEntry = std::to_string(aOrdinal) + ":" + (aName ? aName : "");
+        if (aForward)
+        {
+            vEntry += std::string("->") + aForward;
+        }
+        static_cast<std::vector<std::string>*>(aCookie)->push_back(vEntry);
+        return true;
+    }
+
+    bool CollectFileImport(
+        const base::PEImage& aImage,
+        LPCSTR aModule,
+        DWORD aOrdinal,
+        LPCSTR aName,
+        DWORD /*aHint*/,
+        PIMAGE_THUNK_DATA /*aIat*/,
+        PVOID aCookie
+    )
+    {
+        if (!InsideFile(aImage, aModule) || (aName && !InsideFile(aImage, aName)))
+        {
+            return false;
+        }
+
+        static_cast<std::vector<std::string>*>(aCookie)->push_back(std::string(aModule) + "!" +
+            (aName ? aName : "#" + std::to_string(aOrdinal)));
+        return true;
+    }
+
+    // Maps a PE file of the native bitness with PEFile, then truncated
+    // copies of it.
+    bool TestPEFile()
+    {
+        const TestPE vFile(sizeof(void*) == 4);
+        const auto   vPath = std::filesystem::temp_directory_path() / "libbase_portable_unittest.dll";
+
+        if (!WriteTestFile(vPath, vFile.Bytes().data(), vFile.Bytes().size()))
+        {
+            return Fail(__FUNCTION__, "cannot write the test file");
+        }
+
+        auto vPassed = [&]()
+        {
+            base::PEFile vPE;
+            if (!vPE.Initialize(vPath) || !vPE.IsValid() || vPE.File().Length() != vFile.Bytes().size())
+            {
+                return Fail(__FUNCTION__, "a well-formed file was rejected");
+            }
+
+            // .text is at 0x400 in the file.
+            if (reinterpret_cast<const uint8_t*>(vPE.GetProcAddress("Beta")) != vPE.File().Data() + 0x410)
+            {
+                return Fail(__FUNCTION__, "an export was not translated to its file offset");
+            }
+
+            std::vector<std::string> vEntries;
+            if (!vPE.EnumExports(CollectFileExport, &vEntries) || !vPE.EnumAllImports(CollectFileImport, &vEntries))
+            {
+                return Fail(__FUNCTION__, "the enumeration failed");
+            }
+
+            const std::vector<std::string> vExpected = {
+                "1:Alpha", "2:Beta", "3:Fwd->other.Func",
+                "KERNEL32.dll!CreateFileW", "KERNEL32.dll!#17", "KERNEL32.dll!CloseHandle", "USER32.dll!MessageBoxW",
+            };
+            if (vEntries != vExpected)
+            {
+                return Fail(__FUNCTION__, "the entries differ from those written");
+            }
+
+            // The signature is found in .text, and nothing outside the code.
+            const base::BytePattern vSignature("48 8B 05 ?? ?? ?? ?? E8");
+            const base::BytePattern vDllName("74 65 73 74 2E 64 6C 6C 00");
+
+            base::SectionMatch vMatch{};
+            if (!base::SearchImageSections(vPE, vSignature, &vMatch) ||
+                vMatch.Rva != TestPE::kSignatureRva || vMatch.Section != vPE.GetSectionHeader(0))
+            {
+                return Fail(__FUNCTION__, "the signature was not found in .text");
+            }
+            if (base::SearchImageSections(vPE, vDllName, &vMatch) ||
+                !base::SearchImageSections(vPE, vDllName, &vMatch, IMAGE_SCN_CNT_INITIALIZED_DATA) ||
+                vMatch.Section != vPE.GetSectionHeader(1))
+            {
+                return Fail(__FUNCTION__, "the section characteristics were ignored");
+            }
+
+            vPE.Close();
+            if (vPE.IsValid() || vPE.File().Data() != nullptr)
+            {
+                return Fail(__FUNCTION__, "the file is still mapped after Close");
+            }
+
+            // Truncated files are rejected or enumerate only what they hold.
+            for (size_t vLength = 0; vLength < vFile.Bytes().size(); vLength += 0x20)
+            {
+                if (!WriteTestFile(vPath, vFile.Bytes().data(), vLength))
+                {
+                    return Fail(__FUNCTION__, "cannot write the test file");
+                }
+
+                if (!vPE.Initialize(vPath))
+                {
+                    if (vLength >= 0x400)
+                    {
+                        return Fail(__FUNCTION__, "a file with whole headers was rejected");
+                    }
+                    continue;
+                }
+
+                vEntries.clear();
+                vPE.EnumExports(CollectFileExport, &vEntries);
+                vPE.EnumAllImports(CollectFileImport, &vEntries);
+                if (vEntries.size() > vExpected.size())
+                {
+                    return Fail(__FUNCTION__, "a truncated file has more entries than the whole one");
+                }
+
+                // .text is searched only when the file holds all of it.
+                base::SectionMatch vMatch{};
+                if (base::SearchImageSections(vPE, vSignature, &vMatch) != (vLength >= 0x500))
+                {
+                    return Fail(__FUNCTION__, "a truncated .text was searched");
+                }
+            }
+
+            if (vPE.Initialize(vPath.parent_path() / "libbase_portable_unittest.missing"))
+            {
+                return Fail(__FUNCTION__, "a missing file was mapped");
+            }
+            return true;
+        }();
+
+        std::filesystem::remove(vPath);
+        return vPassed;
+    }
+    // Resolves every import to 0x10000 + its hint.
+    bool ResolveByHint(
+        const base::ImageMapper& /*aImage*/,
+        const base::PEImage::ImportEntry& aImport,
+        ULONGLONG* aAddress,
+        PVOID /*aCookie*/
+    )
+    {
+        *aAddress = 0x10000 + aImport.hint;
+        return true;
+    }
+
+#ifndef _WIN32
+    // Returns the permissions and the file of the mapping that holds
+    // aAddress, from /proc/self/maps.
+    std::string DescribeMapping(const void* aAddress)
+    {
+        const auto vMaps = std::fopen("/proc/self/maps", "r");
+        if (vMaps == nullptr)
+        {
+            return {};
+        }
+
+        std::string vResult;
+        char vLine[512];
+        while (std::fgets(vLine, sizeof(vLine), vMaps))
+        {
+            unsigned long long vFirst = 0;
+            unsigned long long vLast = 0;
+            char vPermissions[5] = {};
+            int vPath = 0;
+            if (std::sscanf(vLine, "%llx-%llx %4s %*s %*s %*s %n", &vFirst, &vLast, vPermissions, &vPath) >= 3 &&
+                reinterpret_cast<uintptr_t>(aAddress) >= vFirst && reinterpret_cast<uintptr_t>(aAddress) < vLast)
+            {
+                vResult = std::string(vPermissions) + " " + (vPath ? vLine + vPath : "");
+                vResult.erase(vResult.find_last_not_of(" \n") + 1);
+                break;
+            }
+        }
+
+        std::fclose(vMaps);
+        return vResult;
+    }
+#endif
+
+    // Maps a PE file of the native bitness as the loader would, rebases it,
+    // resolves its imports and protects it; then a file whose sections are
+    // page-aligned, which is mapped from the file copy-on-write off Windows.
+    bool TestImageMapper()
+    {
+        const TestPE vFile(sizeof(void*) == 4);
+        const auto   vPath = std::filesystem::temp_directory_path() / "libbase_portable_unittest.dll";
+
+        if (!WriteTestFile(vPath, vFile.Bytes().data(), vFile.Bytes().size()))
+        {
+            return Fail(__FUNCTION__, "cannot write the test file");
+        }
+
+        auto vPassed = [&]()
+        {
+            base::ImageMapper vMapper;
+            if (vMapper.Map(vPath) != NO_ERROR || !vMapper.IsValid() || vMapper.Size() != 0x4000)
+            {
+                return Fail(__FUNCTION__, "a well-formed file was not mapped");
+            }
+
+            const auto vRegion = reinterpret_cast<uint8_t*>(vMapper.Module());
+            const auto vImage  = vFile.Image();
+            if (memcmp(vRegion, vImage.data(), vImage.size()) != 0)
+            {
+                return Fail(__FUNCTION__, "the region differs from the loader layout");
+            }
+
+            // Each fixup receives the distance from ImageBase to the region.
+            const auto vDelta = reinterpret_cast<uintptr_t>(vRegion) - static_cast<uintptr_t>(vMapper.GetNTHeaders()->OptionalHeader.ImageBase);
+            if (vMapper.Relocate() != NO_ERROR ||
+                vMapper.GetNTHeaders()->OptionalHeader.ImageBase != reinterpret_cast<uintptr_t>(vRegion))
+            {
+                return Fail(__FUNCTION__, "the image was not rebased");
+            }
+
+            uintptr_t vFixup = 0;
+            memcpy(&vFixup, vRegion + 0x1100, sizeof(vFixup));
+            if (vFixup != vDelta)
+            {
+                return Fail(__FUNCTION__, "a fixup was not applied");
+            }
+
+            vMapper.AddImportResolver(ResolveByHint, nullptr);
+            if (vMapper.ResolveImports() != NO_ERROR)
+            {
+                return Fail(__FUNCTION__, "the imports were not resolved");
+            }
+
+            uintptr_t vSlot = 0;
+            memcpy(&vSlot, vRegion + 0x2380, sizeof(vSlot));
+            if (vSlot != 0x10001)
+            {
+                return Fail(__FUNCTION__, "an import address table slot was not filled");
+            }
+
+            if (vMapper.Protect() != NO_ERROR)
+            {
+                return Fail(__FUNCTION__, "the image was not protected");
+            }
+
+#ifndef _WIN32
+            if (DescribeMapping(vRegion).compare(0, 3, "r--") != 0 ||
+                DescribeMapping(vRegion + TestPE::kTextRva).compare(0, 3, "r-x") != 0 ||
+                DescribeMapping(vRegion + TestPE::kRDataRva).compare(0, 3, "r--") != 0)
+            {
+                return Fail(__FUNCTION__, "the sections have the wrong protection");
+            }
+#endif
+
+            // The loader layout as a file: every section starts on a page.
+            auto vAligned = vImage;
+            const auto vNtHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(&vAligned[0x80]);
+            vNtHeaders->OptionalHeader.FileAlignment = 0x1000;
+
+            const auto vSections = IMAGE_FIRST_SECTION(vNtHeaders);
+            for (WORD i = 0; i < vNtHeaders->FileHeader.NumberOfSections; ++i)
+            {
+                vSections[i].PointerToRawData = vSections[i].VirtualAddress;
+                vSections[i].SizeOfRawData    = 0x1000;
+            }
+
+            if (!WriteTestFile(vPath, vAligned.data(), vAligned.size()) || vMapper.Map(vPath) != NO_ERROR ||
+                memcmp(vMapper.Module(), vAligned.data(), vAligned.size()) != 0)
+            {
+                return Fail(__FUNCTION__, "a page-aligned file was not mapped");
+            }
+
+#ifndef _WIN32
+            const auto vRData = reinterpret_cast<uint8_t*>(vMapper.Module()) + TestPE::kRDataRva;
+            if (sysconf(_SC_PAGESIZE) == 0x1000 &&
+                DescribeMapping(vRData).find(vPath.filename().string()) == std::string::npos)
+            {
+                return Fail(__FUNCTION__, "a page-aligned section was not mapped from the file");
+            }
+
+            // Writes stay in the region.
+            vRData[0] ^= 0xFF;
+
+            base::PEFile vOnDisk;
+            if (!vOnDisk.Initialize(vPath) || vOnDisk.File().Data()[TestPE::kRDataRva] != vAligned[TestPE::kRDataRva])
+            {
+                return Fail(__FUNCTION__, "a write to the region reached the file");
+            }
+#endif
+
+            vMapper.Unmap();
+            if (vMapper.IsValid() || vMapper.Module() != nullptr)
+            {
+                return Fail(__FUNCTION__, "the image is still mapped after Unmap");
+            }
+
+            // Only the DOS header: not an image.
+            if (!WriteTestFile(vPath, vFile.Bytes().data(), sizeof(IMAGE_DOS_HEADER)) ||
+                vMapper.Map(vPath) != ERROR_BAD_EXE_FORMAT || vMapper.IsValid())
+            {
+                return Fail(__FUNCTION__, "a truncated file was mapped");
+            }
+
+            if (vMapper.Map(vPath.parent_path() / "libbase_portable_unittest.missing") != ERROR_FILE_NOT_FOUND)
+            {
+                return Fail(__FUNCTION__, "a missing file was mapped");
+            }
+            return true;
+        }();
+
+        std::filesystem::remove(vPath);
+        return vPassed;
+    }
+
+    // Checks a row of a whole test file against what TestPE writes.
+    bool CheckCorpusRow(const base::PECorpusSummary& aSummary, size_t aRow)
+    {
+        const auto vSection = aSummary.first_section[aRow];
+        const auto vImport  = aSummary.first_import[aRow];
+        const auto& vGuid   = aSummary.debug_guid[aRow];
+
+        return aSummary.time_date_stamp[aRow] == 0x5EADBEEF &&
+            aSummary.section_count[aRow] == 3 &&
+            strcmp(aSummary.String(aSummary.section_name[vSection]), ".text") == 0 &&
+            aSummary.section_rva[vSection + 1] == TestPE::kRDataRva &&
+            aSummary.import_count[aRow] == 2 &&
+            strcmp(aSummary.String(aSummary.import_module[vImport]), "KERNEL32.dll") == 0 &&
+            aSummary.import_functions[vImport] == 3 &&
+            strcmp(aSummary.String(aSummary.import_module[vImport + 1]), "USER32.dll") == 0 &&
+            aSummary.import_functions[vImport + 1] == 1 &&
+            aSummary.export_count[aRow] == 3 &&
+            (aSummary.flags[aRow] & base::PECorpusSummary::kHasDebugId) &&
+            aSummary.debug_age[aRow] == 7 && vGuid.Data1 == 0x04030201 && vGuid.Data4[7] == 0x10;
+    }
+
+    // Scans a corpus of aFiles PE32 and PE32+ files, truncated files, empty
+    // files and other files, nested in directories and then all in one
+    // directory, with 1 to 8 threads. Run it under ThreadSanitizer, with a
+    // larger aFiles, to check the work stealing of the pool.
+    bool TestPECorpusScanner(size_t aFiles)
+    {
+        const TestPE vFile64(false);
+        const TestPE vFile32(true);
+        const auto   vRoot = std::filesystem::temp_directory_path() / "libbase_portable_corpus";
+
+        auto vPassed = [&]()
+        {
+            for (const auto vNested : { true, false })
+            {
+                std::error_code vError;
+                std::filesystem::remove_all(vRoot, vError);
+                std::filesystem::create_directories(vRoot);
+
+                std::mt19937 vRandom(static_cast<uint32_t>(aFiles));
+                uint64_t vImages = 0;
+                uint64_t vWhole  = 0;
+                uint64_t vWhole32 = 0;
+
+                for (size_t i = 0; i < aFiles; ++i)
+                {
+                    auto vDirectory = vRoot;
+                    if (vNested)
+                    {
+                        vDirectory = vRoot / ("d" + std::to_string(i % 37)) / ("s" + std::to_string(i % 5));
+                        std::filesystem::create_directories(vDirectory);
+                    }
+
+                    const auto& vBytes = (i & 1) ? vFile32.Bytes() : vFile64.Bytes();
+                    std::vector<uint8_t> vContent;
+                    switch (vRandom() % 10)
+                    {
+                    case 0:  // Not a PE file.
+                        vContent.assign(100 + vRandom() % 1000, 'x');
+                        break;
+                    case 1:  // The headers only.
+                        vContent.assign(vBytes.begin(), vBytes.begin() + 0x300);
+                        ++vImages;
+                        break;
+                    case 2:  // Empty.
+                        break;
+                    default:
+                        vContent = vBytes;
+                        ++vImages;
+                        ++vWhole;
+                        vWhole32 += (i & 1);
+                        break;
+                    }
+
+                    if (!WriteTestFile(vDirectory / ("f" + std::to_string(i) + ".dll"), vContent.data(), vContent.size()))
+                    {
+                        return Fail(__FUNCTION__, "cannot write the corpus");
+                    }
+                }
+
+                // A link back into the tree is not followed.
+                std::filesystem::create_directory_symlink(vRoot, vRoot / "loop", vError);
+
+                for (const size_t vThreads : { 1, 2, 4, 8 })
+                {
+                    base::PECorpusScanner vScanner(vThreads);
+                    base::PECorpusSummary vSummary;
+                    base::PECorpusStats   vStats;
+
+                    if (vScanner.Scan({ vRoot }, &vSummary, &vStats) != NO_ERROR ||
+                        vStats.files != aFiles || vStats.images != vImages || vStats.errors != 0 ||
+                        vSummary.Size() != vImages)
+                    {
+                        return Fail(__FUNCTION__, "the corpus was not counted right");
+                    }
+
+                    uint64_t vRows = 0;
+                    uint64_t vRows32 = 0;
+                    for (size_t vRow = 0; vRow < vSummary.Size(); ++vRow)
+                    {
+                        if (vSummary.file_size[vRow] != vFile64.Bytes().size())
+                        {
+                            continue;
+                        }
+
+                        if (!(vSummary.flags[vRow] & base::PECorpusSummary::kParsed) || !CheckCorpusRow(vSummary, vRow))
+                        {
+                            return Fail(__FUNCTION__, "a row differs from its file");
+                        }
+
+                        ++vRows;
+                        vRows32 += vSummary.machine[vRow] == IMAGE_FILE_MACHINE_I386;
+                    }
+
+                    if (vRows != vWhole || vRows32 != vWhole32)
+                    {
+                        return Fail(__FUNCTION__, "rows are missing");
+                    }
+                }
+            }
+
+            // A root that does not exist is an error; no root is no row.
+            base::PECorpusScanner vScanner(4);
+            base::PECorpusSummary vSummary;
+            base::PECorpusStats   vStats;
+
+            if (vScanner.Scan({ vRoot / "missing" }, &vSummary, &vStats) != NO_ERROR || vStats.errors != 1 ||
+                vScanner.Scan({}, &vSummary, &vStats) != NO_ERROR || vSummary.Size() != 0)
+            {
+                return Fail(__FUNCTION__, "the roots were misread");
+            }
+            return true;
+        }();
+
+        std::error_code vError;
+        std::filesystem::remove_all(vRoot, vError);
+        return vPassed;
+    }
+
+    // Returns the exports of a cached image, as ordinal:name@rva.
+    std::vector<std::string> CollectCachedExports(const base::PEMetadataCache::Image& aImage)
+    {
+        std::vector<std::string> vEntries;
+        for (const auto& vExport : aImage.Exports())
+        {
+            const auto vName = aImage.String(vExport.Name);
+            vEntries.push_back(std::to_string(vExport.Ordinal) + ":" + (vName ? vName : "") + "@" +
+                std::to_string(vExport.FunctionRVA));
+        }
+        return vEntries;
+    }
+
+    // Caches a PE32+ and a PE32 file, saves the store and finds them in it,
+    // then updates one of them.
+    bool TestPEMetadataCache()
+    {
+        const auto vDirectory = std::filesystem::temp_directory_path() / "libbase_portable_cache";
+        const auto vStore = vDirectory / "metadata.store";
+        const std::filesystem::path vPaths[] = { vDirectory / "pe64.dll", vDirectory / "pe32.dll" };
+        const TestPE vFiles[] = { TestPE(false), TestPE(true) };
+
+        std::error_code vError;
+        std::filesystem::remove_all(vDirectory, vError);
+        std::filesystem::create_directories(vDirectory);
+
+        auto vPassed = [&]()
+        {
+            base::PEMetadataCache vCache;
+            base::PEMetadataCache::Image vImage;
+
+            for (size_t i = 0; i < 2; ++i)
+            {
+                if (!WriteTestFile(vPaths[i], vFiles[i].Bytes().data(), vFiles[i].Bytes().size()) || !vCache.Add(vPaths[i]))
+                {
+                    return Fail(__FUNCTION__, "a file was not added");
+                }
+            }
+
+            if (!vCache.Find(vPaths[0], &vImage) || !vCache.Save(vStore))
+            {
+                return Fail(__FUNCTION__, "the staged images were not saved");
+            }
+
+            const std::vector<std::string> vExports = { "1:Alpha@4096", "2:Beta@4112", "3:Fwd@0" };
+            for (size_t i = 0; i < 2; ++i)
+            {
+                if (!vCache.Find(vPaths[i], &vImage) ||
+                    vImage.Record().Machine != (i ? IMAGE_FILE_MACHINE_I386 : IMAGE_FILE_MACHINE_AMD64) ||
+                    vImage.Record().NumberOfSections != 3 || vImage.Record().NumberOfRelocations != 2 ||
+                    CollectCachedExports(vImage) != vExports)
+                {
+                    return Fail(__FUNCTION__, "a saved image was not found");
+                }
+
+#ifndef _WIN32
+                // Found in the mapped store, not in a staged copy.
+                if (DescribeMapping(&vImage.Record()).find(vStore.filename().string()) == std::string::npos)
+                {
+                    return Fail(__FUNCTION__, "the store was not mapped after Save");
+                }
+#endif
+            }
+
+            // A file whose headers changed is not found until it is added
+            // again.
+            auto vChanged = vFiles[0].Bytes();
+            vChanged[0x80 + 8] ^= 0xFF;
+            if (!WriteTestFile(vPaths[0], vChanged.data(), vChanged.size()) || vCache.Find(vPaths[0], &vImage))
+            {
+                return Fail(__FUNCTION__, "a changed file was found");
+            }
+
+            if (!vCache.Add(vPaths[0]) || !vCache.Find(vPaths[0], &vImage) || !vCache.Save(vStore))
+            {
+                return Fail(__FUNCTION__, "a changed file was not updated");
+            }
+
+            base::PEMetadataCache vReloaded;
+            if (!vReloaded.Load(vStore) ||
+                !vReloaded.Find(vPaths[0], &vImage) || vImage.Record().TimeDateStamp != (0x5EADBEEF ^ 0xFF) ||
+                !vReloaded.Find(vPaths[1], &vImage) || vImage.Record().TimeDateStamp != 0x5EADBEEF)
+            {
+                return Fail(__FUNCTION__, "the store does not hold the latest images");
+            }
+
+            // A truncated store is not loaded.
+            if (!WriteTestFile(vStore, vChanged.data(), 0x30) || vReloaded.Load(vStore) || vReloaded.Find(vPaths[1], &vImage))
+            {
+                return Fail(__FUNCTION__, "a truncated store was loaded");
+            }
+            return true;
+        }();
+
+        std::filesystem::remove_all(vDirectory, vError);
+        return vPassed;
+    }
+
+#ifndef _WIN32
+    bool CollectScannerHit(PVOID aRegion, SIZE_T aOffset, PVOID aCookie)
+    {
+        static_cast<std::vector<uint8_t*>*>(aCookie)->push_back(static_cast<uint8_t*>(aRegion) + aOffset);
+        return true;
+    }
+
+    // Plants a pattern in a child process and finds it with the scanner:
+    // once inside a batch and once across two batches.
+    bool TestProcessMemoryScanner()
+    {
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+        // The child would inherit terabytes of shadow memory, all of it
+        // readable and scanned.
+        return true;
+#endif
+
+        constexpr size_t kBufferSize = 0x1000;
+        constexpr size_t kPatternSize = 16;
+
+        // The pattern bytes are computed into the mapping only, so that the
+        // child holds no other copy of them.
+        const auto vMapping = static_cast<uint8_t*>(mmap(nullptr, 4 * kBufferSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (vMapping == MAP_FAILED)
+        {
+            return Fail(__FUNCTION__, "cannot map the planted pages");
+        }
+
+        const std::vector<uint8_t*> vPlanted = { vMapping + 0x100, vMapping + 2 * kBufferSize - 7 };
+        for (const auto vAddress : vPlanted)
+        {
+            for (size_t i = 0; i < kPatternSize; ++i)
+            {
+                vAddress[i] = static_cast<uint8_t>(0xA5 ^ (i * 37));
+            }
+        }
+
+        int vPipe[2];
+        if (pipe(vPipe) != 0)
+        {
+            return Fail(__FUNCTION__, "cannot create the pipe");
+        }
+
+        const auto vChild = fork();
+        if (vChild == 0)
+        {
+            // Wait until the parent closes the pipe.
+            close(vPipe[1]);
+            char vByte;
+            while (read(vPipe[0], &vByte, 1) > 0)
+            {
+            }
+            _exit(0);
+        }
+
+        close(vPipe[0]);
+        munmap(vMapping, 4 * kBufferSize);
+        if (vChild < 0)
+        {
+            close(vPipe[1]);
+            return Fail(__FUNCTION__, "cannot fork");
+        }
+
+        std::string vText;
+        for (size_t i = 0; i < kPatternSize; ++i)
+        {
+            char vHex[4];
+            std::snprintf(vHex, sizeof(vHex), "%02X ", static_cast<uint8_t>(0xA5 ^ (i * 37)));
+            vText += vHex;
+        }
+        const base::BytePattern vPattern(vText);
+
+        auto vPassed = [&]()
+        {
+            base::ProcessMemoryScanner vScanner(kBufferSize);
+            std::vector<uint8_t*> vHits;
+
+            if (vScanner.Scan(vPattern, CollectScannerHit, &vHits) != ERROR_INVALID_HANDLE)
+            {
+                return Fail(__FUNCTION__, "a scanner that is not open scanned");
+            }
+
+            if (vScanner.Open(static_cast<DWORD>(vChild)) != NO_ERROR || !vScanner.IsOpen())
+            {
+                return Fail(__FUNCTION__, "cannot open the child process");
+            }
+
+            if (vScanner.Scan(vPattern, CollectScannerHit, &vHits) != NO_ERROR || vHits != vPlanted)
+            {
+                return Fail(__FUNCTION__, "the planted patterns were not found");
+            }
+
+            vScanner.Close();
+            return !vScanner.IsOpen() || Fail(__FUNCTION__, "the scanner is still open after Close");
+        }();
+
+        close(vPipe[1]);
+        waitpid(vChild, nullptr, 0);
+        return vPassed;
+    }
+#endif
+}
+
+// The optional argument is the number of files of the corpus scanner test.
+int main(int argc, char* argv[])
+{
+    const size_t vCorpusFiles = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+
+    auto vPassed = true;
+    vPassed &= TestFixedPattern();
+    vPassed &= TestStreamSearcher();
+    vPassed &= TestPEView();
+    vPassed &= TestPEFile();
+    vPassed &= TestImageMapper();
+    vPassed &= TestPECorpusScanner(vCorpusFiles);
+    vPassed &= TestPEMetadataCache();
+#ifndef _WIN32
+    vPassed &= TestProcessMemoryScanner();
+#endif
+
+    return vPassed ? 0 : 1;
+}
@@ -7,12 +7,438 @@
 #endif
 
 #include <include/libbase/libbase.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    // Reports a failed check.
+    bool Fail(const char* aTest, const char* aWhat)
+    {
+        std::cerr << aTest << ": " << aWhat << std::endl;
+        return false;
+    }
+
+    // A PE image of the native bitness laid out as loaded: the headers at
+    // the start of aBytes, followed by aSections section headers.
+    class TestImage
+    {
+    public:
+        TestImage(size_t aBytes, WORD aSections)
+            : _Bytes(aBytes)
+        {
+            auto vDosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(_Bytes.data());
+            vDosHeader->e_magic  = IMAGE_DOS_SIGNATURE;
+            vDosHeader->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+
+            auto vNtHeaders = NtHeaders();
+            vNtHeaders->Signature = IMAGE_NT_SIGNATURE;
+#ifdef _WIN64
+            vNtHeaders->FileHeader.Machine = IMAGE_FILE_MACHINE_AMD64;
+#else
+            vNtHeaders->FileHeader.Machine = IMAGE_FILE_MACHINE_I386;
+#endif
+            vNtHeaders->FileHeader.NumberOfSections     = aSections;
+            vNtHeaders->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+
+            auto& vOptional = vNtHeaders->OptionalHeader;
+            vOptional.Magic               = IMAGE_NT_OPTIONAL_HDR_MAGIC;
+            vOptional.ImageBase           = 0x10000000;
+            vOptional.SectionAlignment    = 0x1000;
+            vOptional.FileAlignment       = 0x200;
+            vOptional.SizeOfImage         = static_cast<DWORD>(aBytes);
+            vOptional.SizeOfHeaders       = 0x1000;
+            vOptional.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+        }
+
+        PIMAGE_NT_HEADERS NtHeaders()
+        {
+            return reinterpret_cast<PIMAGE_NT_HEADERS>(_Bytes.data() + sizeof(IMAGE_DOS_HEADER));
+        }
+
+        PIMAGE_SECTION_HEADER Section(size_t aIndex)
+        {
+            return IMAGE_FIRST_SECTION(NtHeaders()) + aIndex;
+        }
+
+        uint8_t* Data()
+        {
+            return _Bytes.data();
+        }
+
+        const std::vector<uint8_t>& Bytes() const
+        {
+            return _Bytes;
+        }
+
+    private:
+        std::vector<uint8_t> _Bytes;
+    };
+
+    // The lookup GetImageSectionFromAddr replaced: the first header, in
+    // header order, whose range holds the address.
+    PIMAGE_SECTION_HEADER FindSectionLinear(const base::PEImage& aImage, PVOID aAddress)
+    {
+        const auto vRva = static_cast<size_t>(static_cast<PBYTE>(aAddress) - reinterpret_cast<PBYTE>(aImage.Module()));
+
+        PIMAGE_SECTION_HEADER vSection = nullptr;
+        for (UINT i = 0; (vSection = aImage.GetSectionHeader(i)) != nullptr; ++i)
+        {
+            if (vSection->VirtualAddress != 0 && vSection->VirtualAddress <= vRva &&
+                vRva - vSection->VirtualAddress < vSection->Misc.VirtualSize)
+            {
+                return vSection;
+            }
+        }
+        return nullptr;
+    }
+
+    // GetImageSectionFromAddr on random section layouts, a third of them
+    // overlapping, against the linear scan.
+    bool TestSectionLookup()
+    {
+        std::mt19937 vRandom(20);
+
+        for (auto vLayout = 0; vLayout < 3000; ++vLayout)
+        {
+            const auto vCount       = static_cast<WORD>(vRandom() % 41);
+            const auto vOverlapping = vLayout % 3 == 0;
+
+            TestImage vImage(0x1000 + vCount * sizeof(IMAGE_SECTION_HEADER), vCount);
+
+            DWORD vNext = 0x1000 * (vRandom() % 2);
+            for (WORD i = 0; i < vCount; ++i)
+            {
+                auto vSection = vImage.Section(i);
+                if (vOverlapping)
+                {
+                    vSection->VirtualAddress   = (vRandom() % 16) * 0x800;
+                    vSection->Misc.VirtualSize = vRandom() % 0x3000;
+                }
+                else
+                {
+                    vSection->VirtualAddress   = vNext;
+                    vSection->Misc.VirtualSize = vRandom() % 4 == 0 ? 0 : (vRandom() % 3 + 1) * 0x800;
+                    vNext += std::max<DWORD>(vSection->Misc.VirtualSize, 0x800) + (vRandom() % 2) * 0x1000;
+                }
+            }
+
+            // Headers out of address order as well.
+            if (!vOverlapping && vLayout % 2)
+            {
+                std::reverse(vImage.Section(0), vImage.Section(vCount));
+            }
+
+            const base::PEImage vParsed(vImage.Data());
+            const base::PEImage vCopy = vParsed;
+
+            for (auto vProbe = 0; vProbe < 200; ++vProbe)
+            {
+                const auto vAddress = vParsed.RVAToAddr(1 + vRandom() % 0x30000);
+                const auto vExpected = FindSectionLinear(vParsed, vAddress);
+
+                if (vParsed.GetImageSectionFromAddr(vAddress) != vExpected ||
+                    vCopy.GetImageSectionFromAddr(vAddress) != vExpected)
+                {
+                    return Fail(__FUNCTION__, "the section differs from the linear scan");
+                }
+            }
+        }
+
+        return true;
+    }
+
+    using SectionKey = std::tuple<PIMAGE_SECTION_HEADER, PVOID, DWORD>;
+    using ExportKey  = std::tuple<DWORD, DWORD, LPCSTR, PVOID, LPCSTR>;
+    using ImportKey  = std::tuple<LPCSTR, DWORD, LPCSTR, DWORD, PIMAGE_THUNK_DATA>;
+    using RelocKey   = std::tuple<WORD, PVOID>;
+
+    bool CollectSection(const base::PEImage& /*aImage*/, PIMAGE_SECTION_HEADER aHeader,
+        PVOID aStart, DWORD aSize, PVOID aCookie)
+    {
+        static_cast<std::vector<SectionKey>*>(aCookie)->emplace_back(aHeader, aStart, aSize);
+        return true;
+    }
+
+    bool CollectExport(const base::PEImage& /*aImage*/, DWORD aOrdinal, DWORD aHint,
+        LPCSTR aName, PVOID aFunction, LPCSTR aForward, PVOID aCookie)
+    {
+        static_cast<std::vector<ExportKey>*>(aCookie)->emplace_back(aOrdinal, aHint, aName, aFunction, aForward);
+        return true;
+    }
+
+    bool CollectImport(const base::PEImage& /*aImage*/, LPCSTR aModule, DWORD aOrdinal,
+        LPCSTR aName, DWORD aHint, PIMAGE_THUNK_DATA aIat, PVOID aCookie)
+    {
+        static_cast<std::vector<ImportKey>*>(aCookie)->emplace_back(aModule, aOrdinal, aName, aHint, aIat);
+        return true;
+    }
+
+    bool CollectReloc(const base::PEImage& /*aImage*/, WORD aType, PVOID aAddress, PVOID aCookie)
+    {
+        static_cast<std::vector<RelocKey>*>(aCookie)->emplace_back(aType, aAddress);
+        return true;
+    }
+
+    // Compares every range of aImage with its Enum* callback and adds the
+    // number of entries seen to aEntries.
+    bool CheckRangeParity(const base::PEImage& aImage, size_t& aEntries)
+    {
+        std::vector<SectionKey> vSections, vSectionRange;
+        aImage.EnumSections(CollectSection, &vSections);
+        for (const auto& vEntry : aImage.Sections())
+        {
+            vSectionRange.emplace_back(vEntry.header, vEntry.section_start, vEntry.section_size);
+        }
+
+        std::vector<ExportKey> vExports, vExportRange;
+        aImage.EnumExports(CollectExport, &vExports);
+        for (const auto& vEntry : aImage.Exports())
+        {
+            vExportRange.emplace_back(vEntry.ordinal, vEntry.hint, vEntry.name, vEntry.function, vEntry.forward);
+        }
+
+        std::vector<ImportKey> vImports, vImportRange;
+        aImage.EnumAllImports(CollectImport, &vImports);
+        for (const auto& vEntry : aImage.Imports())
+        {
+            vImportRange.emplace_back(vEntry.module, vEntry.ordinal, vEntry.name, vEntry.hint, vEntry.iat);
+        }
+
+        std::vector<ImportKey> vDelayImports, vDelayImportRange;
+        aImage.EnumAllDelayImports(CollectImport, &vDelayImports);
+        for (const auto& vEntry : aImage.DelayImports())
+        {
+            vDelayImportRange.emplace_back(vEntry.module, vEntry.ordinal, vEntry.name, vEntry.hint, vEntry.iat);
+        }
+
+        std::vector<RelocKey> vRelocs, vRelocRange;
+        aImage.EnumRelocs(CollectReloc, &vRelocs);
+        for (const auto& vEntry : aImage.Relocs())
+        {
+            vRelocRange.emplace_back(vEntry.type, vEntry.address);
+        }
+
+        aEntries += vSections.size() + vExports.size() + vImports.size() + vDelayImports.size() + vRelocs.size();
+
+        return vSections == vSectionRange && vExports == vExportRange && vImports == vImportRange &&
+            vDelayImports == vDelayImportRange && vRelocs == vRelocRange;
+    }
+
+    // The ranges against the callback enumerators on loaded modules, laid
+    // out as images, and on their files, mapped as data.
+    bool TestRangeParity()
+    {
+        const wchar_t* const kModules[] = { nullptr, L"ntdll.dll", L"kernel32.dll", L"kernelbase.dll" };
+
+        size_t vEntries = 0;
+        for (const auto vName : kModules)
+        {
+            const auto vModule = GetModuleHandleW(vName);
+            if (vModule == nullptr)
+            {
+                continue;
+            }
+
+            if (!CheckRangeParity(base::PEImage(vModule), vEntries))
+            {
+                return Fail(__FUNCTION__, "a range differs from its callback on an image");
+            }
+
+            wchar_t vPath[MAX_PATH]{};
+            base::PEFile vFile;
+            if (GetModuleFileNameW(vModule, vPath, MAX_PATH) == 0 || !vFile.Initialize(vPath))
+            {
+                return Fail(__FUNCTION__, "cannot map the module file");
+            }
+
+            if (!CheckRangeParity(vFile, vEntries))
+            {
+                return Fail(__FUNCTION__, "a range differs from its callback on a file");
+            }
+        }
+
+        return vEntries != 0 || Fail(__FUNCTION__, "nothing was enumerated");
+    }
+
+    // Adds aDelta to the T stored at aAddress.
+    template<typename T>
+    void AddAt(PVOID aAddress, T aDelta)
+    {
+        T vValue{};
+        memcpy(&vValue, aAddress, sizeof(vValue));
+        vValue = static_cast<T>(vValue + aDelta);
+        memcpy(aAddress, &vValue, sizeof(vValue));
+    }
+
+    // The plain loop over Relocs() that ApplyRelocations replaced.
+    void RelocateNaive(const base::PEImage& aImage, ULONGLONG aNewBase)
+    {
+        const auto vNtHeaders = aImage.GetNTHeaders();
+        const auto vDelta     = aNewBase - vNtHeaders->OptionalHeader.ImageBase;
+        const auto vDelta32   = static_cast<DWORD>(vDelta);
+
+        for (const auto& vEntry : aImage.Relocs())
+        {
+            switch (vEntry.type)
+            {
+            case IMAGE_REL_BASED_DIR64:
+                AddAt<ULONGLONG>(vEntry.address, vDelta);
+                break;
+            case IMAGE_REL_BASED_HIGHLOW:
+                AddAt<DWORD>(vEntry.address, vDelta32);
+                break;
+            case IMAGE_REL_BASED_HIGH:
+                AddAt<WORD>(vEntry.address, HIWORD(vDelta32));
+                break;
+            case IMAGE_REL_BASED_LOW:
+                AddAt<WORD>(vEntry.address, LOWORD(vDelta32));
+                break;
+            }
+        }
+
+        vNtHeaders->OptionalHeader.ImageBase = static_cast<decltype(vNtHeaders->OptionalHeader.ImageBase)>(aNewBase);
+    }
+
+    // ApplyRelocations against RelocateNaive on an image with 8 MB of
+    // random data and mixed relocations: runs of DIR64 and HIGHLOW, as in
+    // pointer tables, and single DIR64, HIGHLOW, HIGH and LOW entries.
+    bool TestApplyRelocations()
+    {
+        constexpr DWORD kDataRva   = 0x1000;
+        constexpr DWORD kDataBytes = 8 << 20;
+        constexpr DWORD kPage      = 0x1000;
+
+        std::mt19937 vRandom(22);
+
+        // The entries of each page, in address order.
+        std::vector<std::vector<WORD>> vPages(kDataBytes / kPage);
+        for (DWORD vRva = 0; vRva + 16 < kDataBytes;)
+        {
+            auto& vEntries = vPages[vRva / kPage];
+            auto  vAdd = [&](WORD aType, DWORD aWidth, DWORD aCount)
+            {
+                for (DWORD i = 0; i < aCount && vRva % kPage + aWidth <= kPage; ++i, vRva += aWidth)
+                {
+                    vEntries.push_back(static_cast<WORD>((aType << 12) | (vRva % kPage)));
+                }
+            };
+
+            switch (vRandom() % 6)
+            {
+            case 0: vAdd(IMAGE_REL_BASED_DIR64, 8, 1 + vRandom() % 40); break;
+            case 1: vAdd(IMAGE_REL_BASED_HIGHLOW, 4, 1 + vRandom() % 12); break;
+            case 2: vAdd(IMAGE_REL_BASED_DIR64, 8, 1); break;
+            case 3: vAdd(IMAGE_REL_BASED_HIGH, 2, 1); break;
+            case 4: vAdd(IMAGE_REL_BASED_LOW, 2, 1); break;
+            default: break;
+            }
+            vRva += vRandom() % 200;
+
+            if (vRva % kPage > kPage - 16)
+            {
+                vRva = (vRva + kPage) & ~(kPage - 1);
+            }
+        }
+
+        // The blocks, each padded to a multiple of 4 bytes with ABSOLUTE.
+        std::vector<WORD> vBlocks;
+        size_t vLastBlock = 0;
+        for (size_t vPage = 0; vPage < vPages.size(); ++vPage)
+        {
+            auto& vEntries = vPages[vPage];
+            if (vEntries.empty())
+            {
+                continue;
+            }
+            if (vEntries.size() % 2)
+            {
+                vEntries.push_back(IMAGE_REL_BASED_ABSOLUTE << 12);
+            }
+
+            IMAGE_BASE_RELOCATION vHeader{};
+            vHeader.VirtualAddress = static_cast<DWORD>(kDataRva + vPage * kPage);
+            vHeader.SizeOfBlock    = static_cast<DWORD>(sizeof(vHeader) + vEntries.size() * sizeof(WORD));
+
+            vLastBlock = vBlocks.size() * sizeof(WORD);
+
+            const auto vHeaderWords = reinterpret_cast<const WORD*>(&vHeader);
+            vBlocks.insert(vBlocks.end(), vHeaderWords, vHeaderWords + sizeof(vHeader) / sizeof(WORD));
+            vBlocks.insert(vBlocks.end(), vEntries.begin(), vEntries.end());
+        }
+
+        const auto vRelocRva   = kDataRva + kDataBytes;
+        const auto vRelocBytes = static_cast<DWORD>(vBlocks.size() * sizeof(WORD));
+
+        TestImage vImage(vRelocRva + ((vRelocBytes + kPage - 1) & ~(kPage - 1)), 2);
+
+        auto vData = vImage.Section(0);
+        memcpy(vData->Name, ".data", 5);
+        vData->VirtualAddress   = kDataRva;
+        vData->Misc.VirtualSize = kDataBytes;
+
+        auto vReloc = vImage.Section(1);
+        memcpy(vReloc->Name, ".reloc", 6);
+        vReloc->VirtualAddress   = vRelocRva;
+        vReloc->Misc.VirtualSize = vRelocBytes;
+
+        auto& vDirectory = vImage.NtHeaders()->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+        vDirectory.VirtualAddress = vRelocRva;
+        vDirectory.Size           = vRelocBytes;
+
+        for (auto vByte = vImage.Data() + kDataRva; vByte != vImage.Data() + vRelocRva; ++vByte)
+        {
+            *vByte = static_cast<uint8_t>(vRandom());
+        }
+        memcpy(vImage.Data() + vRelocRva, vBlocks.data(), vRelocBytes);
+
+        auto vReference = vImage;
+        const base::PEImage vApplied(vImage.Data());
+        const base::PEImage vNaive(vReference.Data());
+
+        for (const ULONGLONG vNewBase : { 0x7ABC0000ull, 0x00400000ull, 0x10000000ull })
+        {
+            if (base::ApplyRelocations(vApplied, vNewBase) != NO_ERROR)
+            {
+                return Fail(__FUNCTION__, "the relocations were rejected");
+            }
+            RelocateNaive(vNaive, vNewBase);
+
+            if (vImage.Bytes() != vReference.Bytes())
+            {
+                return Fail(__FUNCTION__, "the image differs from the naive loop");
+            }
+        }
+
+        // A block reaching past the image is found before anything is
+        // written.
+        auto vLast = reinterpret_cast<PIMAGE_BASE_RELOCATION>(vImage.Data() + vRelocRva + vLastBlock);
+        vLast->VirtualAddress = static_cast<DWORD>(vImage.Bytes().size() - sizeof(WORD));
+        reinterpret_cast<PWORD>(vLast + 1)[0] = IMAGE_REL_BASED_DIR64 << 12;
+
+        const auto vBefore = vImage.Bytes();
+        if (base::ApplyRelocations(vApplied, 0x20000000) != ERROR_BAD_EXE_FORMAT || vImage.Bytes() != vBefore)
+        {
+            return Fail(__FUNCTION__, "a malformed table was not rejected untouched");
+        }
+
+        return true;
+    }
+}
 
 int main(int /*argc*/, char* /*argv*/[])
 {
     base::SetConsoleCodePage();
     base::SetProcessPrivilege(GetCurrentProcessToken(), SE_DEBUG_NAME, true);
 
-    return 0;
+    auto vPassed = true;
+    vPassed &= TestSectionLookup();
+    vPassed &= TestRangeParity();
+    vPassed &= TestApplyRelocations();
+
+    return vPassed ? 0 : 1;
 }
@@ -19,15 +19,52 @@ set_warnings ("allextra", "error")
 
 -- targets
 target("libbase")
-    add_syslinks("advapi32", "wtsapi32")
     set_kind("static")
     add_includedirs(os.scriptdir(), { public = true })
-    add_files("base/**.cpp")
+    if is_plat("windows") then
+        add_syslinks("advapi32", "wtsapi32")
+        add_files("base/**.cpp")
+    else
+        -- Elsewhere only the files that build without the Windows headers.
+        add_syslinks("pthread")
+        add_files("base/memory/search_engine.cpp")
+        add_files("base/memory/stream_search.cpp")
+        add_files("base/memory/region_search.cpp")
+        add_files("base/files/memory_mapped_file.cpp")
+        add_files("base/modules/pe_view.cpp")
+        add_files("base/modules/pe_parser.cpp")
+        add_files("base/modules/pe_file.cpp")
+        add_files("base/modules/pe_search.cpp")
+        add_files("base/modules/pe_relocate.cpp")
+        add_files("base/modules/image_mapper.cpp")
+        add_files("base/modules/pe_corpus_scanner.cpp")
+        add_files("base/modules/pe_metadata_cache.cpp")
+        add_files("base/process/memory_scanner.cpp")
+    end
 
-target("libbase.test")
+if is_plat("windows") then
+    target("libbase.test")
+        set_kind("binary")
+        add_deps("libbase")
+        add_files("test/unittest.cpp")
+
+    target("libbase.bench")
+        set_kind("binary")
+        add_deps("libbase")
+        add_files("test/benchmark.cpp")
+end
+
+-- Tests of the portable files, on every platform.
+target("libbase.portable.test")
+    set_kind("binary")
+    add_deps("libbase")
+    add_files("test/portable_unittest.cpp")
+
+-- Benchmarks of the portable search files, on every platform.
+target("libbase.portable.bench")
     set_kind("binary")
     add_deps("libbase")
-    add_files("test/unittest.cpp")
+    add_files("test/portable_benchmark.cpp")
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io